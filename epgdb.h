@@ -0,0 +1,223 @@
+/* epgdb.h -- on-disk EPG database written by loadepg.
+ *
+ * Copyright (C) 2009-2010  James Courtier-Dutton <James@superbug.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef EPGDB_H
+#define EPGDB_H
+
+/* The file is meant to be mmapped read-only and used in place.
+ * Everything is in the byte order of the machine that wrote it and
+ * refers to other parts by offset from the start of the file, never by
+ * pointer. On a machine of the other byte order the magic does not match,
+ * so such a file is refused rather than misread.
+ *
+ *   header
+ *   channels[channel_count]
+ *   event columns, each event_count long, 8 byte aligned
+ *   string offsets[string_count], then the NUL terminated strings
+ *
+ * The events of a channel are contiguous and in start time order,
+ * events without a title last. String id 0 is the empty string.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define EPGDB_MAGIC 0x42444745 /* "EGDB" */
+#define EPGDB_VERSION 2
+
+#define EPGDB_FLAG_TITLE 0x01
+#define EPGDB_FLAG_SUMMARY 0x02
+
+struct epgdb_header_s {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size; /* Whole file */
+	uint64_t created; /* Unix time */
+	uint64_t epoch; /* Unix time that event starts are relative to */
+	uint32_t channel_count;
+	uint32_t event_count;
+	uint32_t string_count;
+	uint32_t reserved;
+	uint64_t channels;
+	uint64_t start; /* uint32_t, seconds since epoch */
+	uint64_t duration; /* uint32_t, seconds */
+	uint64_t event_id; /* uint16_t */
+	uint64_t theme; /* uint16_t */
+	uint64_t flags; /* uint8_t, EPGDB_FLAG_ */
+	uint64_t title_id; /* uint32_t */
+	uint64_t summary_id; /* uint32_t */
+	uint64_t hash; /* uint32_t, content hash to spot changed events */
+	uint64_t string_offsets; /* uint32_t, from strings */
+	uint64_t strings;
+	uint64_t strings_size;
+};
+
+struct epgdb_channel_s {
+	uint16_t ChannelId;
+	uint16_t Nid;
+	uint16_t Tid;
+	uint16_t Sid;
+	uint16_t SkyNumber1;
+	uint16_t SkyNumber2;
+	uint16_t info;
+	uint16_t reserved;
+	uint32_t first_event;
+	uint32_t event_count;
+};
+
+struct epgdb_s {
+	int fd;
+	uint64_t size;
+	const uint8_t *base;
+	const struct epgdb_header_s *header;
+	const struct epgdb_channel_s *channels;
+	const uint32_t *start;
+	const uint32_t *duration;
+	const uint16_t *event_id;
+	const uint16_t *theme;
+	const uint8_t *flags;
+	const uint32_t *title_id;
+	const uint32_t *summary_id;
+	const uint32_t *hash;
+	const uint32_t *string_offsets;
+	const char *strings;
+};
+
+static inline int epgdb_section_ok( const struct epgdb_header_s *H, uint64_t offset, uint64_t count, uint64_t width )
+{
+	return offset <= H->size && count * width <= H->size - offset;
+}
+
+/* Point db at a database image already in memory, checking it fits in
+ * size bytes. H is the header to go by: normally the image's own, a
+ * reader of memory someone else writes to passes a private copy so the
+ * counts cannot change under it. Returns 0 if the image is not valid.
+ */
+static inline int epgdb_attach( struct epgdb_s *db, const uint8_t *base, uint64_t size, const struct epgdb_header_s *H )
+{
+	uint32_t n;
+
+	if( size < sizeof( struct epgdb_header_s ) ||
+		H->magic != EPGDB_MAGIC || H->version != EPGDB_VERSION || H->size > size ||
+		H->string_count == 0 ||
+		!epgdb_section_ok( H, H->channels, H->channel_count, sizeof( struct epgdb_channel_s ) ) ||
+		!epgdb_section_ok( H, H->start, H->event_count, sizeof( uint32_t ) ) ||
+		!epgdb_section_ok( H, H->duration, H->event_count, sizeof( uint32_t ) ) ||
+		!epgdb_section_ok( H, H->event_id, H->event_count, sizeof( uint16_t ) ) ||
+		!epgdb_section_ok( H, H->theme, H->event_count, sizeof( uint16_t ) ) ||
+		!epgdb_section_ok( H, H->flags, H->event_count, sizeof( uint8_t ) ) ||
+		!epgdb_section_ok( H, H->title_id, H->event_count, sizeof( uint32_t ) ) ||
+		!epgdb_section_ok( H, H->summary_id, H->event_count, sizeof( uint32_t ) ) ||
+		!epgdb_section_ok( H, H->hash, H->event_count, sizeof( uint32_t ) ) ||
+		!epgdb_section_ok( H, H->string_offsets, H->string_count, sizeof( uint32_t ) ) ||
+		!epgdb_section_ok( H, H->strings, H->strings_size, 1 ) ||
+		H->strings_size == 0 || base[H->strings + H->strings_size - 1] != 0 ) {
+		return 0;
+	}
+	db->base = base;
+	db->size = size;
+	db->header = H;
+	db->channels = ( const struct epgdb_channel_s * ) ( base + H->channels );
+	db->start = ( const uint32_t * ) ( base + H->start );
+	db->duration = ( const uint32_t * ) ( base + H->duration );
+	db->event_id = ( const uint16_t * ) ( base + H->event_id );
+	db->theme = ( const uint16_t * ) ( base + H->theme );
+	db->flags = base + H->flags;
+	db->title_id = ( const uint32_t * ) ( base + H->title_id );
+	db->summary_id = ( const uint32_t * ) ( base + H->summary_id );
+	db->hash = ( const uint32_t * ) ( base + H->hash );
+	db->string_offsets = ( const uint32_t * ) ( base + H->string_offsets );
+	db->strings = ( const char * ) ( base + H->strings );
+	for( n = 0; n < H->channel_count; n++ ) {
+		if( db->channels[n].first_event > H->event_count ||
+			db->channels[n].event_count > H->event_count - db->channels[n].first_event ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Map a database read-only. Returns 0 if it is missing or not valid. */
+static inline int epgdb_open( struct epgdb_s *db, const char *FileName )
+{
+	const uint8_t *base;
+	struct stat st;
+
+	memset( db, 0, sizeof( *db ) );
+	db->fd = open( FileName, O_RDONLY );
+	if( db->fd < 0 ) {
+		return 0;
+	}
+	if( fstat( db->fd, &st ) < 0 || st.st_size < ( off_t ) sizeof( struct epgdb_header_s ) ) {
+		close( db->fd );
+		return 0;
+	}
+	base = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, db->fd, 0 );
+	if( base == MAP_FAILED ) {
+		close( db->fd );
+		return 0;
+	}
+	if( !epgdb_attach( db, base, st.st_size, ( const struct epgdb_header_s * ) base ) ) {
+		munmap( ( void * ) base, st.st_size );
+		close( db->fd );
+		db->base = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+static inline void epgdb_close( struct epgdb_s *db )
+{
+	if( db->base ) {
+		munmap( ( void * ) db->base, db->size );
+		close( db->fd );
+	}
+	memset( db, 0, sizeof( *db ) );
+}
+
+static inline const char *epgdb_string( const struct epgdb_s *db, uint32_t id )
+{
+	if( id >= db->header->string_count || db->string_offsets[id] >= db->header->strings_size ) {
+		return "";
+	}
+	return db->strings + db->string_offsets[id];
+}
+
+static inline uint64_t epgdb_start( const struct epgdb_s *db, uint32_t event )
+{
+	return db->header->epoch + db->start[event];
+}
+
+/* Index into db->channels, or -1 */
+static inline int epgdb_find_channel( const struct epgdb_s *db, uint16_t ChannelId )
+{
+	uint32_t n;
+	for( n = 0; n < db->header->channel_count; n++ ) {
+		if( db->channels[n].ChannelId == ChannelId ) {
+			return n;
+		}
+	}
+	return -1;
+}
+
+#endif
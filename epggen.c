@@ -0,0 +1,462 @@
+/* epggen -- synthetic Sky EPG carousel for timing loadepg
+ *
+ * Copyright (C) 2009-2010  James Courtier-Dutton <James@superbug.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+/* Writes a transport stream with a BAT and SDT on PID 0x11, titles on
+ * PID 0x30 and summaries on PID 0x40, the whole carousel sent a number of
+ * times over. Titles and summaries are huffman coded with the dictionary
+ * loadepg uses. The output only depends on the options and the first
+ * day, today unless -m gives one, so runs of different loadepg builds on
+ * it can be compared.
+ *
+ * Like on Sky, every fifth channel is the +1 of the one before it and
+ * carries the same titles and summaries.
+ */
+
+#define PID_SI 0x11
+#define PID_TITLES 0x30
+#define PID_SUMMARIES 0x40
+#define SECTION_SIZE 4096
+#define SECTION_FILL 3000 /* Start a new section past this many bytes of events */
+#define TEXT_SIZE 256
+#define TEXT_CHARS 120
+
+/* Codes of the single character symbols, as '0'/'1' strings */
+char *codes[256];
+/* Prefixes that lead to a longer code, for padding */
+struct node_s {
+	struct node_s *child[2];
+	int leaf;
+};
+struct node_s root;
+
+uint8_t continuity[0x2000];
+FILE *out;
+uint64_t packets;
+
+static const char *const words[] = {
+	"News", "Weather", "The", "Simpsons", "Film", "Live", "Football", "Sport",
+	"Friends", "Doctor", "Who", "Top", "Gear", "Home", "Garden", "Kitchen",
+	"Night", "Show", "Crime", "Story", "World", "Cup", "Match", "Kids",
+};
+#define WORDS ( sizeof( words ) / sizeof( words[0] ) )
+
+static int read_dict( const char *FileName )
+{
+	FILE *File;
+	char line[256];
+	struct node_s *N;
+	char *eq;
+	char *c;
+	int bit;
+
+	File = fopen( FileName, "r" );
+	if( !File ) {
+		printf( "Cannot open '%s'. %s\n", FileName, strerror( errno ) );
+		return 0;
+	}
+	while( fgets( line, sizeof( line ), File ) ) {
+		line[strcspn( line, "\r\n" )] = 0;
+		eq = strrchr( line, '=' );
+		if( !eq || eq == line ) {
+			continue;
+		}
+		*eq = 0;
+		N = &root;
+		for( c = eq + 1; *c == '0' || *c == '1'; c++ ) {
+			bit = *c - '0';
+			if( !N->child[bit] ) {
+				N->child[bit] = calloc( 1, sizeof( struct node_s ) );
+				if( !N->child[bit] ) {
+					fclose( File );
+					return 0;
+				}
+			}
+			N = N->child[bit];
+		}
+		N->leaf = 1;
+		if( eq - line == 1 && !codes[( uint8_t ) line[0]] ) {
+			codes[( uint8_t ) line[0]] = strdup( eq + 1 );
+		}
+	}
+	fclose( File );
+	return 1;
+}
+
+/* Huffman code Text into Data. The first two bits are not part of the
+ * text, and the last byte is padded with bits that complete no symbol.
+ */
+static int encode( const char *Text, uint8_t *Data )
+{
+	struct node_s *N = &root;
+	int bits = 2;
+	const char *c;
+	const char *b;
+
+	memset( Data, 0, TEXT_SIZE );
+	for( ; *Text; Text++ ) {
+		c = codes[( uint8_t ) *Text];
+		if( !c ) {
+			continue;
+		}
+		for( b = c; *b; b++, bits++ ) {
+			if( *b == '1' ) {
+				Data[bits / 8] |= 0x80 >> ( bits % 8 );
+			}
+		}
+	}
+	while( bits % 8 ) {
+		if( N->child[0] && !N->child[0]->leaf ) {
+			N = N->child[0];
+		} else if( N->child[1] && !N->child[1]->leaf ) {
+			N = N->child[1];
+			Data[bits / 8] |= 0x80 >> ( bits % 8 );
+		} else {
+			N = &root;
+		}
+		bits++;
+	}
+	return bits / 8;
+}
+
+static uint32_t crc32_mpeg( const uint8_t *Data, int Length )
+{
+	uint32_t crc = 0xffffffff;
+	int n;
+	while( Length-- ) {
+		crc ^= ( uint32_t ) *Data++ << 24;
+		for( n = 0; n < 8; n++ ) {
+			crc = crc & 0x80000000 ? ( crc << 1 ) ^ 0x04c11db7 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static inline uint8_t *put16( uint8_t *p, uint32_t v )
+{
+	p[0] = v >> 8;
+	p[1] = v;
+	return p + 2;
+}
+
+/* Cut a section into TS packets */
+static void write_section( int Pid, const uint8_t *Section, int Length )
+{
+	uint8_t packet[188];
+	int first = 1;
+	int take;
+
+	while( Length > 0 ) {
+		packet[0] = 0x47;
+		packet[1] = ( first ? 0x40 : 0 ) | Pid >> 8;
+		packet[2] = Pid;
+		packet[3] = 0x10 | continuity[Pid];
+		continuity[Pid] = ( continuity[Pid] + 1 ) & 0xf;
+		take = first ? 183 : 184;
+		if( take > Length ) {
+			take = Length;
+		}
+		memset( packet + 4, 0xff, 184 );
+		if( first ) {
+			packet[4] = 0; /* pointer_field */
+		}
+		memcpy( packet + 188 - ( first ? 183 : 184 ), Section, take );
+		fwrite( packet, 188, 1, out );
+		packets++;
+		Section += take;
+		Length -= take;
+		first = 0;
+	}
+}
+
+/* Long form section around Body, returns its length */
+static int section( uint8_t *Section, int TableId, int Extension, int Number, int Last, const uint8_t *Body, int Length )
+{
+	uint32_t crc;
+	int length = 5 + Length + 4;
+
+	Section[0] = TableId;
+	Section[1] = 0xf0 | ( length >> 8 & 0x0f );
+	Section[2] = length;
+	put16( Section + 3, Extension );
+	Section[5] = 0xc1;
+	Section[6] = Number;
+	Section[7] = Last;
+	memcpy( Section + 8, Body, Length );
+	crc = crc32_mpeg( Section, 8 + Length );
+	Section[8 + Length] = crc >> 24;
+	Section[9 + Length] = crc >> 16;
+	Section[10 + Length] = crc >> 8;
+	Section[11 + Length] = crc;
+	return 12 + Length;
+}
+
+/* Same seed, same text */
+static uint32_t next_random( uint32_t *Seed )
+{
+	*Seed = *Seed * 1103515245 + 12345;
+	return *Seed >> 16;
+}
+
+/* Min to Max words, at most TEXT_CHARS characters so the code fits a descriptor */
+static void make_text( char *Text, uint32_t Seed, int Min, int Max, int Lower )
+{
+	int count;
+	int n;
+	char *p = Text;
+
+	next_random( &Seed );
+	count = Min + next_random( &Seed ) % ( Max - Min + 1 );
+	for( n = 0; n < count && p - Text < TEXT_CHARS; n++ ) {
+		p += sprintf( p, "%s%s", n ? " " : "", words[next_random( &Seed ) % WORDS] );
+	}
+	if( Lower ) {
+		for( p = Text; *p; p++ ) {
+			if( *p >= 'A' && *p <= 'Z' ) {
+				*p += 'a' - 'A';
+			}
+		}
+		strcat( Text, "." );
+	}
+}
+
+static void usage( char *name )
+{
+	printf( "usage: %s [options] <output.ts>\n", name );
+	printf( "  -c <n>     channels (default 600)\n" );
+	printf( "  -d <n>     days (default 7)\n" );
+	printf( "  -e <n>     events per channel and day (default 40)\n" );
+	printf( "  -p <n>     times the carousel is sent (default 2)\n" );
+	printf( "  -s <n>     seed (default 1)\n" );
+	printf( "  -m <mjd>   first day as a Modified Julian Date (default today)\n" );
+	printf( "  -D <file>  huffman dictionary (default conf/sky_uk.dict)\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	uint8_t *bats[64];
+	int bat_length[64];
+	uint8_t *sdts[256];
+	int sdt_length[256];
+	uint8_t body[SECTION_SIZE];
+	uint8_t events[SECTION_SIZE];
+	uint8_t summaries[SECTION_SIZE];
+	uint8_t sec[SECTION_SIZE];
+	uint8_t text[TEXT_SIZE];
+	char str[TEXT_SIZE];
+	char *dict = "conf/sky_uk.dict";
+	uint32_t seed = 1;
+	uint32_t content;
+	uint32_t mjd = time( NULL ) / 86400 + 40587;
+	int channels = 600, days = 7, per_day = 40, passes = 2;
+	int bat_count, sdt_count;
+	int events_used, summaries_used;
+	int spacing;
+	int opt;
+	int pass, c, d, k, n, len, last;
+	uint8_t *p;
+
+	while( ( opt = getopt( argc, argv, "c:d:e:p:s:m:D:" ) ) != -1 ) {
+		switch( opt ) {
+		case 'c':
+			channels = atoi( optarg );
+			break;
+		case 'd':
+			days = atoi( optarg );
+			break;
+		case 'e':
+			per_day = atoi( optarg );
+			break;
+		case 'p':
+			passes = atoi( optarg );
+			break;
+		case 's':
+			seed = strtoul( optarg, NULL, 0 );
+			break;
+		case 'm':
+			mjd = strtoul( optarg, NULL, 0 );
+			break;
+		case 'D':
+			dict = optarg;
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( optind >= argc || channels < 1 || channels > 64 * 100 || days < 1 || days > 28 ||
+		per_day < 1 || per_day > 288 || passes < 1 ) {
+		usage( argv[0] );
+		return 1;
+	}
+	if( !read_dict( dict ) ) {
+		return 1;
+	}
+	out = fopen( argv[optind], "wb" );
+	if( !out ) {
+		printf( "Cannot create '%s'. %s\n", argv[optind], strerror( errno ) );
+		return 1;
+	}
+	spacing = 86400 / per_day;
+
+	/* BAT, 100 channels a section. A padding descriptor makes each span packets. */
+	bat_count = ( channels + 99 ) / 100;
+	for( n = 0; n < bat_count; n++ ) {
+		uint8_t *loop;
+		p = body;
+		p = put16( p, 0xf000 );
+		loop = p;
+		p += 2;
+		p = put16( p, 0x7d4 );
+		p = put16( p, 0x2 );
+		p += 2;
+		last = n * 100 + 100 < channels ? n * 100 + 100 : channels;
+		for( c = n * 100; c < last; c += 25 ) {
+			len = last - c < 25 ? last - c : 25;
+			*p++ = 0xb1;
+			*p++ = len * 9 + 2;
+			*p++ = 0xff;
+			*p++ = 0xff;
+			for( k = c; k < c + len; k++ ) {
+				p = put16( p, 0x1000 + k );
+				*p++ = 1;
+				p = put16( p, 0x540 + k );
+				p = put16( p, 101 + k );
+				p = put16( p, 0xffff );
+			}
+		}
+		put16( loop + 6, 0xf000 | ( p - loop - 8 ) );
+		p = put16( p, 0x7d5 );
+		p = put16( p, 0x2 );
+		p = put16( p, 0xf000 | 202 );
+		*p++ = 0x41;
+		*p++ = 200;
+		memset( p, 0, 200 );
+		p += 200;
+		put16( loop, 0xf000 | ( p - loop - 2 ) );
+		bats[n] = malloc( SECTION_SIZE );
+		bat_length[n] = section( bats[n], 0x4a, 0x1000, n, bat_count > 1 ? bat_count - 1 : 1, body, p - body );
+	}
+	if( bat_count == 1 ) {
+		bats[1] = malloc( SECTION_SIZE );
+		bat_length[1] = section( bats[1], 0x4a, 0x1000, 1, 1, body, p - body );
+		bat_count = 2;
+	}
+
+	/* SDT actual, 40 services a section */
+	sdt_count = ( channels + 39 ) / 40;
+	for( n = 0; n < sdt_count; n++ ) {
+		p = body;
+		p = put16( p, 0x2 );
+		*p++ = 0xff;
+		for( c = n * 40; c < channels && c < n * 40 + 40; c++ ) {
+			len = sprintf( str, "Chan %d", 101 + c );
+			p = put16( p, 0x1000 + c );
+			*p++ = 0xfc;
+			p = put16( p, 0x8000 | ( len + 8 ) );
+			*p++ = 0x48;
+			*p++ = len + 6;
+			*p++ = 1;
+			*p++ = 3;
+			memcpy( p, "SKY", 3 );
+			p += 3;
+			*p++ = len;
+			memcpy( p, str, len );
+			p += len;
+		}
+		/* As on air, a section never fits one packet */
+		memset( p, 0, 200 );
+		p += 200;
+		sdts[n] = malloc( SECTION_SIZE );
+		sdt_length[n] = section( sdts[n], 0x42, 0x7d4, n, sdt_count - 1, body, p - body );
+	}
+
+	for( pass = 0; pass < passes; pass++ ) {
+		for( n = 1; n <= bat_count; n++ ) {
+			write_section( PID_SI, bats[n % bat_count], bat_length[n % bat_count] );
+		}
+		for( n = 0; n < sdt_count; n++ ) {
+			write_section( PID_SI, sdts[n], sdt_length[n] );
+		}
+		for( c = 0; c < channels; c++ ) {
+			/* A +1 channel repeats the schedule of the one before */
+			content = c % 5 == 4 ? c - 1 : c;
+			for( d = 0; d < days; d++ ) {
+				put16( events, mjd + d );
+				put16( summaries, mjd + d );
+				events_used = summaries_used = 2;
+				for( k = 0; k < per_day; k++ ) {
+					make_text( str, seed * 7919 + content * 1000003 + d * 977 + k, 1, 3, 0 );
+					len = encode( str, text );
+					p = events + events_used;
+					p = put16( p, d * per_day + k );
+					p = put16( p, 0xf000 | ( len + 9 ) );
+					*p++ = 0xb5;
+					*p++ = len + 7;
+					p = put16( p, k * spacing / 2 );
+					p = put16( p, spacing / 2 );
+					*p++ = k % 16;
+					p = put16( p, 0xffff );
+					memcpy( p, text, len );
+					events_used = p + len - events;
+
+					make_text( str, seed * 104729 + content * 1000033 + d * 983 + k, 5, 20, 1 );
+					len = encode( str, text );
+					p = summaries + summaries_used;
+					p = put16( p, d * per_day + k );
+					*p++ = 0xb0;
+					*p++ = len + 2;
+					*p++ = 0xb9;
+					*p++ = len;
+					memcpy( p, text, len );
+					summaries_used = p + len - summaries;
+
+					if( events_used > SECTION_FILL || k == per_day - 1 ) {
+						write_section( PID_TITLES, sec, section( sec, 0xa0, 0x540 + c, 0, 0, events, events_used ) );
+						events_used = 2;
+					}
+					if( summaries_used > SECTION_FILL || k == per_day - 1 ) {
+						write_section( PID_SUMMARIES, sec, section( sec, 0xa8, 0x540 + c, 0, 0, summaries, summaries_used ) );
+						summaries_used = 2;
+					}
+				}
+			}
+		}
+	}
+	/* One more section on each PID, so the last real one is seen complete */
+	memset( body, 0, 4 );
+	write_section( PID_SI, sec, section( sec, 0x70, 0, 0, 0, body, 4 ) );
+	write_section( PID_TITLES, sec, section( sec, 0x70, 0, 0, 0, body, 4 ) );
+	write_section( PID_SUMMARIES, sec, section( sec, 0x70, 0, 0, 0, body, 4 ) );
+	if( fclose( out ) != 0 ) {
+		printf( "Error writing '%s'. %s\n", argv[optind], strerror( errno ) );
+		return 1;
+	}
+	printf( "%" PRIu64 " packets, %d channels, %d events\n", packets, channels, channels * days * per_day );
+	return 0;
+}
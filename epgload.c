@@ -0,0 +1,243 @@
+/* epgload -- load generator for the loadepg -u query server
+ *
+ * Copyright (C) 2009-2010  James Courtier-Dutton <James@superbug.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_CLIENTS 1024
+#define MAX_REQUESTS 32
+#define LINE_SIZE 65536
+
+/* Each client keeps one request outstanding and sends the next one,
+ * round robin through the mix, as soon as the reply has ended.
+ */
+struct client_s {
+	int fd;
+	int sent; /* Requests sent */
+	int next; /* In the mix */
+	struct timespec started;
+	char line[LINE_SIZE]; /* Start of the reply line being read */
+	int line_used;
+};
+
+char *requests[MAX_REQUESTS];
+int request_count = 0;
+uint32_t token = 0; /* Last CHANGES token seen, for a bare CHANGES in the mix */
+uint64_t errors = 0;
+uint64_t lines = 0;
+
+static double seconds( const struct timespec *a, const struct timespec *b )
+{
+	return ( b->tv_sec - a->tv_sec ) + ( b->tv_nsec - a->tv_nsec ) / 1e9;
+}
+
+static int compare_double( const void *a, const void *b )
+{
+	double x = *( const double * ) a;
+	double y = *( const double * ) b;
+	return x < y ? -1 : x > y;
+}
+
+static int send_request( struct client_s *K )
+{
+	char buffer[1100];
+	int len;
+
+	if( !strcasecmp( requests[K->next], "CHANGES" ) ) {
+		len = snprintf( buffer, sizeof( buffer ), "CHANGES %u\n", token );
+	} else {
+		len = snprintf( buffer, sizeof( buffer ), "%s\n", requests[K->next] );
+	}
+	K->next = ( K->next + 1 ) % request_count;
+	clock_gettime( CLOCK_MONOTONIC, &K->started );
+	K->sent++;
+	return write( K->fd, buffer, len ) == len;
+}
+
+/* Reads what is there. Returns 1 when the reply ended, 0 when it has not yet and -1 on error. */
+static int read_reply( struct client_s *K )
+{
+	char buffer[65536];
+	ssize_t tmp;
+	ssize_t n;
+	int done = 0;
+
+	tmp = read( K->fd, buffer, sizeof( buffer ) );
+	if( tmp <= 0 ) {
+		return -1;
+	}
+	for( n = 0; n < tmp; n++ ) {
+		if( buffer[n] != '\n' ) {
+			if( K->line_used < LINE_SIZE - 1 ) {
+				K->line[K->line_used++] = buffer[n];
+			}
+			continue;
+		}
+		K->line[K->line_used] = 0;
+		K->line_used = 0;
+		if( !strncmp( K->line, "OK ", 3 ) ) {
+			token = strtoul( strchr( K->line + 3, ' ' ) ? strchr( K->line + 3, ' ' ) + 1 : "0", NULL, 0 );
+			done = 1;
+		} else if( !strncmp( K->line, "ERR", 3 ) ) {
+			errors++;
+			done = 1;
+		} else {
+			lines++;
+		}
+	}
+	return done;
+}
+
+static void usage( char *name )
+{
+	printf( "usage: %s [options] <socket>\n", name );
+	printf( "  -c <n>        concurrent clients (default 16)\n" );
+	printf( "  -n <n>        requests per client (default 1000)\n" );
+	printf( "  -r <request>  add a request to the mix, may be repeated. A bare CHANGES\n" );
+	printf( "                asks for the changes since the last token seen.\n" );
+	printf( "The default mix is \"NOW *\", \"SEARCH news\" and CHANGES.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	struct sockaddr_un addr;
+	struct client_s *clients;
+	struct pollfd *fds;
+	struct timespec begin, end, now;
+	double *latency;
+	uint64_t done = 0;
+	int client_count = 16;
+	int per_client = 1000;
+	int active;
+	int opt;
+	int n;
+
+	while( ( opt = getopt( argc, argv, "c:n:r:" ) ) != -1 ) {
+		switch( opt ) {
+		case 'c':
+			client_count = atoi( optarg );
+			break;
+		case 'n':
+			per_client = atoi( optarg );
+			break;
+		case 'r':
+			if( request_count == MAX_REQUESTS ) {
+				usage( argv[0] );
+				return 1;
+			}
+			requests[request_count++] = optarg;
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( optind >= argc || client_count < 1 || client_count > MAX_CLIENTS || per_client < 1 ||
+		strlen( argv[optind] ) >= sizeof( addr.sun_path ) ) {
+		usage( argv[0] );
+		return 1;
+	}
+	if( !request_count ) {
+		requests[request_count++] = "NOW *";
+		requests[request_count++] = "SEARCH news";
+		requests[request_count++] = "CHANGES";
+	}
+	clients = calloc( client_count, sizeof( struct client_s ) );
+	fds = calloc( client_count, sizeof( struct pollfd ) );
+	latency = malloc( ( uint64_t ) client_count * per_client * sizeof( double ) );
+	if( !clients || !fds || !latency ) {
+		printf( "Out of memory\n" );
+		return 1;
+	}
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, argv[optind] );
+	clock_gettime( CLOCK_MONOTONIC, &begin );
+	for( n = 0; n < client_count; n++ ) {
+		clients[n].fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+		if( clients[n].fd < 0 || connect( clients[n].fd, ( struct sockaddr * ) &addr, sizeof( addr ) ) < 0 ) {
+			printf( "Cannot connect to '%s'. %s\n", argv[optind], strerror( errno ) );
+			return 1;
+		}
+		clients[n].next = n % request_count;
+		if( !send_request( &clients[n] ) ) {
+			printf( "Error sending. %s\n", strerror( errno ) );
+			return 1;
+		}
+		fds[n].fd = clients[n].fd;
+		fds[n].events = POLLIN;
+	}
+	active = client_count;
+	while( active ) {
+		if( poll( fds, client_count, -1 ) < 0 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			printf( "poll failed. %s\n", strerror( errno ) );
+			return 1;
+		}
+		for( n = 0; n < client_count; n++ ) {
+			if( !fds[n].revents ) {
+				continue;
+			}
+			switch( read_reply( &clients[n] ) ) {
+			case 0:
+				continue;
+			case 1:
+				clock_gettime( CLOCK_MONOTONIC, &now );
+				latency[done++] = seconds( &clients[n].started, &now );
+				if( clients[n].sent < per_client && send_request( &clients[n] ) ) {
+					continue;
+				}
+				break;
+			default:
+				printf( "Client %d: connection lost\n", n );
+				break;
+			}
+			close( clients[n].fd );
+			fds[n].fd = -1;
+			active--;
+		}
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	if( !done ) {
+		printf( "No replies\n" );
+		return 1;
+	}
+	qsort( latency, done, sizeof( double ), compare_double );
+	printf( "%" PRIu64 " requests from %d clients in %.3f s, %.0f requests/s, %" PRIu64 " events, %" PRIu64 " errors\n",
+		done, client_count, seconds( &begin, &end ), done / seconds( &begin, &end ), lines, errors );
+	printf( "latency us: min %.0f  p50 %.0f  p90 %.0f  p99 %.0f  max %.0f\n",
+		latency[0] * 1e6, latency[done / 2] * 1e6, latency[done * 9 / 10] * 1e6,
+		latency[done * 99 / 100] * 1e6, latency[done - 1] * 1e6 );
+	free( latency );
+	free( fds );
+	free( clients );
+	return 0;
+}
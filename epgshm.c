@@ -0,0 +1,252 @@
+/* epgshm -- read the EPG loadepg -M publishes in shared memory, and stress it
+ *
+ * Copyright (C) 2009-2010  James Courtier-Dutton <James@superbug.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "epgshm.h"
+
+#define MAX_READERS 64
+
+static double now( void )
+{
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Copy of a consistent image, NULL if none came within a second */
+static uint8_t *snapshot( struct epgshm_s *S, uint64_t *Size )
+{
+	struct epgshm_view_s V;
+	uint8_t *image;
+	double give_up = now() + 1;
+
+	while( now() < give_up ) {
+		if( !epgshm_begin( S, &V ) ) {
+			continue;
+		}
+		image = malloc( V.db.size );
+		if( !image ) {
+			return NULL;
+		}
+		memcpy( image, V.db.base, V.db.size );
+		if( epgshm_end( S, &V ) && epgshm_checksum( image, V.db.size ) == V.checksum ) {
+			*Size = V.db.size;
+			return image;
+		}
+		free( image );
+	}
+	return NULL;
+}
+
+static int list( struct epgshm_s *S, int ChannelId )
+{
+	const struct epgdb_channel_s *C;
+	struct epgdb_s db;
+	uint8_t *image;
+	uint64_t size;
+	uint32_t e;
+	int n;
+
+	image = snapshot( S, &size );
+	if( !image || !epgdb_attach( &db, image, size, ( const struct epgdb_header_s * ) image ) ) {
+		printf( "No consistent image\n" );
+		free( image );
+		return 1;
+	}
+	printf( "%u channels, %u events, %u strings, %" PRIu64 " bytes, image %" PRIu64 " of the object\n",
+		db.header->channel_count, db.header->event_count, db.header->string_count, size,
+		epgshm_control( S )->published );
+	for( n = 0; n < ( int ) db.header->channel_count; n++ ) {
+		C = &db.channels[n];
+		if( ChannelId < 0 ) {
+			printf( "0x%04x sid 0x%04x sky %u: %u events\n", C->ChannelId, C->Sid, C->SkyNumber1, C->event_count );
+			continue;
+		}
+		if( C->ChannelId != ChannelId ) {
+			continue;
+		}
+		for( e = C->first_event; e < C->first_event + C->event_count; e++ ) {
+			printf( "%" PRIu64 "\t%u\t%u\t%s\t%s\n", epgdb_start( &db, e ), db.duration[e], db.event_id[e],
+				epgdb_string( &db, db.title_id[e] ), epgdb_string( &db, db.summary_id[e] ) );
+		}
+	}
+	free( image );
+	return 0;
+}
+
+/* Read as fast as possible, checking every image that epgshm_end() passes */
+static void stress_reader( const char *Name, int Id, double Until )
+{
+	struct epgshm_view_s V;
+	struct epgshm_s S;
+	uint64_t good = 0, retried = 0, torn = 0;
+	uint32_t sum;
+
+	if( !epgshm_open( &S, Name ) ) {
+		printf( "reader %d: cannot open '%s'\n", Id, Name );
+		exit( 1 );
+	}
+	while( now() < Until ) {
+		if( !epgshm_begin( &S, &V ) ) {
+			retried++;
+			continue;
+		}
+		sum = epgshm_checksum( V.db.base, V.db.size );
+		if( !epgshm_end( &S, &V ) ) {
+			retried++;
+		} else if( sum != V.checksum ) {
+			torn++;
+		} else {
+			good++;
+		}
+	}
+	printf( "reader %d: %" PRIu64 " images read, %" PRIu64 " retried, %" PRIu64 " inconsistent\n", Id, good, retried, torn );
+	epgshm_close( &S );
+	exit( torn ? 2 : 0 );
+}
+
+/* Republish changed copies of the current image of Name in Name.stress
+ * while Readers processes read them.
+ */
+static int stress( struct epgshm_s *S, const char *Name, int Seconds, int Readers )
+{
+	const struct epgdb_header_s *H;
+	struct epgshm_s W;
+	uint8_t *image;
+	uint64_t size;
+	uint64_t published = 0;
+	uint32_t *duration;
+	uint32_t e;
+	double until;
+	char *stress_name;
+	int status;
+	int failed = 0;
+	int n;
+
+	image = snapshot( S, &size );
+	if( !image ) {
+		printf( "No consistent image\n" );
+		return 1;
+	}
+	H = ( const struct epgdb_header_s * ) image;
+	duration = ( uint32_t * ) ( image + H->duration );
+	stress_name = malloc( strlen( Name ) + 8 );
+	if( !stress_name ) {
+		return 1;
+	}
+	sprintf( stress_name, "%s.stress", Name );
+	if( !epgshm_create( &W, stress_name ) ||
+		!epgshm_publish( &W, image, size ) ) {
+		printf( "Cannot publish to '%s.stress'\n", Name );
+		return 1;
+	}
+	until = now() + Seconds;
+	for( n = 0; n < Readers; n++ ) {
+		if( fork() == 0 ) {
+			stress_reader( stress_name, n, until );
+		}
+	}
+	/* Every image differs in every event from all before it, so a slot
+	 * rewritten under a reader never holds the same bytes again
+	 */
+	while( now() < until ) {
+		for( e = 0; e < H->event_count; e++ ) {
+			duration[e]++;
+		}
+		if( !epgshm_publish( &W, image, size ) ) {
+			printf( "Publish failed\n" );
+			break;
+		}
+		published++;
+	}
+	for( n = 0; n < Readers; n++ ) {
+		if( wait( &status ) < 0 || !WIFEXITED( status ) || WEXITSTATUS( status ) ) {
+			failed++;
+		}
+	}
+	printf( "writer: %" PRIu64 " images of %" PRIu64 " bytes in %d s, %.0f/s\n", published, size, Seconds,
+		published / ( double ) Seconds );
+	epgshm_close( &W );
+	shm_unlink( stress_name );
+	free( stress_name );
+	free( image );
+	printf( "%s\n", failed ? "FAILED" : "ok" );
+	return failed != 0;
+}
+
+static void usage( char *name )
+{
+	printf( "usage: %s [options] <name>\n", name );
+	printf( "  -c <ChannelId>  list the events of this channel\n" );
+	printf( "  -S <seconds>    stress test: republish the image in <name>.stress while readers check it\n" );
+	printf( "  -r <n>          readers for -S (default 4)\n" );
+	printf( "Without options the channels are listed.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	struct epgshm_s S;
+	int channel = -1;
+	int seconds = 0;
+	int readers = 4;
+	int result;
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "c:r:S:" ) ) != -1 ) {
+		switch( opt ) {
+		case 'c':
+			channel = strtol( optarg, NULL, 0 );
+			break;
+		case 'r':
+			readers = atoi( optarg );
+			break;
+		case 'S':
+			seconds = atoi( optarg );
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( optind >= argc || readers < 1 || readers > MAX_READERS ) {
+		usage( argv[0] );
+		return 1;
+	}
+	if( !epgshm_open( &S, argv[optind] ) ) {
+		printf( "'%s' is not a published EPG\n", argv[optind] );
+		return 1;
+	}
+	if( seconds > 0 ) {
+		result = stress( &S, argv[optind], seconds, readers );
+	} else {
+		result = list( &S, channel );
+	}
+	epgshm_close( &S );
+	return result;
+}
@@ -0,0 +1,272 @@
+/* epgshm.h -- EPG database published by loadepg in shared memory.
+ *
+ * Copyright (C) 2009-2010  James Courtier-Dutton <James@superbug.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef EPGSHM_H
+#define EPGSHM_H
+
+/* loadepg -M publishes epgdb.h images into a POSIX shared memory object:
+ *
+ *   control block
+ *   slot 0, slot 1, each holding one image
+ *
+ * The writer fills the slot readers are not pointed at and then points
+ * them at it. Each slot has a generation that is odd while the slot is
+ * written, so a reader takes the generation, reads, and checks it again:
+ * unchanged means nothing was overwritten under it. That only happens
+ * when two images are published during one read. No locks and, unless
+ * the object grew, no system calls on the reader side.
+ *
+ * A slot that is too small for the next image is moved to the end of a
+ * bigger object. Readers map the new size the next time they begin.
+ * The last byte of a slot is never written and stays 0, so a string read
+ * from a torn image still ends inside the slot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "epgdb.h"
+
+#define EPGSHM_MAGIC 0x4d484745 /* "EGHM" */
+#define EPGSHM_VERSION 1
+#define EPGSHM_ALIGN 4096
+
+struct epgshm_slot_s {
+	uint64_t generation; /* Odd while being written */
+	uint64_t offset; /* From the start of the object */
+	uint64_t capacity;
+	uint64_t size; /* Of the image in it */
+	uint32_t checksum; /* FNV-1a of the image */
+	uint32_t reserved;
+};
+
+struct epgshm_control_s {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size; /* Of the whole object, only grows */
+	uint32_t active; /* Slot readers begin on */
+	uint32_t reserved;
+	uint64_t published; /* Images published so far */
+	struct epgshm_slot_s slots[2];
+};
+
+struct epgshm_s {
+	int fd;
+	int writable;
+	uint8_t *base;
+	uint64_t size; /* Mapped */
+};
+
+/* One read of the current image. Copy out what is needed from db and only
+ * trust it once epgshm_end() says the image did not change meanwhile.
+ * Until then indexes read from the image can be anything: bound them by
+ * the counts in header, which are a private copy.
+ */
+struct epgshm_view_s {
+	struct epgdb_s db;
+	struct epgdb_header_s header;
+	uint32_t slot;
+	uint64_t generation;
+	uint32_t checksum;
+};
+
+static inline uint32_t epgshm_checksum( const uint8_t *data, uint64_t size )
+{
+	uint32_t hash = 2166136261u;
+	uint64_t n;
+
+	for( n = 0; n < size; n++ ) {
+		hash = ( hash ^ data[n] ) * 16777619u;
+	}
+	return hash;
+}
+
+static inline struct epgshm_control_s *epgshm_control( const struct epgshm_s *S )
+{
+	return ( struct epgshm_control_s * ) S->base;
+}
+
+static inline int epgshm_map( struct epgshm_s *S, uint64_t size )
+{
+	uint8_t *base;
+
+	base = mmap( NULL, size, S->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, S->fd, 0 );
+	if( base == MAP_FAILED ) {
+		return 0;
+	}
+	if( S->base ) {
+		munmap( S->base, S->size );
+	}
+	S->base = base;
+	S->size = size;
+	return 1;
+}
+
+/* Attach to a published object. Returns 0 if it is missing or not one. */
+static inline int epgshm_open( struct epgshm_s *S, const char *Name )
+{
+	struct stat st;
+
+	memset( S, 0, sizeof( *S ) );
+	S->fd = shm_open( Name, O_RDONLY, 0 );
+	if( S->fd < 0 ) {
+		return 0;
+	}
+	if( fstat( S->fd, &st ) < 0 || st.st_size < ( off_t ) sizeof( struct epgshm_control_s ) ||
+		!epgshm_map( S, st.st_size ) ) {
+		close( S->fd );
+		return 0;
+	}
+	if( epgshm_control( S )->magic != EPGSHM_MAGIC || epgshm_control( S )->version != EPGSHM_VERSION ) {
+		munmap( S->base, S->size );
+		close( S->fd );
+		return 0;
+	}
+	return 1;
+}
+
+static inline void epgshm_close( struct epgshm_s *S )
+{
+	if( S->base ) {
+		munmap( S->base, S->size );
+		close( S->fd );
+	}
+	memset( S, 0, sizeof( *S ) );
+}
+
+/* Start reading the current image. Returns 0 when there is none yet or the
+ * writer is mid-way through replacing it, try again later.
+ */
+static inline int epgshm_begin( struct epgshm_s *S, struct epgshm_view_s *V )
+{
+	struct epgshm_control_s *C = epgshm_control( S );
+	struct epgshm_slot_s *slot;
+	uint64_t size;
+
+	size = __atomic_load_n( &C->size, __ATOMIC_ACQUIRE );
+	if( size > S->size ) {
+		if( !epgshm_map( S, size ) ) {
+			return 0;
+		}
+		C = epgshm_control( S );
+	}
+	V->slot = __atomic_load_n( &C->active, __ATOMIC_ACQUIRE ) & 1;
+	slot = &C->slots[V->slot];
+	V->generation = __atomic_load_n( &slot->generation, __ATOMIC_ACQUIRE );
+	if( V->generation == 0 || ( V->generation & 1 ) ) {
+		return 0;
+	}
+	if( slot->offset > S->size || slot->capacity > S->size - slot->offset || slot->size > slot->capacity ||
+		slot->size < sizeof( struct epgdb_header_s ) ) {
+		return 0;
+	}
+	V->checksum = slot->checksum;
+	memcpy( &V->header, S->base + slot->offset, sizeof( V->header ) );
+	memset( &V->db, 0, sizeof( V->db ) );
+	V->db.fd = -1;
+	return epgdb_attach( &V->db, S->base + slot->offset, slot->size, &V->header );
+}
+
+/* Returns 1 if the image read since epgshm_begin() was not touched */
+static inline int epgshm_end( struct epgshm_s *S, const struct epgshm_view_s *V )
+{
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+	return __atomic_load_n( &epgshm_control( S )->slots[V->slot].generation, __ATOMIC_RELAXED ) == V->generation;
+}
+
+/* Create the object, or take over an existing one. Readers that have it
+ * open keep going through the first publish.
+ */
+static inline int epgshm_create( struct epgshm_s *S, const char *Name )
+{
+	struct epgshm_control_s *C;
+	struct stat st;
+	uint64_t size = EPGSHM_ALIGN;
+
+	memset( S, 0, sizeof( *S ) );
+	S->writable = 1;
+	S->fd = shm_open( Name, O_RDWR | O_CREAT, 0644 );
+	if( S->fd < 0 ) {
+		return 0;
+	}
+	if( fstat( S->fd, &st ) < 0 ) {
+		close( S->fd );
+		return 0;
+	}
+	if( st.st_size > ( off_t ) size ) {
+		size = st.st_size;
+	}
+	if( ftruncate( S->fd, size ) < 0 || !epgshm_map( S, size ) ) {
+		close( S->fd );
+		return 0;
+	}
+	C = epgshm_control( S );
+	if( C->magic != EPGSHM_MAGIC || C->version != EPGSHM_VERSION || C->size != size ) {
+		memset( C, 0, sizeof( *C ) );
+		C->version = EPGSHM_VERSION;
+		C->size = size;
+		__atomic_store_n( &C->magic, EPGSHM_MAGIC, __ATOMIC_RELEASE );
+	}
+	return 1;
+}
+
+/* Copy an image into the slot readers are not on and switch them to it */
+static inline int epgshm_publish( struct epgshm_s *S, const uint8_t *Image, uint64_t Size )
+{
+	struct epgshm_control_s *C = epgshm_control( S );
+	struct epgshm_slot_s *slot;
+	uint64_t capacity;
+	uint64_t size;
+	uint32_t n;
+
+	n = ( C->active & 1 ) ^ ( C->published != 0 );
+	slot = &C->slots[n];
+	__atomic_store_n( &slot->generation, slot->generation + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	if( Size + 1 > slot->capacity ) {
+		/* Move it to the end of a bigger object, with room to grow */
+		capacity = ( ( Size + Size / 2 + 1 ) + EPGSHM_ALIGN - 1 ) & ~( uint64_t ) ( EPGSHM_ALIGN - 1 );
+		size = C->size + capacity;
+		if( ftruncate( S->fd, size ) < 0 || !epgshm_map( S, size ) ) {
+			C = epgshm_control( S );
+			__atomic_store_n( &C->slots[n].generation, C->slots[n].generation + 1, __ATOMIC_RELEASE );
+			return 0;
+		}
+		C = epgshm_control( S );
+		slot = &C->slots[n];
+		slot->offset = C->size;
+		slot->capacity = capacity;
+		__atomic_store_n( &C->size, size, __ATOMIC_RELEASE );
+	}
+	memcpy( S->base + slot->offset, Image, Size );
+	slot->size = Size;
+	slot->checksum = epgshm_checksum( Image, Size );
+	__atomic_store_n( &slot->generation, slot->generation + 1, __ATOMIC_RELEASE );
+	__atomic_store_n( &C->active, n, __ATOMIC_RELEASE );
+	C->published++;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,174 @@
+/* epgtrace -- list and slice the section traces written by loadepg -T
+ *
+ * Copyright (C) 2009-2010  James Courtier-Dutton <James@superbug.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "epgtrace.h"
+
+#define MAX_FILTERS 32
+
+int table_filter[MAX_FILTERS];
+int table_filters = 0;
+int pid_filter[MAX_FILTERS];
+int pid_filters = 0;
+
+static int wanted( const struct epgtrace_index_s *I )
+{
+	int n;
+
+	if( table_filters ) {
+		for( n = 0; n < table_filters && table_filter[n] != I->table_id; n++ ) {
+		}
+		if( n == table_filters ) {
+			return 0;
+		}
+	}
+	if( pid_filters ) {
+		for( n = 0; n < pid_filters && pid_filter[n] != I->pid; n++ ) {
+		}
+		if( n == pid_filters ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void dump( const uint8_t *Data, int Length )
+{
+	int n;
+
+	for( n = 0; n < Length; n++ ) {
+		printf( "%02x ", Data[n] );
+		if( ( n % 32 ) == 31 ) {
+			printf( "\n" );
+		}
+	}
+	printf( "\n" );
+}
+
+static void usage( char *name )
+{
+	printf( "usage: %s [options] <sections.trace>\n", name );
+	printf( "  -t <table_id>  only sections of this table, may be repeated\n" );
+	printf( "  -p <pid>       only sections from this PID, may be repeated\n" );
+	printf( "  -o <file>      write the matching sections to a new trace for loadepg -R\n" );
+	printf( "  -x             hex dump the sections\n" );
+	printf( "Without -o the matching sections are listed.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	const struct epgtrace_record_s *R;
+	struct epgtrace_writer_s W;
+	struct epgtrace_s T;
+	uint32_t count[256];
+	uint32_t matched = 0;
+	uint32_t n;
+	char *out_file = NULL;
+	int hex = 0;
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "o:p:t:x" ) ) != -1 ) {
+		switch( opt ) {
+		case 't':
+		case 'p':
+			if( ( opt == 't' ? table_filters : pid_filters ) == MAX_FILTERS ) {
+				usage( argv[0] );
+				return 1;
+			}
+			if( opt == 't' ) {
+				table_filter[table_filters++] = strtol( optarg, NULL, 0 );
+			} else {
+				pid_filter[pid_filters++] = strtol( optarg, NULL, 0 );
+			}
+			break;
+		case 'o':
+			out_file = optarg;
+			break;
+		case 'x':
+			hex = 1;
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( optind >= argc ) {
+		usage( argv[0] );
+		return 1;
+	}
+	if( !epgtrace_open( &T, argv[optind] ) ) {
+		printf( "'%s' is not a finished section trace\n", argv[optind] );
+		return 1;
+	}
+	if( out_file && !epgtrace_create( &W, out_file ) ) {
+		printf( "Error creating '%s'. %s\n", out_file, strerror( errno ) );
+		epgtrace_close( &T );
+		return 1;
+	}
+	memset( count, 0, sizeof( count ) );
+	for( n = 0; n < T.header->record_count; n++ ) {
+		if( !wanted( &T.index[n] ) ) {
+			continue;
+		}
+		R = epgtrace_record( &T, n );
+		matched++;
+		count[R->table_id]++;
+		if( out_file ) {
+			if( !epgtrace_append( &W, R, epgtrace_data( R ) ) ) {
+				printf( "Error writing '%s'. %s\n", out_file, strerror( errno ) );
+				return 1;
+			}
+			continue;
+		}
+		printf( "%8" PRIu64 " pid=0x%04x table_id=0x%02x length=%4u crc=%s pcr=",
+			R->packet, R->pid, R->table_id, R->length, ( R->flags & EPGTRACE_CRC_OK ) ? "ok " : "bad" );
+		if( R->pcr == EPGTRACE_NO_PCR ) {
+			printf( "-\n" );
+		} else {
+			printf( "%" PRIu64 "\n", R->pcr );
+		}
+		if( hex ) {
+			dump( epgtrace_data( R ), R->length );
+		}
+	}
+	if( out_file && !epgtrace_finish( &W ) ) {
+		printf( "Error writing '%s'. %s\n", out_file, strerror( errno ) );
+		return 1;
+	}
+	printf( "%u of %u sections", matched, T.header->record_count );
+	if( out_file ) {
+		printf( " written to '%s'", out_file );
+	}
+	printf( "\n" );
+	for( n = 0; n < 256; n++ ) {
+		if( count[n] ) {
+			printf( "  table_id 0x%02x: %u\n", n, count[n] );
+		}
+	}
+	epgtrace_close( &T );
+	return 0;
+}
@@ -0,0 +1,239 @@
+/* epgtrace.h -- binary trace of the sections seen by loadepg.
+ *
+ * Copyright (C) 2009-2010  James Courtier-Dutton <James@superbug.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef EPGTRACE_H
+#define EPGTRACE_H
+
+/* loadepg -T writes one record per completed section, in arrival order:
+ *
+ *   header
+ *   records, each a record header then the section, padded to 8 bytes
+ *   index[record_count]
+ *
+ * The index and the counts in the header are only written when the trace
+ * is closed, a header with index 0 is a trace that was never finished.
+ * Everything is in native byte order, a trace from a machine of the other
+ * byte order fails the magic check. loadepg -R replays a trace into the
+ * section handlers and the epgtrace tool lists and slices them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define EPGTRACE_MAGIC 0x52544745 /* "EGTR" */
+#define EPGTRACE_VERSION 1
+
+#define EPGTRACE_CRC_OK 0x01
+#define EPGTRACE_NO_PCR UINT64_MAX
+#define EPGTRACE_MAX_SECTION 0x1100 /* Same as the demux section buffers */
+#define EPGTRACE_MAX_PID 0x1fff
+#define EPGTRACE_MIN_SECTION 3 /* table_id and section_length */
+
+struct epgtrace_header_s {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t created; /* Unix time */
+	uint64_t index;
+	uint32_t record_count;
+	uint32_t reserved;
+	uint32_t table_count[256]; /* Records per table_id */
+};
+
+struct epgtrace_record_s {
+	uint64_t pcr; /* 90 kHz, the last PCR seen before the section completed */
+	uint64_t packet; /* TS packet that completed the section, from 0 */
+	uint16_t pid;
+	uint16_t length;
+	uint8_t table_id;
+	uint8_t flags; /* EPGTRACE_ */
+	uint16_t reserved;
+};
+
+struct epgtrace_index_s {
+	uint64_t offset; /* Of the record header */
+	uint16_t pid;
+	uint8_t table_id;
+	uint8_t flags;
+	uint32_t reserved;
+};
+
+struct epgtrace_s {
+	int fd;
+	uint64_t size;
+	const uint8_t *base;
+	const struct epgtrace_header_s *header;
+	const struct epgtrace_index_s *index;
+};
+
+struct epgtrace_writer_s {
+	FILE *file;
+	uint64_t offset;
+	struct epgtrace_header_s header;
+	struct epgtrace_index_s *index;
+	uint32_t index_size;
+};
+
+static inline uint32_t epgtrace_padded( uint32_t length )
+{
+	return ( length + 7 ) & ~7;
+}
+
+/* Map a finished trace read-only. Returns 0 if it is missing or not valid. */
+static inline int epgtrace_open( struct epgtrace_s *T, const char *FileName )
+{
+	const struct epgtrace_header_s *H;
+	const struct epgtrace_record_s *R;
+	struct stat st;
+	uint32_t n;
+
+	memset( T, 0, sizeof( *T ) );
+	T->fd = open( FileName, O_RDONLY );
+	if( T->fd < 0 ) {
+		return 0;
+	}
+	if( fstat( T->fd, &st ) < 0 || st.st_size < ( off_t ) sizeof( struct epgtrace_header_s ) ) {
+		close( T->fd );
+		return 0;
+	}
+	T->size = st.st_size;
+	T->base = mmap( NULL, T->size, PROT_READ, MAP_SHARED, T->fd, 0 );
+	if( T->base == MAP_FAILED ) {
+		close( T->fd );
+		return 0;
+	}
+	H = T->header = ( const struct epgtrace_header_s * ) T->base;
+	if( H->magic != EPGTRACE_MAGIC || H->version != EPGTRACE_VERSION || H->index < sizeof( *H ) ||
+		H->index > T->size || H->record_count > ( T->size - H->index ) / sizeof( struct epgtrace_index_s ) ) {
+		goto invalid;
+	}
+	T->index = ( const struct epgtrace_index_s * ) ( T->base + H->index );
+	for( n = 0; n < H->record_count; n++ ) {
+		if( T->index[n].offset < sizeof( *H ) || T->index[n].offset > H->index - sizeof( *R ) ) {
+			goto invalid;
+		}
+		R = ( const struct epgtrace_record_s * ) ( T->base + T->index[n].offset );
+		if( R->pid > EPGTRACE_MAX_PID || R->length < EPGTRACE_MIN_SECTION || R->length > EPGTRACE_MAX_SECTION ||
+			R->length > H->index - T->index[n].offset - sizeof( *R ) ) {
+			goto invalid;
+		}
+	}
+	return 1;
+invalid:
+	munmap( ( void * ) T->base, T->size );
+	close( T->fd );
+	return 0;
+}
+
+static inline void epgtrace_close( struct epgtrace_s *T )
+{
+	if( T->base ) {
+		munmap( ( void * ) T->base, T->size );
+		close( T->fd );
+	}
+	memset( T, 0, sizeof( *T ) );
+}
+
+static inline const struct epgtrace_record_s *epgtrace_record( const struct epgtrace_s *T, uint32_t n )
+{
+	return ( const struct epgtrace_record_s * ) ( T->base + T->index[n].offset );
+}
+
+static inline const uint8_t *epgtrace_data( const struct epgtrace_record_s *R )
+{
+	return ( const uint8_t * ) ( R + 1 );
+}
+
+static inline int epgtrace_create( struct epgtrace_writer_s *W, const char *FileName )
+{
+	memset( W, 0, sizeof( *W ) );
+	W->file = fopen( FileName, "w" );
+	if( !W->file ) {
+		return 0;
+	}
+	W->header.magic = EPGTRACE_MAGIC;
+	W->header.version = EPGTRACE_VERSION;
+	W->header.created = time( NULL );
+	if( fwrite( &W->header, sizeof( W->header ), 1, W->file ) != 1 ) {
+		fclose( W->file );
+		W->file = NULL;
+		return 0;
+	}
+	W->offset = sizeof( W->header );
+	return 1;
+}
+
+static inline int epgtrace_append( struct epgtrace_writer_s *W, const struct epgtrace_record_s *R, const uint8_t *Data )
+{
+	static const uint8_t padding[8];
+	struct epgtrace_index_s *I;
+	uint32_t padded = epgtrace_padded( R->length );
+
+	if( W->header.record_count == W->index_size ) {
+		I = realloc( W->index, ( W->index_size ? W->index_size * 2 : 1024 ) * sizeof( *I ) );
+		if( !I ) {
+			return 0;
+		}
+		W->index = I;
+		W->index_size = W->index_size ? W->index_size * 2 : 1024;
+	}
+	I = &W->index[W->header.record_count];
+	memset( I, 0, sizeof( *I ) );
+	I->offset = W->offset;
+	I->pid = R->pid;
+	I->table_id = R->table_id;
+	I->flags = R->flags;
+	if( fwrite( R, sizeof( *R ), 1, W->file ) != 1 ||
+		fwrite( Data, 1, R->length, W->file ) != R->length ||
+		fwrite( padding, 1, padded - R->length, W->file ) != padded - R->length ) {
+		return 0;
+	}
+	W->offset += sizeof( *R ) + padded;
+	W->header.record_count++;
+	W->header.table_count[R->table_id]++;
+	return 1;
+}
+
+/* Write the index and the final header */
+static inline int epgtrace_finish( struct epgtrace_writer_s *W )
+{
+	int result = 1;
+
+	W->header.index = W->offset;
+	if( fwrite( W->index, sizeof( *W->index ), W->header.record_count, W->file ) != W->header.record_count ||
+		fseek( W->file, 0, SEEK_SET ) < 0 ||
+		fwrite( &W->header, sizeof( W->header ), 1, W->file ) != 1 ) {
+		result = 0;
+	}
+	if( fclose( W->file ) ) {
+		result = 0;
+	}
+	free( W->index );
+	W->file = NULL;
+	W->index = NULL;
+	return result;
+}
+
+#endif
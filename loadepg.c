@@ -28,6 +28,24 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <time.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_SQLITE
+#include <sqlite3.h>
+#endif
+
+#include "epgdb.h"
+#include "epgtrace.h"
+#include "epgshm.h"
 
 #if 0
 #define TS_LOG 1
@@ -41,6 +59,41 @@
 #define TS_SI 1
 #endif
 
+/* Logging, along the lines of esyslog/isyslog/dsyslog in tools.h. Each
+ * message has a category and a level. Levels above LOG_LEVEL_MAX are
+ * compiled out (make CFLAGS="-g -DLOG_LEVEL_MAX=1" keeps only errors),
+ * the rest are filtered per category at run time with -l.
+ */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_DUMP 4 /* Hex dumps of packets and sections */
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX LOG_LEVEL_DUMP
+#endif
+
+#define LOG_CAT_DEMUX 0
+#define LOG_CAT_SDT 1
+#define LOG_CAT_BAT 2
+#define LOG_CAT_TITLES 3
+#define LOG_CAT_SUMMARY 4
+#define LOG_CAT_HUFFMAN 5
+#define LOG_CAT_TABLES 6 /* Time offset and the tables not understood yet */
+#define LOG_CATEGORIES 7
+
+char *log_category_names[LOG_CATEGORIES] = { "demux", "sdt", "bat", "titles", "summary", "huffman", "tables" };
+char *log_level_names[] = { "none", "error", "info", "debug", "dump" };
+int log_level[LOG_CATEGORIES] = { LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO };
+
+#define log_enabled( c, l ) ( ( l ) <= LOG_LEVEL_MAX && ( l ) <= log_level[c] )
+#define elog( c, a... ) do { if( log_enabled( c, LOG_LEVEL_ERROR ) ) printf( a ); } while( 0 )
+#define ilog( c, a... ) do { if( log_enabled( c, LOG_LEVEL_INFO ) ) printf( a ); } while( 0 )
+#define dlog( c, a... ) do { if( log_enabled( c, LOG_LEVEL_DEBUG ) ) printf( a ); } while( 0 )
+#define xlog( c, a... ) do { if( log_enabled( c, LOG_LEVEL_DUMP ) ) printf( a ); } while( 0 )
+#define xlog_hex( c, d, l, w ) do { if( log_enabled( c, LOG_LEVEL_DUMP ) ) log_hex( d, l, w ); } while( 0 )
+#define xlog_hex_ascii( c, d, l ) do { if( log_enabled( c, LOG_LEVEL_DUMP ) ) log_hex_ascii( d, l ); } while( 0 )
+
 /* more PIDS are needed due "auto-detection". 40 spare media entries  */
 #define PKT_SIZE 188
 #define BODY_SIZE (188 - 4)
@@ -67,12 +120,9 @@
 #define PID_TYPE_PRIV_PES 11
 #define PID_TYPE_UNKNOWN 12
 #define MAX_FILTERS 24
-#define MAX_BOUQUETS 256
 #define MAX_THEMES 4096
-#define MAX_CHANNELS 4096
 #define MAX_TITLES 262144
 #define MAX_SUMMARIES 262144
-#define MAX_SERVICES 4096
 
 #define MAX_BUFFER_SIZE_CHANNELS 1048576
 #define MAX_BUFFER_SIZE_TITLES 4194304
@@ -151,9 +201,23 @@ struct audio_pid_s {
 };
 
 struct service_s {
-	int program_id;
-	char *provider;
-	char *name;
+	uint16_t Nid; /* original_network_id */
+	uint16_t Tid; /* transport_stream_id */
+	int program_id; /* service_id */
+	uint32_t provider_id; /* In the string pool, 0 until the SDT names it */
+	uint32_t name_id;
+};
+
+/* SDT services, found by (original_network_id, transport_stream_id,
+ * service_id) through an open addressed index. Services never move
+ * within the array, which doubles when full.
+ */
+struct service_table_s {
+	int count;
+	int size;
+	struct service_s *services;
+	uint32_t index_size; /* Power of two */
+	uint32_t *index; /* Holds service number + 1, 0 is a free slot */
 };
 
 struct program_s {
@@ -164,6 +228,7 @@ struct program_s {
 	int service_count;
 };
 
+/* Row view of one event, filled from the event table by event_row() */
 struct event_s {
 	uint16_t event_id;
 	uint16_t channel_id;
@@ -172,11 +237,155 @@ struct event_s {
 	uint64_t duration_title; /* In seconds */
 	uint16_t theme_id; /* Theme, FIXME: JCD: Details TODO */
 	int prefix_len; /* How much of the Title should be ignored in searches. "The Italian Job", prefix_len = 4 */
-	int title_len;
-	char *title;
+	uint32_t title_id; /* Interned in the string pool, 0 is the empty string */
 /* FIXME: JCD Add title, title suppliment and description is they all exist */
-	int summary_len;
-	char *summary;
+	uint32_t summary_id;
+};
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+#define ARENA_ALIGN 16
+#define ARENA_FREE_CLASSES 32 /* Free lists of power of two sizes, by log2 */
+
+struct arena_block_s {
+	struct arena_block_s *next;
+	size_t size;
+	size_t used;
+	uint8_t data[];
+};
+
+/* Bump allocator. Everything decoded in one generation lives here
+ * and is released in one call. Tables replaced by bigger ones are handed
+ * back with arena_free(), to be reused for the next table of their size.
+ */
+struct arena_s {
+	struct arena_block_s *blocks; /* Current block first */
+	uint64_t allocated; /* Bytes handed out */
+	uint64_t reserved; /* Bytes obtained from malloc */
+	uint64_t limit; /* Memory budget in bytes, 0 for none. Only arena blocks count against it */
+	uint64_t refused; /* Allocations turned down because of the limit */
+	void *free[ARENA_FREE_CLASSES]; /* Each free table holds the next of its size */
+};
+
+struct pool_string_s {
+	char *str;
+	uint32_t len;
+	uint32_t hash;
+};
+
+/* Hash-consed strings. Titles and summaries repeat a lot across channels
+ * and days, so each distinct string is stored once and events keep its id.
+ */
+struct string_pool_s {
+	uint32_t count;
+	uint32_t size;
+	struct pool_string_s *strings; /* Indexed by string id */
+	uint32_t index_size; /* Power of two */
+	uint32_t *index; /* Open addressed by hash, holds string ids, 0 is a free slot */
+	uint64_t requested_count;
+	uint64_t requested_bytes;
+	uint64_t stored_bytes;
+};
+
+#define EVENT_NONE ((uint32_t)(-1))
+#define EVENT_FLAG_TITLE 0x01
+#define EVENT_FLAG_SUMMARY 0x02
+#define EVENT_FLAG_SNAPSHOT 0x04 /* Loaded from the previous run's database */
+#define EVENT_FLAG_SEEN 0x08 /* Title or summary received in this run */
+#define EVENT_FLAG_DELETED 0x10 /* Dropped by delta_write(), the row is never reused */
+/* Start times older than the first one seen still fit without rebasing */
+#define EVENT_EPOCH_SLACK (14 * 86400)
+
+/* All events of all channels, one array per field.
+ * Rows never move, so channels and indexes refer to events by row number.
+ * Range scans only touch the start and duration columns.
+ */
+struct event_table_s {
+	uint32_t count;
+	uint32_t size;
+	uint64_t epoch; /* Unix time that start is relative to */
+	uint32_t *start; /* Seconds since epoch, valid with EVENT_FLAG_TITLE */
+	uint32_t *duration; /* In seconds */
+	uint16_t *channel; /* Index into lChannels */
+	uint16_t *event_id;
+	uint16_t *theme;
+	uint8_t *flags;
+	uint32_t *title_id;
+	uint32_t *summary_id;
+	uint32_t *prev_hash; /* event_content_hash() in the previous run, with EVENT_FLAG_SNAPSHOT */
+	uint32_t *seq; /* last_seq when the row last changed */
+	uint32_t last_seq; /* Bumped on every change, the token of the query server's CHANGES */
+};
+
+#define INTERVAL_BUCKET_SECONDS 3600
+#define INTERVAL_WINDOW_BUCKETS ( 8 * 7 * 24 ) /* Most the index spans, a guide holds two weeks */
+#define INTERVAL_HISTORY_BUCKETS ( 14 * 24 ) /* Of the window, before the anchor */
+
+struct interval_bucket_s {
+	uint32_t count;
+	uint32_t size;
+	uint32_t *rows;
+};
+
+/* Events by time across all channels. Each event is listed in every
+ * hourly bucket it overlaps, so a query only looks at the buckets it covers.
+ * The buckets stay within a window of INTERVAL_WINDOW_BUCKETS around the
+ * anchor hour, the current time unless set before the first insert.
+ */
+struct interval_index_s {
+	uint32_t base_hour; /* Unix time / INTERVAL_BUCKET_SECONDS of buckets[0] */
+	uint32_t bucket_count;
+	struct interval_bucket_s *buckets;
+	uint64_t entries;
+	uint32_t anchor_hour;
+	uint64_t outside; /* Events left out, none of their time is in the window */
+};
+
+/* Set in a summary_id when the text is in the spill file, the rest is its offset */
+#define SUMMARY_SPILLED 0x80000000u
+
+#define CAROUSEL_TITLES 0
+#define CAROUSEL_SUMMARIES 1
+
+#define WRITER_BUFFER_SIZE ( 1024 * 1024 )
+
+/* Output through one large buffer and write(2), for the exporters */
+struct writer_s {
+	int fd;
+	char *data;
+	size_t used;
+	size_t size;
+	uint64_t written;
+	int error;
+};
+
+/* Cached local time of the current local hour, see xmltv_time() */
+struct xmltv_s {
+	struct writer_s out;
+	int header_done;
+	uint8_t *listed; /* <channel> element written, by index in lChannels */
+	int listed_size;
+	uint64_t base; /* Unix time that tm and offset belong to */
+	uint32_t left; /* Seconds from base to the end of its local hour */
+	struct tm tm;
+	char offset[6]; /* "+hhmm" */
+	uint32_t programmes;
+	uint32_t channels;
+	uint32_t unlisted; /* Channels first seen after the header */
+};
+
+/* Summaries that did not fit in the memory budget. An unlinked temporary
+ * file that is only appended to; a record is a uint32_t length and the
+ * text with its NUL. Identical texts are stored once.
+ */
+struct spill_s {
+	int fd; /* -1 until first used, -2 once it could not be created */
+	uint64_t size;
+	uint64_t count;
+	uint32_t index_size; /* Power of two */
+	uint32_t index_count;
+	uint64_t *index; /* hash << 32 | ( offset + 1 ), 0 is a free slot */
+	char *buffer; /* Holds the last record read */
+	uint32_t buffer_size;
 };
 
 struct channel_s {
@@ -191,14 +400,34 @@ struct channel_s {
 	uint16_t lenData;
 	int IsFound;
 	int IsEpg;
+	uint32_t carousel_first[2]; /* First title and summary section, Mjd << 16 | EventId */
+	int carousel_sections[2]; /* Sections seen since the first */
+	int carousel_wrapped[2]; /* The first section came round again */
+	int carousel_laps; /* Complete carousels since the last generation, see epg_generation_complete() */
+	int exported; /* Handed to the exporters */
 	int events_count;
-	struct event_s *events;
+	int events_size; /* Allocated, grows geometrically */
+	uint32_t *events; /* Rows in the event table, by start time, events without a title last */
+	uint32_t events_index_size; /* Power of two */
+	uint32_t *events_index; /* Open addressed by EventId, holds row + 1, 0 is a free slot */
+	int service; /* In demux_ts.services, -1 if the SDT has not listed it. See channel_join() */
+	int program; /* In demux_ts.programs, -1 if not on the tuned transport stream */
+};
+
+/* Sections of one table received so far, one bit per section_number.
+ * Marking a section and telling whether the table is complete are O(1),
+ * and the counter shared by a set of tables (every bouquet of the BAT,
+ * say) tells the same for the whole set.
+ */
+struct section_tracker_s {
+  uint64_t received[4];
+  int16_t last_section_number; /* -1 before the first section */
+  uint16_t outstanding; /* Of sections 0 to last_section_number */
 };
 
 struct bouquet_s {
   uint16_t BouquetId;
-  int16_t SectionNumber[256];
-  int16_t LastSectionNumber;
+  struct section_tracker_s sections;
 };
 
 struct filter_s {
@@ -214,6 +443,25 @@ struct sNode
   char *Value;
   struct sNode *P0;
   struct sNode *P1;
+  uint32_t Hits; /* How many times this symbol was decoded. Used by the huffman profiler. */
+};
+
+#define MAX_HUFFMAN_MISSES 4096
+#define MAX_HUFFMAN_CODE 64
+
+/* A prefix that walked off the huffman tree. */
+struct huffman_miss_s {
+	char code[MAX_HUFFMAN_CODE]; /* Bits from the root up to and including the missing branch */
+	char sample[MAX_HUFFMAN_CODE]; /* First undecoded bit sequence seen after this prefix */
+	uint32_t count;
+};
+
+struct huffman_profile_s {
+	uint64_t decodes;
+	uint64_t bytes;
+	uint64_t errors;
+	int misses_count;
+	struct huffman_miss_s misses[MAX_HUFFMAN_MISSES];
 };
 
 /*
@@ -237,8 +485,9 @@ struct demux_ts_s {
   uint32_t         program_number[MAX_PMTS];
   uint32_t         pmt_pid[MAX_PMTS];
 	int	number_of_programs;
+	int	programs_size; /* Allocated, doubles when full */
   struct program_s  *programs;
-  struct service_s  *services;
+  struct service_table_s services;
 	struct pid_s	*pids;
   int		  *pmt[MAX_PMTS];
   uint8_t         *pmt_write_ptr[MAX_PMTS];
@@ -246,24 +495,104 @@ struct demux_ts_s {
   unsigned int     videoPid;
   uint32_t         last_pmt_crc;
   unsigned int      spu_pid;
-
+	uint64_t packet_index; /* Of the packet being parsed */
+	int64_t pcr; /* Last PCR seen on any PID, -1 before the first */
+	int transport_stream_id; /* Of the tuned transport stream from the PAT, -1 before it */
+	int original_network_id; /* From the SDT actual, -1 before it */
 };
 struct demux_ts_s demux_ts;
+struct epgtrace_writer_s section_trace; /* -T */
+
+/* Dictionary and themes, swapped as one version on reload.
+ * A decode keeps using the version it started with; a replaced version
+ * is only freed at the next quiescent point, between two TS packets.
+ */
+struct tables_s {
+	struct sNode H;
+	char *themes[MAX_THEMES];
+	int generation;
+	struct tables_s *next_retired;
+};
 
 uint8_t pat[200];
-struct sNode H;
+struct tables_s *tables;
+struct tables_s *tables_retired;
+char *dict_file = "conf/sky_uk.dict";
+char *themes_file = "conf/sky_uk.themes";
+volatile sig_atomic_t reload_requested;
+int huffman_profile;
+struct huffman_profile_s huffman_stats;
 
 int EndBAT;
 int EndSDT;
 int EndThemes;
 int EndChannels;
 
+/* 16-bit ids to indexes in a table, open addressed. A slot holds
+ * id << 16 | index + 1, 0 is a free slot.
+ */
+struct id_map_s {
+	uint32_t size; /* Power of two */
+	uint32_t count;
+	uint32_t *slots;
+};
+#define ID_MAP_NONE 0xffff
+
 int nChannels;
+int channels_size; /* Allocated, doubles when full */
 struct channel_s *lChannels;
-uint16_t *channels_all;
+struct id_map_s channels_by_id;
 
 int nBouquets;
+int bouquets_size;
 struct bouquet_s *lBouquets;
+struct id_map_s bouquets_by_id;
+uint32_t bat_outstanding; /* BAT sections of the known bouquets still to come */
+
+/* State of the last channel_join(). Channels added since are caught by
+ * their count, everything else that changes a match sets stale.
+ */
+struct join_s {
+	int stale;
+	int channels;
+	uint32_t index_size; /* Power of two */
+	uint32_t *index; /* Programs open addressed by program_number, holds program + 1 */
+};
+struct join_s join = { 1 };
+
+struct arena_s epg_arena;
+struct string_pool_s string_pool;
+struct event_table_s events;
+struct interval_index_s events_by_time;
+struct spill_s summary_spill = { -1 };
+struct xmltv_s xmltv = { { -1 } };
+
+#define VDR_SOURCE "S28.2E"
+#define VDR_SVDRP_PORT 6419
+#define VDR_PUTE_BLOCK ( 256 * 1024 ) /* Bytes of epg.data per PUTE */
+#define MAX_EQUIV 1024
+
+/* loadepg.equiv: events of original also go to other */
+struct equiv_s {
+	char original[64];
+	char other[64];
+};
+struct equiv_s *lEquiv;
+int nEquiv;
+const char *vdr_source = VDR_SOURCE;
+
+/* Channel subset. Bitmaps over the 16-bit ChannelId, SkyNumber and Sid
+ * spaces. SkyNumber and Sid entries become ChannelIds once the BAT says
+ * which channel they belong to.
+ */
+struct channel_filter_s {
+	int enabled;
+	uint8_t channel_id[0x10000 / 8];
+	uint8_t sky_number[0x10000 / 8];
+	uint8_t sid[0x10000 / 8];
+	uint64_t skipped; /* Sections dropped before decoding */
+};
+struct channel_filter_s channel_filter;
 
 int EpgTimeOffset;
 int LocalTimeOffset;
@@ -415,18 +744,6 @@ static int qsortChannelsByChID( const void *A, const void *B )
   return 0;
 }
 
-static int qsort_events_by_time( const void *A, const void *B ) {
-	struct event_s *eventA = ( struct event_s * ) A;
-	struct event_s *eventB = ( struct event_s * ) B;
-	if( eventA->start_time_title > eventB->start_time_title ) {
-		return 1;
-	}
-	if( eventA->start_time_title < eventB->start_time_title ) {
-		return -1;
-	}
-	return 0;
-}
-
 static void demux_ts_build_crc32_table(struct demux_ts_s *this) {
   uint32_t  i, j, k;
 
@@ -448,6 +765,93 @@ static uint32_t demux_ts_compute_crc32(struct demux_ts_s *this, uint8_t *data,
   }
   return crc32;
 }
+/* Hex, Width bytes to a line */
+static void log_hex( const uint8_t *Data, int Length, int Width )
+{
+	char line[3 * 256 + 2];
+	int n, p = 0;
+
+	for( n = 0; n < Length; n++ ) {
+		p += sprintf( &line[p], "%02x ", Data[n] );
+		if( ( n % Width ) == Width - 1 || p > ( int ) sizeof( line ) - 5 ) {
+			line[p++] = '\n';
+			fwrite( line, 1, p, stdout );
+			p = 0;
+		}
+	}
+	line[p++] = '\n';
+	fwrite( line, 1, p, stdout );
+}
+
+/* Hex then printable characters, 32 bytes to a line */
+static void log_hex_ascii( const uint8_t *Data, int Length )
+{
+	char line[32 * 4 + 2];
+	int n, m, p;
+
+	for( n = 0; n < Length; n += 32 ) {
+		p = 0;
+		for( m = n; m < n + 32 && m < Length; m++ ) {
+			p += sprintf( &line[p], "%02x ", Data[m] );
+		}
+		for( m = n; m < n + 32 && m < Length; m++ ) {
+			line[p++] = ( Data[m] > 31 && Data[m] < 127 ) ? Data[m] : '.';
+		}
+		line[p++] = '\n';
+		fwrite( line, 1, p, stdout );
+	}
+	if( ( Length % 32 ) == 0 ) {
+		putchar( '\n' );
+	}
+}
+
+/* -l <level> or -l <category>=<level>[,...], levels by name or number */
+int log_parse( const char *Spec )
+{
+	char Buffer[256];
+	char *item, *value, *save;
+	int category, level;
+
+	snprintf( Buffer, sizeof( Buffer ), "%s", Spec );
+	for( item = strtok_r( Buffer, ",", &save ); item; item = strtok_r( NULL, ",", &save ) ) {
+		value = strchr( item, '=' );
+		if( value ) {
+			*value++ = 0;
+		} else {
+			value = item;
+		}
+		for( level = LOG_LEVEL_NONE; level <= LOG_LEVEL_DUMP; level++ ) {
+			if( !strcmp( value, log_level_names[level] ) ) {
+				break;
+			}
+		}
+		if( level > LOG_LEVEL_DUMP ) {
+			if( value[0] < '0' || value[0] > '9' ) {
+				printf( "LoadEPG: unknown log level '%s'\n", value );
+				return 0;
+			}
+			level = atoi( value );
+		}
+		if( value == item ) {
+			for( category = 0; category < LOG_CATEGORIES; category++ ) {
+				log_level[category] = level;
+			}
+			continue;
+		}
+		for( category = 0; category < LOG_CATEGORIES; category++ ) {
+			if( !strcmp( item, log_category_names[category] ) ) {
+				break;
+			}
+		}
+		if( category == LOG_CATEGORIES ) {
+			printf( "LoadEPG: unknown log category '%s'\n", item );
+			return 0;
+		}
+		log_level[category] = level;
+	}
+	return 1;
+}
+
 static int ecm_compare(uint8_t *previous, uint8_t *buffer)
 {
 	uint8_t *original_pkt = buffer;
@@ -485,20 +889,8 @@ static int ecm_compare(uint8_t *previous, uint8_t *buffer)
 	table_id = (unsigned int)pkt[5] ;
 	section_syntax_indicator = (((unsigned int)pkt[6] >> 7) & 1) ;
 	section_length = (((unsigned int)pkt[6] & 0x03) << 8) | pkt[7];
-	for(n = 0; n < section_length + 3; n++) {
-		printf("%02x ", previous[ecm_offset + n + 5 ]);
-		if ((n % 32) == 31) {
-		printf("\n");
-		}
-	}
-	printf("\n");
-	for(n = 0; n < section_length + 3; n++) {
-		printf("%02x ", buffer[ecm_offset + n + 5 ]);
-		if ((n % 32) == 31) {
-		printf("\n");
-		}
-	}
-	printf("\n");
+	xlog_hex( LOG_CAT_DEMUX, &previous[ecm_offset + 5], section_length + 3, 32 );
+	xlog_hex( LOG_CAT_DEMUX, &buffer[ecm_offset + 5], section_length + 3, 32 );
 	match = 0;
 	for(n = 0; n < section_length + 3; n++) {
 		if (buffer[ecm_offset + n + 5] != previous[ecm_offset + n + 5 ]) {
@@ -533,16 +925,15 @@ static void demux_ts_parse_ecm (struct demux_ts_s *this, uint8_t *original_pkt,
   unsigned int   pmt_pid;
   unsigned int   program_count;
 	int 	count;
-	int	n;
 	uint8_t *pkt;
 
   /*
    * A PAT in a single section should start with a payload unit start
    * indicator set.
    */
-  printf ("demux_ts: parsing ECM\n");
+  dlog( LOG_CAT_DEMUX, "demux_ts: parsing ECM\n");
   if (!pusi) {
-    printf ("demux_ts: demux error! ECM without payload unit start indicator\n");
+    elog( LOG_CAT_DEMUX, "demux_ts: demux error! ECM without payload unit start indicator\n");
     return;
   }
 	pkt = original_pkt + offset;
@@ -551,7 +942,7 @@ static void demux_ts_parse_ecm (struct demux_ts_s *this, uint8_t *original_pkt,
    */
   pkt += pkt[4];
   if (pkt - original_pkt > PKT_SIZE) {
-    printf ("demux_ts: demux error! CAT with invalid pointer\n");
+    elog( LOG_CAT_DEMUX, "demux_ts: demux error! CAT with invalid pointer\n");
     return;
   }
   table_id = (unsigned int)pkt[5] ;
@@ -559,27 +950,21 @@ static void demux_ts_parse_ecm (struct demux_ts_s *this, uint8_t *original_pkt,
   section_length = (((unsigned int)pkt[6] & 0x03) << 8) | pkt[7];
 
 #ifdef TS_PAT_LOG
-  printf ("demux_ts: ECM table_id: %.2x\n", table_id);
-  printf ("              section_syntax: %d\n", section_syntax_indicator);
-  printf ("              section_length: %d (%#.3x)\n",
+  dlog( LOG_CAT_DEMUX, "demux_ts: ECM table_id: %.2x\n", table_id);
+  dlog( LOG_CAT_DEMUX, "              section_syntax: %d\n", section_syntax_indicator);
+  dlog( LOG_CAT_DEMUX, "              section_length: %d (%#.3x)\n",
           section_length, section_length);
 #endif
   /* Check CRC. */
   calc_crc32 = demux_ts_compute_crc32 (this, pkt+5, section_length+3-4,
                                        0xffffffff);
 #ifdef TS_PAT_LOG
-	printf ("demux_ts: ECM CRC32: %.8x\n", calc_crc32);
+	dlog( LOG_CAT_DEMUX, "demux_ts: ECM CRC32: %.8x\n", calc_crc32);
 #endif
 	pid                            = ((original_pkt[1] << 8) |
 				    original_pkt[2]) & 0x1fff;
-	printf("demux_ts:ts_header:pid:0x%.4x\n", pid);
-	for(n = 0; n < section_length + 3 + 8; n++) {
-		printf("%02x ", pkt[n + 5 ]);
-		if ((n % 32) == 31) {
-		printf("\n");
-		}
-	}
-	printf("\n");
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:pid:0x%.4x\n", pid);
+	xlog_hex( LOG_CAT_DEMUX, &pkt[5], section_length + 3 + 8, 32 );
 
 }
 
@@ -623,9 +1008,9 @@ static void demux_ts_parse_cat (struct demux_ts_s *this, uint8_t *original_pkt,
    * A PAT in a single section should start with a payload unit start
    * indicator set.
    */
-  printf ("demux_ts: parsing CAT\n");
+  dlog( LOG_CAT_DEMUX, "demux_ts: parsing CAT\n");
   if (!pusi) {
-    printf ("demux_ts: demux error! CAT without payload unit start indicator\n");
+    elog( LOG_CAT_DEMUX, "demux_ts: demux error! CAT without payload unit start indicator\n");
     return;
   }
 	pkt = original_pkt + offset;
@@ -634,7 +1019,7 @@ static void demux_ts_parse_cat (struct demux_ts_s *this, uint8_t *original_pkt,
    */
   pkt += pkt[4];
   if (pkt - original_pkt > PKT_SIZE) {
-    printf ("demux_ts: demux error! CAT with invalid pointer\n");
+    elog( LOG_CAT_DEMUX, "demux_ts: demux error! CAT with invalid pointer\n");
     return;
   }
   table_id = (unsigned int)pkt[5] ;
@@ -651,27 +1036,27 @@ static void demux_ts_parse_cat (struct demux_ts_s *this, uint8_t *original_pkt,
   crc32 |= (uint32_t)pkt[7+section_length] ;
 
 #ifdef TS_PAT_LOG
-  printf ("demux_ts: CAT table_id: %.2x\n", table_id);
-  printf ("              section_syntax: %d\n", section_syntax_indicator);
-  printf ("              section_length: %d (%#.3x)\n",
+  dlog( LOG_CAT_DEMUX, "demux_ts: CAT table_id: %.2x\n", table_id);
+  dlog( LOG_CAT_DEMUX, "              section_syntax: %d\n", section_syntax_indicator);
+  dlog( LOG_CAT_DEMUX, "              section_length: %d (%#.3x)\n",
           section_length, section_length);
-  printf ("              transport_stream_id: %#.4x\n", transport_stream_id);
-  printf ("              version_number: %d\n", version_number);
-  printf ("              c/n indicator: %d\n", current_next_indicator);
-  printf ("              section_number: %d\n", section_number);
-  printf ("              last_section_number: %d\n", last_section_number);
+  dlog( LOG_CAT_DEMUX, "              transport_stream_id: %#.4x\n", transport_stream_id);
+  dlog( LOG_CAT_DEMUX, "              version_number: %d\n", version_number);
+  dlog( LOG_CAT_DEMUX, "              c/n indicator: %d\n", current_next_indicator);
+  dlog( LOG_CAT_DEMUX, "              section_number: %d\n", section_number);
+  dlog( LOG_CAT_DEMUX, "              last_section_number: %d\n", last_section_number);
 #endif
   if ((section_syntax_indicator != 1) || !(current_next_indicator)) {
     return;
   }
 
   if (pkt - original_pkt > BODY_SIZE - 1 - 3 - section_length) {
-    printf ("demux_ts: FIXME: (unsupported )PAT spans multiple TS packets\n");
+    dlog( LOG_CAT_DEMUX, "demux_ts: FIXME: (unsupported )PAT spans multiple TS packets\n");
     return;
   }
 
   if ((section_number != 0) || (last_section_number != 0)) {
-    printf ("demux_ts: FIXME: (unsupported) PAT consists of multiple (%d) sections\n", last_section_number);
+    dlog( LOG_CAT_DEMUX, "demux_ts: FIXME: (unsupported) PAT consists of multiple (%d) sections\n", last_section_number);
     return;
   }
 
@@ -679,13 +1064,13 @@ static void demux_ts_parse_cat (struct demux_ts_s *this, uint8_t *original_pkt,
   calc_crc32 = demux_ts_compute_crc32 (this, pkt+5, section_length+3-4,
                                        0xffffffff);
   if (crc32 != calc_crc32) {
-    printf ("demux_ts: demux error! PAT with invalid CRC32: packet_crc32: %.8x calc_crc32: %.8x\n",
+    elog( LOG_CAT_DEMUX, "demux_ts: demux error! PAT with invalid CRC32: packet_crc32: %.8x calc_crc32: %.8x\n",
 	     crc32,calc_crc32);
     return;
   }
 #ifdef TS_PAT_LOG
   else {
-    printf ("demux_ts: CAT CRC32: %.8x ok.\n", crc32);
+    dlog( LOG_CAT_DEMUX, "demux_ts: CAT CRC32: %.8x ok.\n", crc32);
   }
 #endif
 		for (n = 0; n < section_length - 9 ; ) {
@@ -701,18 +1086,105 @@ static void demux_ts_parse_cat (struct demux_ts_s *this, uint8_t *original_pkt,
 						 pkt[13 + n + 5]) & 0x1fff;
 				this->pids[ca_pid].type = PID_TYPE_CA_EMM;
 			}
-			printf ("              desc_tag: 0x%02x\n", desc_tag);
-			printf ("              desc_len: 0x%02x\n", desc_len);
+			dlog( LOG_CAT_DEMUX, "              desc_tag: 0x%02x\n", desc_tag);
+			dlog( LOG_CAT_DEMUX, "              desc_len: 0x%02x\n", desc_len);
 			if (desc_tag == 9) {
-				printf ("              ca_system_id: 0x%04x\n", ca_system_id);
-				printf ("              ca_pid: 0x%04x\n", ca_pid);
+				dlog( LOG_CAT_DEMUX, "              ca_system_id: 0x%04x\n", ca_system_id);
+				dlog( LOG_CAT_DEMUX, "              ca_pid: 0x%04x\n", ca_pid);
 			}
-			printf("n = %d\n", n);
+			dlog( LOG_CAT_DEMUX, "n = %d\n", n);
 			n += desc_len + 2;
-			printf("n + desc_len + 2 = %d\n", n);
+			dlog( LOG_CAT_DEMUX, "n + desc_len + 2 = %d\n", n);
+		}
+		xlog( LOG_CAT_DEMUX, "\n");
+
+}
+
+static inline uint32_t id_map_hash( uint16_t Id )
+{
+	return ( Id * 0x9e3779b1u ) >> 16;
+}
+
+/* Index of Id, ID_MAP_NONE if it is not in the map */
+static inline uint16_t id_map_find( const struct id_map_s *M, uint16_t Id )
+{
+	uint32_t n;
+
+	if( !M->size ) {
+		return ID_MAP_NONE;
+	}
+	n = id_map_hash( Id ) & ( M->size - 1 );
+	while( M->slots[n] ) {
+		if( ( M->slots[n] >> 16 ) == Id ) {
+			return ( M->slots[n] & 0xffff ) - 1;
+		}
+		n = ( n + 1 ) & ( M->size - 1 );
+	}
+	return ID_MAP_NONE;
+}
+
+/* Add an Id that is not in the map yet. Returns 0 when out of memory. */
+static int id_map_add( struct id_map_s *M, uint16_t Id, uint16_t Index )
+{
+	uint32_t *slots;
+	uint32_t size;
+	uint32_t n;
+	uint32_t m;
+
+	if( Index >= ID_MAP_NONE ) {
+		return 0;
+	}
+	/* Keep it at most half full */
+	if( ( M->count + 1 ) * 2 > M->size ) {
+		size = M->size ? M->size * 2 : 256;
+		slots = calloc( size, sizeof( uint32_t ) );
+		if( !slots ) {
+			return 0;
 		}
-		printf("\n");
+		for( m = 0; m < M->size; m++ ) {
+			if( !M->slots[m] ) {
+				continue;
+			}
+			n = id_map_hash( M->slots[m] >> 16 ) & ( size - 1 );
+			while( slots[n] ) {
+				n = ( n + 1 ) & ( size - 1 );
+			}
+			slots[n] = M->slots[m];
+		}
+		free( M->slots );
+		M->slots = slots;
+		M->size = size;
+	}
+	n = id_map_hash( Id ) & ( M->size - 1 );
+	while( M->slots[n] ) {
+		n = ( n + 1 ) & ( M->size - 1 );
+	}
+	M->slots[n] = ( uint32_t ) Id << 16 | ( Index + 1 );
+	M->count++;
+	return 1;
+}
+
+/* Double the capacity of a table of Count entries when it is full. The
+ * new entries are zeroed. Entries move, so pointers into the table do not
+ * survive a call that adds to it.
+ */
+static int table_reserve( void **Table, int *Size, int Count, size_t EntrySize )
+{
+	void *table;
+	int size;
 
+	if( Count < *Size ) {
+		return 1;
+	}
+	size = *Size ? *Size * 2 : 64;
+	table = realloc( *Table, size * EntrySize );
+	if( !table ) {
+		return 0;
+	}
+	memset( ( uint8_t * ) table + *Size * EntrySize, 0, ( size - *Size ) * EntrySize );
+	*Table = table;
+	*Size = size;
+	return 1;
 }
 
 /*
@@ -751,9 +1223,9 @@ static void demux_ts_parse_pat (struct demux_ts_s *this, uint8_t *original_pkt,
    * A PAT in a single section should start with a payload unit start
    * indicator set.
    */
-  printf ("demux_ts: parsing PAT\n");
+  dlog( LOG_CAT_DEMUX, "demux_ts: parsing PAT\n");
   if (!pusi) {
-    printf ("demux_ts: demux error! PAT without payload unit start indicator\n");
+    elog( LOG_CAT_DEMUX, "demux_ts: demux error! PAT without payload unit start indicator\n");
     return;
   }
 	pkt = original_pkt + offset;
@@ -762,7 +1234,7 @@ static void demux_ts_parse_pat (struct demux_ts_s *this, uint8_t *original_pkt,
    */
   pkt += pkt[4];
   if (pkt - original_pkt > PKT_SIZE) {
-    printf ("demux_ts: demux error! PAT with invalid pointer\n");
+    elog( LOG_CAT_DEMUX, "demux_ts: demux error! PAT with invalid pointer\n");
     return;
   }
   table_id = (unsigned int)pkt[5] ;
@@ -779,15 +1251,15 @@ static void demux_ts_parse_pat (struct demux_ts_s *this, uint8_t *original_pkt,
   crc32 |= (uint32_t)pkt[7+section_length] ;
 
 #ifdef TS_PAT_LOG
-  printf ("demux_ts: PAT table_id: %.2x\n", table_id);
-  printf ("              section_syntax: %d\n", section_syntax_indicator);
-  printf ("              section_length: %d (%#.3x)\n",
+  dlog( LOG_CAT_DEMUX, "demux_ts: PAT table_id: %.2x\n", table_id);
+  dlog( LOG_CAT_DEMUX, "              section_syntax: %d\n", section_syntax_indicator);
+  dlog( LOG_CAT_DEMUX, "              section_length: %d (%#.3x)\n",
           section_length, section_length);
-  printf ("              transport_stream_id: %#.4x\n", transport_stream_id);
-  printf ("              version_number: %d\n", version_number);
-  printf ("              c/n indicator: %d\n", current_next_indicator);
-  printf ("              section_number: %d\n", section_number);
-  printf ("              last_section_number: %d\n", last_section_number);
+  dlog( LOG_CAT_DEMUX, "              transport_stream_id: %#.4x\n", transport_stream_id);
+  dlog( LOG_CAT_DEMUX, "              version_number: %d\n", version_number);
+  dlog( LOG_CAT_DEMUX, "              c/n indicator: %d\n", current_next_indicator);
+  dlog( LOG_CAT_DEMUX, "              section_number: %d\n", section_number);
+  dlog( LOG_CAT_DEMUX, "              last_section_number: %d\n", last_section_number);
 #endif
 
   if ((section_syntax_indicator != 1) || !(current_next_indicator)) {
@@ -795,12 +1267,12 @@ static void demux_ts_parse_pat (struct demux_ts_s *this, uint8_t *original_pkt,
   }
 
   if (pkt - original_pkt > BODY_SIZE - 1 - 3 - section_length) {
-    printf ("demux_ts: FIXME: (unsupported )PAT spans multiple TS packets\n");
+    dlog( LOG_CAT_DEMUX, "demux_ts: FIXME: (unsupported )PAT spans multiple TS packets\n");
     return;
   }
 
   if ((section_number != 0) || (last_section_number != 0)) {
-    printf ("demux_ts: FIXME: (unsupported) PAT consists of multiple (%d) sections\n", last_section_number);
+    dlog( LOG_CAT_DEMUX, "demux_ts: FIXME: (unsupported) PAT consists of multiple (%d) sections\n", last_section_number);
     return;
   }
 
@@ -808,20 +1280,25 @@ static void demux_ts_parse_pat (struct demux_ts_s *this, uint8_t *original_pkt,
   calc_crc32 = demux_ts_compute_crc32 (this, pkt+5, section_length+3-4,
                                        0xffffffff);
   if (crc32 != calc_crc32) {
-    printf ("demux_ts: demux error! PAT with invalid CRC32: packet_crc32: %.8x calc_crc32: %.8x\n",
+    elog( LOG_CAT_DEMUX, "demux_ts: demux error! PAT with invalid CRC32: packet_crc32: %.8x calc_crc32: %.8x\n",
 	     crc32,calc_crc32);
     return;
   }
 #ifdef TS_PAT_LOG
   else {
-    printf ("demux_ts: PAT CRC32 ok.\n");
+    dlog( LOG_CAT_DEMUX, "demux_ts: PAT CRC32 ok.\n");
   }
 #endif
 
+  if (this->transport_stream_id != (int)transport_stream_id) {
+    this->transport_stream_id = transport_stream_id;
+    join.stale = 1;
+  }
+
   /*
    * Process all programs in the program loop.
    */
-	printf("section_length - 9 = %d\n", section_length - 9);
+	dlog( LOG_CAT_DEMUX, "section_length - 9 = %d\n", section_length - 9);
 	program_offset = pkt + 13;
 	count = (section_length - 9) / 4;
   program_count = 0;
@@ -840,12 +1317,18 @@ static void demux_ts_parse_pat (struct demux_ts_s *this, uint8_t *original_pkt,
      * use this loop to eventually add support for dynamically changing
      * PATs.
      */
-	program_count = 0;
-
-	while ((this->programs[program_count].program_id != INVALID_PROGRAM) &&
-		(this->programs[program_count].program_id != program_number)  &&
-		(program_count < 255 ) ) {
-		program_count++;
+	/* A PAT lists a handful of programs, a scan finds them */
+	for (program_count = 0; program_count < this->number_of_programs &&
+		this->programs[program_count].program_id != program_number; program_count++) {
+	}
+	if (program_count == this->number_of_programs) {
+		if (!table_reserve((void **)&this->programs, &this->programs_size, this->number_of_programs,
+			sizeof(struct program_s))) {
+			elog( LOG_CAT_DEMUX, "demux_ts: out of memory for programs\n");
+			return;
+		}
+		this->number_of_programs++;
+		join.stale = 1;
 	}
 	this->programs[program_count].program_id = program_number;
 	this->programs[program_count].pid_pmt = pmt_pid;
@@ -859,7 +1342,7 @@ static void demux_ts_parse_pat (struct demux_ts_s *this, uint8_t *original_pkt,
 
 #ifdef TS_PAT_LOG
     if (this->programs[program_count].program_id != INVALID_PROGRAM)
-      printf ("demux_ts: PAT acquired count=%d programNumber=0x%04x "
+      ilog( LOG_CAT_DEMUX, "demux_ts: PAT acquired count=%d programNumber=0x%04x "
               "pmtPid=0x%04x\n",
               program_count,
               this->programs[program_count].program_id,
@@ -904,7 +1387,6 @@ static void demux_ts_parse_section_si (struct demux_ts_s *this,
 	uint32_t       calc_crc32;
 	uint32_t       coded_length;
 	unsigned char *stream;
-	unsigned int	 i;
 	int		 count;
 	char		*ptr = NULL;
 	unsigned char  len;
@@ -912,7 +1394,6 @@ static void demux_ts_parse_section_si (struct demux_ts_s *this,
 	uint32_t	offset_section_start;
 	uint8_t		*pkt;
 	uint32_t	progress;
-	int		n;
 
 	/*
 	 * A new section should start with the payload unit start
@@ -920,9 +1401,9 @@ static void demux_ts_parse_section_si (struct demux_ts_s *this,
 	 * to copy the complete section into one chunk.
 	 */
 #ifdef TS_SI
-	printf("section->size = 0x%x\n", section->size);
-	printf("section->buffer_target = 0x%x\n", section->buffer_target);
-	printf("section->buffer_progress = 0x%x\n", section->buffer_progress);
+	dlog( LOG_CAT_DEMUX, "section->size = 0x%x\n", section->size);
+	dlog( LOG_CAT_DEMUX, "section->buffer_target = 0x%x\n", section->buffer_target);
+	dlog( LOG_CAT_DEMUX, "section->buffer_progress = 0x%x\n", section->buffer_progress);
 #endif
 	/* When the payload of the Transport Stream packet contains PES packet data, the payload_unit_start_indicator has the
 following significance: a '1' indicates that the payload of this Transport Stream packet will commence with the first byte
@@ -945,14 +1426,14 @@ stream_type 5
 	if (!section->whole_section) {
 		section->whole_section = calloc(0x1100, 1);   /* Max section length is 0xfff + 3 + 188 */
 		if (!section->whole_section) {
-			printf("OUT OF MEMORY!!!!\n");
+			elog( LOG_CAT_DEMUX, "OUT OF MEMORY!!!!\n");
 			return;
 		}
 	}
 	if (!section->buffer) {
 		section->buffer = calloc(0x1100, 1);   /* Max section length is 0xfff + 3 + 188 */
 		if (!section->buffer) {
-			printf("OUT OF MEMORY!!!!\n");
+			elog( LOG_CAT_DEMUX, "OUT OF MEMORY!!!!\n");
 			return;
 		}
 	}
@@ -961,44 +1442,44 @@ stream_type 5
 		/* pointer to start of section. */
 		/* Only exists if pusi is set. */
 #ifdef TS_SI
-		printf ("demux_ts: section pusi\n");
+		dlog( LOG_CAT_DEMUX, "demux_ts: section pusi\n");
 #endif
 		len = 188 - offset;
 #ifdef TS_SI
-		printf("pusi: offset = 0x%04x len = 0x%04x\n", offset, len);
+		dlog( LOG_CAT_DEMUX, "pusi: offset = 0x%04x len = 0x%04x\n", offset, len);
 #endif
 		tmp32 = original_pkt[offset + 4];
 		offset_section_start = offset + tmp32 + 5;
 		pkt = original_pkt + offset_section_start;
 #ifdef TS_SI
-		printf("pusi: offset_section_start = 0x%04x\n", offset_section_start);
+		dlog( LOG_CAT_DEMUX, "pusi: offset_section_start = 0x%04x\n", offset_section_start);
 #endif
 		
 
 		if (!section->whole_section) {
-			printf("CORRUPTED whole section!!!!\n");
+			elog( LOG_CAT_DEMUX, "CORRUPTED whole section!!!!\n");
 			return;
 		}
 		if (!section->buffer) {
-			printf("CORRUPTED section buffer!!!!\n");
+			elog( LOG_CAT_DEMUX, "CORRUPTED section buffer!!!!\n");
 			return;
 		}
 
 #ifdef TS_SI
-		printf("1 offset = 0x%x\n", offset);
-		printf("1 offset_section_start = 0x%x\n", offset_section_start);
-		printf("1 offset_section_start  -  offset - 3 = 0x%x\n", offset_section_start - offset - 3);
+		dlog( LOG_CAT_DEMUX, "1 offset = 0x%x\n", offset);
+		dlog( LOG_CAT_DEMUX, "1 offset_section_start = 0x%x\n", offset_section_start);
+		dlog( LOG_CAT_DEMUX, "1 offset_section_start  -  offset - 3 = 0x%x\n", offset_section_start - offset - 3);
 #endif
 		memcpy (section->buffer + section->buffer_progress, original_pkt + offset + 5, offset_section_start - offset - 3);
 		section->buffer_progress += offset_section_start - offset - 3;
 #ifdef TS_SI
-		printf("2 section->buffer_target = 0x%x\n", section->buffer_target);
-		printf("2 section->buffer_progress = 0x%x\n", section->buffer_progress);
+		dlog( LOG_CAT_DEMUX, "2 section->buffer_target = 0x%x\n", section->buffer_target);
+		dlog( LOG_CAT_DEMUX, "2 section->buffer_progress = 0x%x\n", section->buffer_progress);
 #endif
 		if ((section->buffer_target) && (section->buffer_progress >= section->buffer_target)) {
 			/* We have a complete section_si */
 #ifdef TS_SI
-			printf("complete section si!\n");
+			dlog( LOG_CAT_DEMUX, "complete section si!\n");
 #endif
 			memset(section->whole_section, 0, 0x1100);
 			memcpy(section->whole_section, section->buffer, section->buffer_target);
@@ -1030,35 +1511,35 @@ stream_type 5
 			program_info_length       = (((uint32_t) section->buffer[10] << 8) | section->buffer[11]) & 0x0fff;
 
 #ifdef TS_PMT_LOG
-			printf ("demux_ts: SECTION table_id: %2x, pid = 0x%x\n", table_id, pid);
-			printf ("              section_syntax: %d\n", section_syntax_indicator);
-			printf ("              section_length: %d (%#.3x)\n",
+			dlog( LOG_CAT_DEMUX, "demux_ts: SECTION table_id: %2x, pid = 0x%x\n", table_id, pid);
+			dlog( LOG_CAT_DEMUX, "              section_syntax: %d\n", section_syntax_indicator);
+			dlog( LOG_CAT_DEMUX, "              section_length: %d (%#.3x)\n",
 				section_length, section_length);
-			printf ("              program_number: %#.4x\n", program_number);
-			printf ("              version_number: %d\n", version_number);
-			printf ("              c/n indicator: %d\n", current_next_indicator);
-			printf ("              section_number: %d\n", section_number);
-			printf ("              last_section_number: %d\n", last_section_number);
-			printf ("              pcr_pid: 0x%04x\n", pcr_pid);
-			printf ("              program_info_length: 0x%04x\n", program_info_length);
-			printf ("              buffer_target: 0x%04x\n", section->buffer_target);
+			dlog( LOG_CAT_DEMUX, "              program_number: %#.4x\n", program_number);
+			dlog( LOG_CAT_DEMUX, "              version_number: %d\n", version_number);
+			dlog( LOG_CAT_DEMUX, "              c/n indicator: %d\n", current_next_indicator);
+			dlog( LOG_CAT_DEMUX, "              section_number: %d\n", section_number);
+			dlog( LOG_CAT_DEMUX, "              last_section_number: %d\n", last_section_number);
+			dlog( LOG_CAT_DEMUX, "              pcr_pid: 0x%04x\n", pcr_pid);
+			dlog( LOG_CAT_DEMUX, "              program_info_length: 0x%04x\n", program_info_length);
+			dlog( LOG_CAT_DEMUX, "              buffer_target: 0x%04x\n", section->buffer_target);
 #endif
 		}
 
 		if ((section_syntax_indicator != 1) || (!current_next_indicator)) {
 //#ifdef TS_PMT_LOG
-			printf ("ts_demux: section_syntax_indicator != 1 || !current_next_indicator\n");
+			dlog( LOG_CAT_DEMUX, "ts_demux: section_syntax_indicator != 1 || !current_next_indicator\n");
 //#endif
 			//section->size = 0;
 			//return;
 		}
 	} else {
 #ifdef TS_SI
-		printf ("demux_ts: section !pusi\n");
+		dlog( LOG_CAT_DEMUX, "demux_ts: section !pusi\n");
 #endif
 		if (discontinuity) {
 			section->size = 0;
-			printf ("demux_ts: section !pusi discontinuity\n");
+			dlog( LOG_CAT_DEMUX, "demux_ts: section !pusi discontinuity\n");
 			return;
 		}
 		/* Wait for pusi */
@@ -1067,7 +1548,7 @@ stream_type 5
 		}
 		len = 188 - offset - 4;
 #ifdef TS_SI
-		printf("!pusi: offset = 0x%04x len = 0x%04x\n", offset, len);
+		dlog( LOG_CAT_DEMUX, "!pusi: offset = 0x%04x len = 0x%04x\n", offset, len);
 #endif
 		memcpy (section->buffer + section->buffer_progress, original_pkt + offset + 4, len);
 		section->buffer_progress += len;
@@ -1092,44 +1573,135 @@ stream_type 5
 			program_info_length       = (((uint32_t) section->buffer[10] << 8) | section->buffer[11]) & 0x0fff;
 
 #ifdef TS_PMT_LOG
-			printf ("demux_ts: SECTION table_id: %2x, pid = 0x%x (small)\n", table_id, pid);
-			printf ("              section_syntax: %d\n", section_syntax_indicator);
-			printf ("              section_length: %d (%#.3x)\n",
+			dlog( LOG_CAT_DEMUX, "demux_ts: SECTION table_id: %2x, pid = 0x%x (small)\n", table_id, pid);
+			dlog( LOG_CAT_DEMUX, "              section_syntax: %d\n", section_syntax_indicator);
+			dlog( LOG_CAT_DEMUX, "              section_length: %d (%#.3x)\n",
 				section_length, section_length);
-			printf ("              program_number: %#.4x\n", program_number);
-			printf ("              version_number: %d\n", version_number);
-			printf ("              c/n indicator: %d\n", current_next_indicator);
-			printf ("              section_number: %d\n", section_number);
-			printf ("              last_section_number: %d\n", last_section_number);
-			printf ("              pcr_pid: 0x%04x\n", pcr_pid);
-			printf ("              program_info_length: 0x%04x\n", program_info_length);
-			printf ("              buffer_target: 0x%04x\n", section->buffer_target);
+			dlog( LOG_CAT_DEMUX, "              program_number: %#.4x\n", program_number);
+			dlog( LOG_CAT_DEMUX, "              version_number: %d\n", version_number);
+			dlog( LOG_CAT_DEMUX, "              c/n indicator: %d\n", current_next_indicator);
+			dlog( LOG_CAT_DEMUX, "              section_number: %d\n", section_number);
+			dlog( LOG_CAT_DEMUX, "              last_section_number: %d\n", last_section_number);
+			dlog( LOG_CAT_DEMUX, "              pcr_pid: 0x%04x\n", pcr_pid);
+			dlog( LOG_CAT_DEMUX, "              program_info_length: 0x%04x\n", program_info_length);
+			dlog( LOG_CAT_DEMUX, "              buffer_target: 0x%04x\n", section->buffer_target);
 #endif
 		}
 		if ((section->buffer_target) && (section->buffer_progress >= section->buffer_target)) {
 			/* We have a complete section_si */
-			printf("complete section si 2!\n");
+			dlog( LOG_CAT_DEMUX, "complete section si 2!\n");
 			memset(section->whole_section, 0, 0x1100);
 			memcpy(section->whole_section, section->buffer, section->buffer_target);
 			section->size = section->buffer_target;
 		}
 	}
 #ifdef TS_SI
-	printf("section->size = 0x%x\n", section->size);
-	printf("section->buffer_target = 0x%x\n", section->buffer_target);
-	printf("section->buffer_progress = 0x%x\n", section->buffer_progress);
+	dlog( LOG_CAT_DEMUX, "section->size = 0x%x\n", section->size);
+	dlog( LOG_CAT_DEMUX, "section->buffer_target = 0x%x\n", section->buffer_target);
+	dlog( LOG_CAT_DEMUX, "section->buffer_progress = 0x%x\n", section->buffer_progress);
 #endif
 #if 0
 	for(n = 0; n < section->buffer_progress; n++) {
-		printf("%02x ", section->buffer[n]);
+		xlog( LOG_CAT_DEMUX, "%02x ", section->buffer[n]);
 		if ((n % 32) == 31) {
-			printf("\n");
+			xlog( LOG_CAT_DEMUX, "\n");
 		}
 	}
-	printf("\n");
+	xlog( LOG_CAT_DEMUX, "\n");
 #endif
 }
 
+/* With the string pool further down */
+uint32_t string_intern( struct string_pool_s *pool, const char *str, int len );
+
+static inline uint32_t service_hash( uint16_t Nid, uint16_t Tid, uint16_t Sid )
+{
+	uint64_t key = ( ( uint64_t ) Nid << 32 ) | ( ( uint32_t ) Tid << 16 ) | Sid;
+	return ( key * 0x9e3779b97f4a7c15ull ) >> 32;
+}
+
+static int service_table_grow_index( struct service_table_s *T )
+{
+	uint32_t *index;
+	uint32_t size;
+	uint32_t n;
+	int s;
+
+	size = T->index_size ? T->index_size * 2 : 256;
+	index = calloc( size, sizeof( uint32_t ) );
+	if( !index ) {
+		return 0;
+	}
+	for( s = 0; s < T->count; s++ ) {
+		n = service_hash( T->services[s].Nid, T->services[s].Tid, T->services[s].program_id ) & ( size - 1 );
+		while( index[n] ) {
+			n = ( n + 1 ) & ( size - 1 );
+		}
+		index[n] = s + 1;
+	}
+	free( T->index );
+	T->index = index;
+	T->index_size = size;
+	return 1;
+}
+
+/* The service, or NULL if the SDT has not listed it */
+struct service_s *service_find( struct service_table_s *T, uint16_t Nid, uint16_t Tid, uint16_t Sid )
+{
+	struct service_s *S;
+	uint32_t n;
+
+	if( !T->index_size ) {
+		return NULL;
+	}
+	n = service_hash( Nid, Tid, Sid ) & ( T->index_size - 1 );
+	while( T->index[n] ) {
+		S = &T->services[T->index[n] - 1];
+		if( S->program_id == Sid && S->Tid == Tid && S->Nid == Nid ) {
+			return S;
+		}
+		n = ( n + 1 ) & ( T->index_size - 1 );
+	}
+	return NULL;
+}
+
+/* Find the service, adding an unnamed one if it is new. NULL when out of memory. */
+struct service_s *service_add( struct service_table_s *T, uint16_t Nid, uint16_t Tid, uint16_t Sid )
+{
+	struct service_s *S;
+	uint32_t n;
+	int size;
+
+	S = service_find( T, Nid, Tid, Sid );
+	if( S ) {
+		return S;
+	}
+	/* Keep the index at most half full */
+	if( ( uint32_t ) ( T->count + 1 ) * 2 > T->index_size && !service_table_grow_index( T ) ) {
+		return NULL;
+	}
+	if( T->count == T->size ) {
+		size = T->size ? T->size * 2 : 256;
+		S = realloc( T->services, size * sizeof( struct service_s ) );
+		if( !S ) {
+			return NULL;
+		}
+		T->services = S;
+		T->size = size;
+	}
+	S = &T->services[T->count];
+	memset( S, 0, sizeof( *S ) );
+	S->Nid = Nid;
+	S->Tid = Tid;
+	S->program_id = Sid;
+	n = service_hash( Nid, Tid, Sid ) & ( T->index_size - 1 );
+	while( T->index[n] ) {
+		n = ( n + 1 ) & ( T->index_size - 1 );
+	}
+	T->index[n] = ++T->count;
+	return S;
+}
+
 static void process_sdt_descriptors(struct demux_ts_s *this, struct service_s *service, uint8_t *buffer, int len)
 {
 	int n, m;
@@ -1143,48 +1715,41 @@ static void process_sdt_descriptors(struct demux_ts_s *this, struct service_s *s
 	for (n = 0; n < len; ) {
 		desc_tag = buffer[n];
 		desc_len = buffer[n + 1];
-		printf("sdt: tag=0x%x, len=0x%x\n", desc_tag, desc_len);
+		dlog( LOG_CAT_SDT, "sdt: tag=0x%x, len=0x%x\n", desc_tag, desc_len);
 		switch (desc_tag) {
 		case 0x48:
 			type =  buffer[n + 2];
 			len2 = buffer[n + 3];
-			printf("type:0x%x, len2:0x%x\n", type, len2);
-			for (m = 0; m < len2; m++) {
-				printf("%c", buffer[n + m + 4]);
-			}
-			printf("\n");
-			if (!(service->provider)) {
-				service->provider = malloc(len2+1);
+			dlog( LOG_CAT_SDT, "type:0x%x, len2:0x%x\n", type, len2);
+			dlog( LOG_CAT_SDT, "%.*s\n", len2, &buffer[n + 4]);
+			if (len2 + 2 > desc_len) {
+				break;
 			}
-			memcpy(service->provider, &buffer[n + 4], len2);
-			service->provider[len2] = 0;
 			len3 = buffer[n + 4 + len2];
-			printf("len3:0x%x\n", len3);
-			for (m = 0; m < len3; m++) {
-				printf("%c", buffer[n + m + 5 + len2]);
-			}
-			printf("\n");
-			if (!(service->name)) {
-				service->name = malloc(len3+1);
+			dlog( LOG_CAT_SDT, "len3:0x%x\n", len3);
+			dlog( LOG_CAT_SDT, "%.*s\n", len3, &buffer[n + 5 + len2]);
+			if (len2 + len3 + 3 > desc_len) {
+				break;
 			}
-			memcpy(service->name, &buffer[n + 5 + len2], len3);
-			service->name[len3] = 0;
+			/* The SDT repeats, interning makes a repeat a lookup and shares "BSkyB" */
+			service->provider_id = string_intern(&string_pool, (char *)&buffer[n + 4], len2);
+			service->name_id = string_intern(&string_pool, (char *)&buffer[n + 5 + len2], len3);
 			break;
 		default:
-			printf("sdt: Unknown tag 0x%x\n", desc_tag);
+			dlog( LOG_CAT_SDT, "sdt: Unknown tag 0x%x\n", desc_tag);
 			for (m = 0; m < desc_len; m++) {
-				printf("%02x", buffer[n + m + 2]);
+				xlog( LOG_CAT_SDT, "%02x", buffer[n + m + 2]);
 			}
-			printf("\n");
+			xlog( LOG_CAT_SDT, "\n");
 			for (m = 0; m < desc_len; m++) {
 				tmp =buffer[n + m + 2];
 				if ((tmp > 31) && (tmp < 127)) {
-					printf("%c ", tmp);
+					xlog( LOG_CAT_SDT, "%c ", tmp);
 				} else {
-					printf("  ", tmp);
+					xlog( LOG_CAT_SDT, "  ");
 				}
 			}
-			printf("\n");
+			xlog( LOG_CAT_SDT, "\n");
 			break;
 		}
 
@@ -1205,6 +1770,8 @@ static void parse_sdt_actual(struct demux_ts_s *this, int pid)
 	uint32_t last_section_number;
 	uint32_t offset = 11;
 	uint32_t service_id;
+	uint32_t original_network_id;
+	struct service_s *service;
 	int descriptors_loop_len;
 	int n;
 
@@ -1219,28 +1786,28 @@ static void parse_sdt_actual(struct demux_ts_s *this, int pid)
 	section_version_number = (buffer[5] >> 1) & 0x1f;
 	section_number = buffer[6];
 	last_section_number = buffer[7];
+	original_network_id = (buffer[8] << 8) | buffer[9];
+	if (buffer[0] == 0x42 && this->original_network_id != (int)original_network_id) {
+		this->original_network_id = original_network_id;
+		join.stale = 1;
+	}
+	service_count = this->services.count;
 	
 	for (n = offset; n < section_length - 4; ) {
 		service_id = (buffer[n] << 8) | buffer[n + 1];
 		descriptors_loop_len = ((buffer[n + 3] & 0x0f) << 8) | buffer[n + 4];
 		//printf("sdt actual: service_id:0x%x len:0x%x\n", service_id, descriptors_loop_len);
-		service_count = 0;
-
-		while ((this->services[service_count].program_id != INVALID_PROGRAM) &&
-			(this->services[service_count].program_id != service_id)  &&
-			(service_count < MAX_SERVICES ) ) {
-			service_count++;
-		}
-		if (service_count == MAX_SERVICES) {
-			printf("ERROR: MAX_SERVICES overflow\n");
+		service = service_add(&this->services, original_network_id, table_id_ext, service_id);
+		if (!service) {
+			elog( LOG_CAT_SDT, "ERROR: out of memory for services\n");
 			return;
 		}
-		this->services[service_count].program_id = service_id;
-		process_sdt_descriptors( this, &(this->services[service_count]), &buffer[n + 5], descriptors_loop_len );
-		//printf("sdt actual: service_count=0x%x, %s, %s\n", service_count, this->services[service_count].provider, this->services[service_count].name);
-		//printf("sdt actual: service_count=0x%x, %s, %s\n", 0xe, this->services[0xe].provider, this->services[0xe].name);
+		process_sdt_descriptors( this, service, &buffer[n + 5], descriptors_loop_len );
 		n += descriptors_loop_len + 5;
 	}
+	if (this->services.count != service_count) {
+		join.stale = 1;
+	}
 }
 
 #if 1
@@ -1248,72 +1815,289 @@ static void parse_sdt_actual(struct demux_ts_s *this, int pid)
     unsigned char DecodeErrorText[4096];
 	uint8_t buffer_for_decode[4096];
 
-int decode_huffman_code( unsigned char *Data, int Length, uint8_t *decoded )
+/* Free list of a size, -1 if it does not have one */
+static int arena_free_class( size_t size )
 {
-  int i;
-  int p;
-  int q;
-  int CodeError;
-  int IsFound;
-  unsigned char Byte;
-  unsigned char lastByte;
-  unsigned char Mask;
-  unsigned char lastMask;
-	struct sNode *nH;
-  nH = &H;
-  p = 0;
-  q = 0;
-  DecodeText[0] = '\0';
-  DecodeErrorText[0] = '\0';
-	if (!Length) {
-		return p;
+	int n;
+
+	if( size & ( size - 1 ) || size > ARENA_BLOCK_SIZE / 4 ) {
+		return -1;
 	}
-  CodeError = 0;
-  IsFound = 0;
-  lastByte = 0;
-  lastMask = 0;
-  for( i = 0; i < Length; i ++ )
-  {
-    Byte = Data[i];
-    Mask = 0x80;
-    if( i == 0 )
-    {
-      Mask = 0x20;
-      lastByte = i;
-      lastMask = Mask;
-    }
-    loop1:;
-    if( IsFound )
-    {
-      lastByte = i;
-      lastMask = Mask;
-      IsFound = 0;
-    }
-    if( ( Byte & Mask ) == 0 )
-    {
-      //printf("0");
-      if( CodeError )
-      {
-        DecodeErrorText[q] = 0x30;
-	q ++;
-	goto nextloop1;
-      }
-      if( nH->P0 != NULL )
-      {
-        nH = nH->P0;
-	if( nH->Value != NULL )
-	{
-	  memcpy( &DecodeText[p], nH->Value, strlen( nH->Value ) );
-	  //printf(" %s\n",nH->Value);
-	  p += strlen( nH->Value );
-	  nH = &H;
-	  IsFound = 1;
+	for( n = 0; ( ( size_t ) 1 << n ) < size; n++ ) {
 	}
-      }
-      else
+	return n;
+}
+
+/* NULL when out of memory or when size would take the arena over its limit */
+void *arena_alloc( struct arena_s *arena, size_t size )
+{
+	struct arena_block_s *B;
+	size_t block_size;
+	void *ptr;
+	int n;
+
+	size = ( size + ARENA_ALIGN - 1 ) & ~( size_t ) ( ARENA_ALIGN - 1 );
+	if( arena->limit && arena->allocated + size > arena->limit ) {
+		arena->refused++;
+		return NULL;
+	}
+	n = arena_free_class( size );
+	if( n >= 0 && arena->free[n] ) {
+		ptr = arena->free[n];
+		arena->free[n] = *( void ** ) ptr;
+		arena->allocated += size;
+		return ptr;
+	}
+	B = arena->blocks;
+	if( !B || B->used + size > B->size ) {
+		block_size = ARENA_BLOCK_SIZE;
+		if( size > block_size / 4 ) {
+			/* Large allocations get a block of their own */
+			block_size = size;
+		}
+		B = malloc( sizeof( struct arena_block_s ) + block_size );
+		if( !B ) {
+			printf( "failed to allocate memory for arena\n" );
+			return NULL;
+		}
+		B->size = block_size;
+		B->used = 0;
+		if( block_size == size && arena->blocks ) {
+			/* Keep bumping in the current block */
+			B->next = arena->blocks->next;
+			arena->blocks->next = B;
+		} else {
+			B->next = arena->blocks;
+			arena->blocks = B;
+		}
+		arena->reserved += block_size;
+	}
+	B->used += size;
+	arena->allocated += size;
+	return B->data + B->used - size;
+}
+
+/* Hand back a table that is no longer used. One in a block of its own
+ * goes back to malloc, a power of two size to its free list. Anything
+ * else stays in the arena until the generation is released.
+ */
+void arena_free( struct arena_s *arena, void *ptr, size_t size )
+{
+	struct arena_block_s **P;
+	struct arena_block_s *B;
+	int n;
+
+	if( !ptr ) {
+		return;
+	}
+	size = ( size + ARENA_ALIGN - 1 ) & ~( size_t ) ( ARENA_ALIGN - 1 );
+	if( size > ARENA_BLOCK_SIZE / 4 ) {
+		for( P = &arena->blocks; ( B = *P ); P = &B->next ) {
+			if( B->data == ptr && B->used == size ) {
+				*P = B->next;
+				arena->reserved -= B->size;
+				arena->allocated -= size;
+				free( B );
+				return;
+			}
+		}
+		return;
+	}
+	n = arena_free_class( size );
+	if( n >= 0 ) {
+		*( void ** ) ptr = arena->free[n];
+		arena->free[n] = ptr;
+		arena->allocated -= size;
+	}
+}
+
+/* Grow an allocation, in place when it is the last one of the current block.
+ * Otherwise the old copy is handed back with arena_free().
+ */
+void *arena_grow( struct arena_s *arena, void *old, size_t old_size, size_t new_size )
+{
+	struct arena_block_s *B;
+	void *ptr;
+
+	old_size = ( old_size + ARENA_ALIGN - 1 ) & ~( size_t ) ( ARENA_ALIGN - 1 );
+	B = arena->blocks;
+	if( old && B && ( uint8_t * ) old + old_size == B->data + B->used ) {
+		size_t size = ( new_size + ARENA_ALIGN - 1 ) & ~( size_t ) ( ARENA_ALIGN - 1 );
+		if( B->used - old_size + size <= B->size ) {
+			if( arena->limit && arena->allocated - old_size + size > arena->limit ) {
+				arena->refused++;
+				return NULL;
+			}
+			B->used = B->used - old_size + size;
+			arena->allocated = arena->allocated - old_size + size;
+			return old;
+		}
+	}
+	ptr = arena_alloc( arena, new_size );
+	if( ptr && old ) {
+		memcpy( ptr, old, old_size < new_size ? old_size : new_size );
+		arena_free( arena, old, old_size );
+	}
+	return ptr;
+}
+
+/* Whether size more bytes fit in the budget. arena_alloc() enforces it,
+ * callers with somewhere else to put their data check this first.
+ */
+int arena_has_room( struct arena_s *arena, size_t size )
+{
+	return !arena->limit || arena->allocated + size <= arena->limit;
+}
+
+void arena_release( struct arena_s *arena )
+{
+	struct arena_block_s *B;
+	while( arena->blocks ) {
+		B = arena->blocks;
+		arena->blocks = B->next;
+		free( B );
+	}
+	arena->allocated = 0;
+	arena->reserved = 0;
+	memset( arena->free, 0, sizeof( arena->free ) );
+}
+
+#define FNV1A_BASIS 2166136261u
+
+static uint32_t hash_fnv1a_update( uint32_t hash, const void *Data, int Length )
+{
+	const uint8_t *d = Data;
+	int n;
+	for( n = 0; n < Length; n++ ) {
+		hash = ( hash ^ d[n] ) * 16777619u;
+	}
+	return hash;
+}
+
+static uint32_t hash_fnv1a( const void *Data, int Length )
+{
+	return hash_fnv1a_update( FNV1A_BASIS, Data, Length );
+}
+
+/* Record the code that walked off the tree: the bits of the current symbol
+ * from (Byte, Mask) up to and including the failing bit at (lastByte, lastMask).
+ */
+static struct huffman_miss_s *huffman_profile_miss( unsigned char *Data, int Byte, unsigned char Mask, int lastByte, unsigned char lastMask )
+{
+	char code[MAX_HUFFMAN_CODE];
+	uint32_t hash;
+	int len;
+	int n;
+	struct huffman_miss_s *M;
+
+	len = 0;
+	while( len < MAX_HUFFMAN_CODE - 1 ) {
+		code[len++] = ( Data[Byte] & Mask ) ? '1' : '0';
+		if( Byte == lastByte && Mask == lastMask ) {
+			break;
+		}
+		Mask = Mask >> 1;
+		if( Mask == 0 ) {
+			Mask = 0x80;
+			Byte++;
+		}
+	}
+	code[len] = 0;
+	hash = hash_fnv1a( code, len );
+	n = hash % MAX_HUFFMAN_MISSES;
+	while( huffman_stats.misses[n].count ) {
+		if( strcmp( huffman_stats.misses[n].code, code ) == 0 ) {
+			huffman_stats.misses[n].count++;
+			return &huffman_stats.misses[n];
+		}
+		n = ( n + 1 ) % MAX_HUFFMAN_MISSES;
+	}
+	if( huffman_stats.misses_count >= MAX_HUFFMAN_MISSES - 1 ) {
+		return NULL;
+	}
+	M = &huffman_stats.misses[n];
+	memcpy( M->code, code, len + 1 );
+	M->sample[0] = 0;
+	M->count = 1;
+	huffman_stats.misses_count++;
+	return M;
+}
+
+int decode_huffman_code( unsigned char *Data, int Length, uint8_t *decoded )
+{
+	struct huffman_miss_s *Miss = NULL;
+  int i;
+  int p;
+  int q;
+  int CodeError;
+  int IsFound;
+  unsigned char Byte;
+  unsigned char lastByte;
+  unsigned char Mask;
+  unsigned char lastMask;
+	struct sNode *nH;
+	struct sNode *Root;
+  /* Hold on to this version of the dictionary for the whole string */
+  Root = &tables->H;
+  nH = Root;
+  p = 0;
+  q = 0;
+  DecodeText[0] = '\0';
+  DecodeErrorText[0] = '\0';
+	if (!Length) {
+		return p;
+	}
+  CodeError = 0;
+  IsFound = 0;
+  lastByte = 0;
+  lastMask = 0;
+  for( i = 0; i < Length; i ++ )
+  {
+    Byte = Data[i];
+    Mask = 0x80;
+    if( i == 0 )
+    {
+      Mask = 0x20;
+      lastByte = i;
+      lastMask = Mask;
+    }
+    loop1:;
+    if( IsFound )
+    {
+      lastByte = i;
+      lastMask = Mask;
+      IsFound = 0;
+    }
+    if( ( Byte & Mask ) == 0 )
+    {
+      //printf("0");
+      if( CodeError )
+      {
+        DecodeErrorText[q] = 0x30;
+	q ++;
+	goto nextloop1;
+      }
+      if( nH->P0 != NULL )
+      {
+        nH = nH->P0;
+	if( nH->Value != NULL )
+	{
+	  memcpy( &DecodeText[p], nH->Value, strlen( nH->Value ) );
+	  //printf(" %s\n",nH->Value);
+	  p += strlen( nH->Value );
+	  nH->Hits++;
+	  nH = Root;
+	  IsFound = 1;
+	}
+      }
+      else
       {
 	memcpy( &DecodeText[p], "<...?...>", 9 );
 	p += 9;
+	if( huffman_profile )
+	{
+	  Miss = huffman_profile_miss( Data, lastByte, lastMask, i, Mask );
+	}
 	i = lastByte;
 	Byte = Data[lastByte];
 	Mask = lastMask;
@@ -1338,7 +2122,8 @@ int decode_huffman_code( unsigned char *Data, int Length, uint8_t *decoded )
 	  memcpy( &DecodeText[p], nH->Value, strlen( nH->Value ) );
 	  //printf(" %s\n",nH->Value);
 	  p += strlen( nH->Value );
-	  nH = &H;
+	  nH->Hits++;
+	  nH = Root;
 	  IsFound = 1;
 	}
       }
@@ -1346,6 +2131,10 @@ int decode_huffman_code( unsigned char *Data, int Length, uint8_t *decoded )
       {
 	memcpy( &DecodeText[p], "<...?...>", 9 );
 	p += 9;
+	if( huffman_profile )
+	{
+	  Miss = huffman_profile_miss( Data, lastByte, lastMask, i, Mask );
+	}
 	i = lastByte;
 	Byte = Data[lastByte];
 	Mask = lastMask;
@@ -1362,6 +2151,23 @@ int decode_huffman_code( unsigned char *Data, int Length, uint8_t *decoded )
   }
   DecodeText[p] = '\0';
   DecodeErrorText[q] = '\0';
+  if( huffman_profile )
+  {
+    huffman_stats.decodes++;
+    huffman_stats.bytes += Length;
+    if( CodeError )
+    {
+      huffman_stats.errors++;
+      if( Miss && !Miss->sample[0] )
+      {
+        snprintf( Miss->sample, sizeof( Miss->sample ), "%s", DecodeErrorText );
+      }
+    }
+  }
+  if( CodeError )
+  {
+    dlog( LOG_CAT_HUFFMAN, "huffman: undecodable bits in '%s': %s\n", DecodeText, DecodeErrorText );
+  }
 //	printf("\nEND\n");
   return p;
 }
@@ -1382,19 +2188,16 @@ int isempty(const char *s)
   return !(s && *skipspace(s));
 }
 
-int read_huff_dict( void )
+int read_huff_dict( struct sNode *Root, const char *FileName )
 {
-  char *FileName;
   FILE *FileDict;
   char *Line;
   char Buffer[256];
 	struct sNode *nH;
-  asprintf( &FileName, "%s/%s", "conf", "sky_uk.dict" );
   FileDict = fopen( FileName, "r" );
   if( FileDict == NULL )
   {
-    printf( "LoadEPG: Error opening file '%s'. %s", FileName, strerror( errno ) );
-    free( FileName );
+    printf( "LoadEPG: Error opening file '%s'. %s\n", FileName, strerror( errno ) );
     return 0;
   }
   else
@@ -1403,9 +2206,10 @@ int read_huff_dict( void )
     int LenPrefix;
     char string1[256];
     char string2[256];
-    H.Value = NULL;
-    H.P0 = NULL;
-    H.P1 = NULL;
+    Root->Value = NULL;
+    Root->P0 = NULL;
+    Root->P1 = NULL;
+    Root->Hits = 0;
     while( ( Line = fgets( Buffer, sizeof( Buffer ), FileDict ) ) != NULL )
     {
       if( ! isempty( Line ) )
@@ -1419,7 +2223,7 @@ int read_huff_dict( void )
         else if( sscanf( Line, "%[^=]=%[^\n]\n", string1, string2 ) == 2 )
 	{
 	  codingstart:;
-	  nH = &H;
+	  nH = Root;
 	  LenPrefix = strlen( string2 );
 	  for( i = 0; i < LenPrefix; i ++ )
 	  {
@@ -1433,6 +2237,7 @@ int read_huff_dict( void )
 		  nH->Value = NULL;
 		  nH->P0 = NULL;
 		  nH->P1 = NULL;
+		  nH->Hits = 0;
 		  if( ( LenPrefix - 1 ) == i )
 		  {
 		    asprintf( &nH->Value, "%s", string1 );
@@ -1455,6 +2260,7 @@ int read_huff_dict( void )
 		  nH->Value = NULL;
 		  nH->P0 = NULL;
 		  nH->P1 = NULL;
+		  nH->Hits = 0;
 		  if( ( LenPrefix - 1 ) == i )
 		  {
 		    asprintf( &nH->Value, "%s", string1 );
@@ -1500,7 +2306,7 @@ int read_huff_dict( void )
         else if( sscanf( Line, "%[^=]=%[^\n]\n", string1, string2 ) == 2 )
 	{
 	  verifystart:;
-	  nH = &H;
+	  nH = Root;
 	  LenPrefix = strlen( string2 );
 	  for( i = 0; i < LenPrefix; i ++ )
 	  {
@@ -1538,110 +2344,3626 @@ int read_huff_dict( void )
     }
     fclose( FileDict );
   }
-  free( FileName );
   return 1;
 }
 #endif
-#if 0
-bool cTaskLoadepg::ReadFileThemes( void )
+
+void free_huff_tree( struct sNode *nH )
+{
+  if( nH->P0 != NULL )
+  {
+    free_huff_tree( nH->P0 );
+    free( nH->P0 );
+  }
+  if( nH->P1 != NULL )
+  {
+    free_huff_tree( nH->P1 );
+    free( nH->P1 );
+  }
+  free( nH->Value );
+}
+
+static struct sNode *find_huff_value( struct sNode *nH, const char *Value )
+{
+  struct sNode *Found = NULL;
+  if( nH->Value != NULL )
+  {
+    return strcmp( nH->Value, Value ) ? NULL : nH;
+  }
+  if( nH->P0 != NULL )
+  {
+    Found = find_huff_value( nH->P0, Value );
+  }
+  if( Found == NULL && nH->P1 != NULL )
+  {
+    Found = find_huff_value( nH->P1, Value );
+  }
+  return Found;
+}
+
+/* Add the profile hits of From to the same symbols in To, whatever their
+ * code is there. Returns the hits of symbols To does not have.
+ */
+static uint64_t carry_huff_hits( struct sNode *From, struct sNode *To )
+{
+  struct sNode *nH;
+  uint64_t lost = 0;
+  if( From->Value != NULL )
+  {
+    if( From->Hits )
+    {
+      nH = find_huff_value( To, From->Value );
+      if( nH != NULL )
+      {
+        nH->Hits += From->Hits;
+      }
+      else
+      {
+        lost = From->Hits;
+      }
+    }
+    return lost;
+  }
+  if( From->P0 != NULL )
+  {
+    lost += carry_huff_hits( From->P0, To );
+  }
+  if( From->P1 != NULL )
+  {
+    lost += carry_huff_hits( From->P1, To );
+  }
+  return lost;
+}
+
+int read_themes( char **Themes, const char *FileName )
 {
-  char *FileName;
   FILE *FileThemes;
   char *Line;
   char Buffer[256];
-  asprintf( &FileName, "%s/%s", "conf", "sky_uk.dict" );
+  int id;
+  char string1[256];
+  char string2[256];
   FileThemes = fopen( FileName, "r" );
   if( FileThemes == NULL )
   {
-    esyslog( "LoadEPG: Error opening file '%s'. %s", FileName, strerror( errno ) );
-    free( FileName );
-    return false;
+    printf( "LoadEPG: Error opening file '%s'. %s\n", FileName, strerror( errno ) );
+    return 0;
   }
-  else
+  id = 0;
+  while( ( Line = fgets( Buffer, sizeof( Buffer ), FileThemes ) ) != NULL && id < MAX_THEMES )
   {
-    int id = 0;
-    char string1[256];
-    char string2[256];
-    while( ( Line = fgets( Buffer, sizeof( Buffer ), FileThemes ) ) != NULL )
+    memset( string1, 0, sizeof( string1 ) );
+    memset( string2, 0, sizeof( string2 ) );
+    if( ! isempty( Line ) )
     {
-      memset( string1, 0, sizeof( string1 ) );
-      memset( string2, 0, sizeof( string2 ) );
-      if( ! isempty( Line ) )
+      if( sscanf( Line, "%[^=] =%[^\n] ", string1, string2 ) == 2 )
       {
-	sTheme *T = ( lThemes + id );
-        if( sscanf( Line, "%[^=] =%[^\n] ", string1, string2 ) == 2 )
-	{
-	  snprintf( ( char * ) T->Name, 255, "%s", string2 );
+        Themes[id] = strdup( string2 );
+      }
+      id ++;
+    }
+  }
+  fclose( FileThemes );
+  return 1;
+}
+
+#define BITMAP_SET( Map, n ) ( ( Map )[( n ) >> 3] |= 1 << ( ( n ) & 7 ) )
+#define BITMAP_TEST( Map, n ) ( ( Map )[( n ) >> 3] & ( 1 << ( ( n ) & 7 ) ) )
+
+/* Lines are "sky <number>", "chid <ChannelId>" or "sid <Sid>", # starts a comment */
+int read_channel_filter( struct channel_filter_s *F, const char *FileName )
+{
+  FILE *File;
+  char *Line;
+  char Buffer[256];
+  char Type[256];
+  unsigned long Value;
+  int n;
+  File = fopen( FileName, "r" );
+  if( File == NULL )
+  {
+    printf( "LoadEPG: Error opening file '%s'. %s\n", FileName, strerror( errno ) );
+    return 0;
+  }
+  n = 0;
+  while( ( Line = fgets( Buffer, sizeof( Buffer ), File ) ) != NULL )
+  {
+    n ++;
+    if( isempty( Line ) || Line[strspn( Line, " \t" )] == '#' )
+    {
+      continue;
+    }
+    if( sscanf( Line, "%255s %li", Type, &Value ) != 2 || Value > 0xffff )
+    {
+      printf( "LoadEPG: %s:%d: bad channel filter entry\n", FileName, n );
+      continue;
+    }
+    if( !strcasecmp( Type, "sky" ) )
+    {
+      BITMAP_SET( F->sky_number, Value );
+    }
+    else if( !strcasecmp( Type, "chid" ) )
+    {
+      BITMAP_SET( F->channel_id, Value );
+    }
+    else if( !strcasecmp( Type, "sid" ) )
+    {
+      BITMAP_SET( F->sid, Value );
+    }
+    else
+    {
+      printf( "LoadEPG: %s:%d: unknown channel filter type '%s'\n", FileName, n, Type );
+    }
+  }
+  fclose( File );
+  F->enabled = 1;
+  return 1;
+}
+
+/* Called from the BAT for every channel it lists */
+void channel_filter_resolve( struct channel_filter_s *F, uint16_t ChannelId, uint16_t Sid, uint16_t SkyNumber )
+{
+  if( F->enabled && ( BITMAP_TEST( F->sky_number, SkyNumber ) || BITMAP_TEST( F->sid, Sid ) ) )
+  {
+    BITMAP_SET( F->channel_id, ChannelId );
+  }
+}
+
+static inline int channel_wanted( uint16_t ChannelId )
+{
+  return !channel_filter.enabled || BITMAP_TEST( channel_filter.channel_id, ChannelId );
+}
+
+static void free_tables( struct tables_s *T )
+{
+  int n;
+  free_huff_tree( &T->H );
+  for( n = 0; n < MAX_THEMES; n++ )
+  {
+    free( T->themes[n] );
+  }
+  free( T );
+}
+
+/* Build a new version of the dictionary and themes.
+ * Returns NULL if the dictionary could not be read.
+ */
+struct tables_s *load_tables( void )
+{
+  struct tables_s *T;
+  T = calloc( 1, sizeof( struct tables_s ) );
+  if( !T )
+  {
+    printf( "failed to allocate memory for tables\n" );
+    return NULL;
+  }
+  if( !read_huff_dict( &T->H, dict_file ) )
+  {
+    free_tables( T );
+    return NULL;
+  }
+  /* Themes are optional, the theme ids are kept either way */
+  read_themes( T->themes, themes_file );
+  T->generation = tables ? tables->generation + 1 : 1;
+  return T;
+}
+
+/* Swap in a freshly loaded version. The old one is retired and freed
+ * once every decode that started on it has finished.
+ */
+int reload_tables( void )
+{
+  struct tables_s *T;
+  uint64_t lost;
+  T = load_tables();
+  if( !T )
+  {
+    printf( "LoadEPG: Reload failed, keeping dictionary generation %d\n", tables ? tables->generation : 0 );
+    return 0;
+  }
+  if( tables && huffman_profile )
+  {
+    /* The profile covers the whole run, not just the last generation */
+    lost = carry_huff_hits( &tables->H, &T->H );
+    if( lost )
+    {
+      printf( "LoadEPG: %" PRIu64 " profile hits are for symbols the new dictionary does not have\n", lost );
+    }
+  }
+  if( tables )
+  {
+    tables->next_retired = tables_retired;
+    tables_retired = tables;
+  }
+  __atomic_store_n( &tables, T, __ATOMIC_RELEASE );
+  printf( "LoadEPG: Loaded dictionary generation %d\n", T->generation );
+  return 1;
+}
+
+/* Called between TS packets, where no decode can be in flight. */
+void tables_quiescent( void )
+{
+  struct tables_s *T;
+  if( reload_requested )
+  {
+    reload_requested = 0;
+    reload_tables();
+  }
+  while( tables_retired )
+  {
+    T = tables_retired;
+    tables_retired = T->next_retired;
+    free_tables( T );
+  }
+}
+
+static void sighup_handler( int sig )
+{
+  reload_requested = 1;
+}
+
+char *theme_name( struct tables_s *T, int theme_id )
+{
+  if( theme_id < 0 || theme_id >= MAX_THEMES || !T->themes[theme_id] )
+  {
+    return "";
+  }
+  return T->themes[theme_id];
+}
+
+struct huffman_symbol_s {
+	char *value;
+	char code[MAX_HUFFMAN_CODE];
+	uint32_t hits;
+};
+
+static int qsort_huffman_symbols_by_hits( const void *A, const void *B )
+{
+	struct huffman_symbol_s *SymbolA = ( struct huffman_symbol_s * ) A;
+	struct huffman_symbol_s *SymbolB = ( struct huffman_symbol_s * ) B;
+	if( SymbolA->hits < SymbolB->hits ) {
+		return 1;
+	}
+	if( SymbolA->hits > SymbolB->hits ) {
+		return -1;
+	}
+	return strcmp( SymbolA->code, SymbolB->code );
+}
+
+static int qsort_huffman_misses_by_count( const void *A, const void *B )
+{
+	struct huffman_miss_s *MissA = *( struct huffman_miss_s ** ) A;
+	struct huffman_miss_s *MissB = *( struct huffman_miss_s ** ) B;
+	if( MissA->count < MissB->count ) {
+		return 1;
+	}
+	if( MissA->count > MissB->count ) {
+		return -1;
+	}
+	return strcmp( MissA->code, MissB->code );
+}
+
+static int collect_huffman_symbols( struct sNode *nH, char *code, int len, struct huffman_symbol_s *symbols, int count )
+{
+	if( nH->Value != NULL ) {
+		symbols[count].value = nH->Value;
+		memcpy( symbols[count].code, code, len );
+		symbols[count].code[len] = 0;
+		symbols[count].hits = nH->Hits;
+		return count + 1;
+	}
+	if( len >= MAX_HUFFMAN_CODE - 1 ) {
+		return count;
+	}
+	if( nH->P0 != NULL ) {
+		code[len] = '0';
+		count = collect_huffman_symbols( nH->P0, code, len + 1, symbols, count );
+	}
+	if( nH->P1 != NULL ) {
+		code[len] = '1';
+		count = collect_huffman_symbols( nH->P1, code, len + 1, symbols, count );
+	}
+	return count;
+}
+
+static int count_huffman_symbols( struct sNode *nH )
+{
+	if( nH->Value != NULL ) {
+		return 1;
+	}
+	return ( nH->P0 ? count_huffman_symbols( nH->P0 ) : 0 ) +
+		( nH->P1 ? count_huffman_symbols( nH->P1 ) : 0 );
+}
+
+static void print_huffman_value( FILE *File, char *Value )
+{
+	unsigned char *c;
+	fputc( '"', File );
+	for( c = ( unsigned char * ) Value; *c; c++ ) {
+		if( *c < 0x20 || *c >= 0x7f || *c == '"' || *c == '\\' ) {
+			fprintf( File, "\\x%02x", *c );
+		} else {
+			fputc( *c, File );
+		}
+	}
+	fputc( '"', File );
+}
+
+/* Write the huffman profile collected during the run.
+ * Unknown prefixes are ranked first, as the most frequent ones are the
+ * codes most likely missing from the dictionary.
+ * The symbol frequencies follow, in decreasing order.
+ */
+int write_huffman_profile( const char *FileName )
+{
+	FILE *File;
+	struct huffman_symbol_s *symbols;
+	struct huffman_miss_s **misses;
+	char code[MAX_HUFFMAN_CODE];
+	uint64_t total;
+	int symbols_count;
+	int misses_count;
+	int n;
+
+	File = fopen( FileName, "w" );
+	if( File == NULL ) {
+		printf( "LoadEPG: Error opening file '%s'. %s\n", FileName, strerror( errno ) );
+		return 0;
+	}
+	symbols = calloc( count_huffman_symbols( &tables->H ) + 1, sizeof( struct huffman_symbol_s ) );
+	misses = calloc( MAX_HUFFMAN_MISSES, sizeof( struct huffman_miss_s * ) );
+	if( !symbols || !misses ) {
+		printf( "failed to allocate memory for huffman profile\n" );
+		free( symbols );
+		free( misses );
+		fclose( File );
+		return 0;
+	}
+	symbols_count = collect_huffman_symbols( &tables->H, code, 0, symbols, 0 );
+	qsort( symbols, symbols_count, sizeof( struct huffman_symbol_s ), &qsort_huffman_symbols_by_hits );
+	total = 0;
+	for( n = 0; n < symbols_count; n++ ) {
+		total += symbols[n].hits;
+	}
+	misses_count = 0;
+	for( n = 0; n < MAX_HUFFMAN_MISSES; n++ ) {
+		if( huffman_stats.misses[n].count ) {
+			misses[misses_count++] = &huffman_stats.misses[n];
+		}
+	}
+	qsort( misses, misses_count, sizeof( struct huffman_miss_s * ), &qsort_huffman_misses_by_count );
+
+	fprintf( File, "# Huffman profile\n" );
+	fprintf( File, "# decodes=%" PRIu64 " bytes=%" PRIu64 " symbols=%" PRIu64 " errors=%" PRIu64 " unknown_prefixes=%d\n",
+		huffman_stats.decodes, huffman_stats.bytes, total, huffman_stats.errors, misses_count );
+	fprintf( File, "\n# Likely missing codes: count, prefix, first failed bits\n" );
+	for( n = 0; n < misses_count; n++ ) {
+		fprintf( File, "MISS %u %s %s\n", misses[n]->count, misses[n]->code, misses[n]->sample );
+	}
+	fprintf( File, "\n# Symbol frequencies: hits, share, code length, code, value\n" );
+	for( n = 0; n < symbols_count; n++ ) {
+		fprintf( File, "SYMBOL %u %.4f%% %d %s ", symbols[n].hits,
+			total ? ( 100.0 * symbols[n].hits ) / total : 0.0,
+			( int ) strlen( symbols[n].code ), symbols[n].code );
+		print_huffman_value( File, symbols[n].value );
+		fputc( '\n', File );
+	}
+	fclose( File );
+	free( symbols );
+	free( misses );
+	printf( "LoadEPG: Huffman profile written to '%s'\n", FileName );
+	return 1;
+}
+
+#if 0
+bool cTaskLoadepg::ReadFileThemes( void )
+{
+  char *FileName;
+  FILE *FileThemes;
+  char *Line;
+  char Buffer[256];
+  asprintf( &FileName, "%s/%s", "conf", "sky_uk.dict" );
+  FileThemes = fopen( FileName, "r" );
+  if( FileThemes == NULL )
+  {
+    esyslog( "LoadEPG: Error opening file '%s'. %s", FileName, strerror( errno ) );
+    free( FileName );
+    return false;
+  }
+  else
+  {
+    int id = 0;
+    char string1[256];
+    char string2[256];
+    while( ( Line = fgets( Buffer, sizeof( Buffer ), FileThemes ) ) != NULL )
+    {
+      memset( string1, 0, sizeof( string1 ) );
+      memset( string2, 0, sizeof( string2 ) );
+      if( ! isempty( Line ) )
+      {
+	sTheme *T = ( lThemes + id );
+        if( sscanf( Line, "%[^=] =%[^\n] ", string1, string2 ) == 2 )
+	{
+	  snprintf( ( char * ) T->Name, 255, "%s", string2 );
+	}
+	else
+	{
+	  T->Name[0] = '\0';
+	}
+	id ++;
+      }
+    }
+    fclose( FileThemes );
+  }
+  free( FileName );
+  return true;
+
+#endif
+
+void clean_string( unsigned char *String )
+{
+  unsigned char *Src;
+  unsigned char *Dst;
+  int Spaces;
+  int pC;
+  Src = String;
+  Dst = String;
+  Spaces = 0;
+  pC = 0;
+  while( *Src )
+  {
+    // corrections
+    if( *Src == 0x8c ) // iso-8859-2 LATIN CAPITAL LETTER S WITH ACUTE
+    {
+      *Src = 0xa6;
+    }
+    if( *Src == 0x8f ) // iso-8859-2 LATIN CAPITAL LETTER Z WITH ACUTE
+    {
+      *Src = 0xac;
+    }
+    
+    if( *Src < 0x20 )
+    {
+      *Src = 0x20;
+    }
+    if( *Src == 0x20 )
+    {
+      Spaces ++;
+      if( pC == 0 )
+      {
+        Spaces ++;
+      }
+    }
+    else
+    {
+      Spaces = 0;
+    }
+    if( Spaces < 2 )
+    {
+      *Dst = *Src;
+      *Dst ++;
+      pC ++;
+    }
+    *Src ++;
+  }
+  if( Spaces > 0 )
+  {
+    Dst --;
+    *Dst = 0;
+  }
+  else
+  {
+    *Dst = 0;
+  }
+}
+
+static int string_pool_grow_index( struct string_pool_s *pool )
+{
+	uint32_t *index;
+	uint32_t size;
+	uint32_t id;
+	uint32_t n;
+
+	size = pool->index_size ? pool->index_size * 2 : 256;
+	index = arena_alloc( &epg_arena, size * sizeof( uint32_t ) );
+	if( !index ) {
+		return 0;
+	}
+	memset( index, 0, size * sizeof( uint32_t ) );
+	for( id = 1; id < pool->count; id++ ) {
+		n = pool->strings[id].hash & ( size - 1 );
+		while( index[n] ) {
+			n = ( n + 1 ) & ( size - 1 );
+		}
+		index[n] = id;
+	}
+	arena_free( &epg_arena, pool->index, pool->index_size * sizeof( uint32_t ) );
+	pool->index = index;
+	pool->index_size = size;
+	return 1;
+}
+
+/* Return the id of the string, adding it to the pool if it is new.
+ * Id 0 is the empty string.
+ */
+uint32_t string_intern( struct string_pool_s *pool, const char *str, int len )
+{
+	struct pool_string_s *S;
+	uint32_t hash;
+	uint32_t n;
+	uint32_t id;
+
+	if( len <= 0 ) {
+		return 0;
+	}
+	pool->requested_count++;
+	pool->requested_bytes += len + 1;
+	/* Keep the index at most half full */
+	if( ( pool->count + 1 ) * 2 > pool->index_size ) {
+		if( !string_pool_grow_index( pool ) ) {
+			return 0;
+		}
+	}
+	hash = hash_fnv1a( str, len );
+	n = hash & ( pool->index_size - 1 );
+	while( ( id = pool->index[n] ) ) {
+		S = &pool->strings[id];
+		if( S->hash == hash && S->len == len && memcmp( S->str, str, len ) == 0 ) {
+			return id;
+		}
+		n = ( n + 1 ) & ( pool->index_size - 1 );
+	}
+	if( pool->count == 0 ) {
+		/* Reserve id 0 for the empty string */
+		pool->count = 1;
+	}
+	if( pool->count >= pool->size ) {
+		struct pool_string_s *strings;
+		uint32_t size = pool->size ? pool->size * 2 : 256;
+		strings = arena_grow( &epg_arena, pool->strings, pool->size * sizeof( struct pool_string_s ), size * sizeof( struct pool_string_s ) );
+		if( !strings ) {
+			return 0;
+		}
+		strings[0].str = "";
+		strings[0].len = 0;
+		strings[0].hash = 0;
+		pool->strings = strings;
+		pool->size = size;
+	}
+	id = pool->count;
+	S = &pool->strings[id];
+	S->str = arena_alloc( &epg_arena, len + 1 );
+	if( !S->str ) {
+		return 0;
+	}
+	memcpy( S->str, str, len );
+	S->str[len] = 0;
+	S->len = len;
+	S->hash = hash;
+	pool->index[n] = id;
+	pool->count++;
+	pool->stored_bytes += len + 1;
+	return id;
+}
+
+char *string_get( struct string_pool_s *pool, uint32_t id )
+{
+	if( id == 0 || id >= pool->count ) {
+		return "";
+	}
+	return pool->strings[id].str;
+}
+
+void print_string_pool_stats( struct string_pool_s *pool )
+{
+	int64_t overhead;
+	int64_t before;
+	int64_t after;
+	/* What the pool costs on top of the string bytes */
+	overhead = ( int64_t ) pool->size * sizeof( struct pool_string_s ) +
+		( int64_t ) pool->index_size * sizeof( uint32_t );
+	/* One malloc and one pointer per event string, against one copy per distinct string and an id */
+	before = pool->requested_bytes + pool->requested_count * sizeof( char * );
+	after = pool->stored_bytes + overhead + pool->requested_count * sizeof( uint32_t );
+	printf( "Strings: %" PRIu64 " interned (%" PRIu64 " bytes), %u unique (%" PRIu64 " bytes), pool overhead %" PRId64 " bytes, saved %" PRId64 " bytes\n",
+		pool->requested_count, pool->requested_bytes,
+		pool->count ? pool->count - 1 : 0, pool->stored_bytes,
+		overhead, before - after );
+}
+
+static int spill_open( struct spill_s *S )
+{
+	const char *dir = getenv( "TMPDIR" );
+	char *name;
+
+	if( !dir || !*dir ) {
+		dir = "/tmp";
+	}
+	name = malloc( strlen( dir ) + sizeof( "/loadepg-spill-XXXXXX" ) );
+	if( !name ) {
+		return 0;
+	}
+	sprintf( name, "%s/loadepg-spill-XXXXXX", dir );
+	S->fd = mkstemp( name );
+	if( S->fd < 0 ) {
+		printf( "Spill: Error creating file '%s'. %s\n", name, strerror( errno ) );
+		free( name );
+		S->fd = -2;
+		return 0;
+	}
+	/* Nobody else needs it and it goes away with us */
+	unlink( name );
+	free( name );
+	S->size = 0;
+	return 1;
+}
+
+static int spill_grow_index( struct spill_s *S )
+{
+	uint64_t *index;
+	uint32_t size;
+	uint32_t n;
+	uint32_t m;
+
+	size = S->index_size ? S->index_size * 2 : 1024;
+	index = calloc( size, sizeof( uint64_t ) );
+	if( !index ) {
+		return 0;
+	}
+	for( n = 0; n < S->index_size; n++ ) {
+		if( S->index[n] ) {
+			m = ( S->index[n] >> 32 ) & ( size - 1 );
+			while( index[m] ) {
+				m = ( m + 1 ) & ( size - 1 );
+			}
+			index[m] = S->index[n];
+		}
+	}
+	free( S->index );
+	S->index = index;
+	S->index_size = size;
+	return 1;
+}
+
+/* Read the record at offset into S->buffer. Returns its length or -1. */
+static int spill_read( struct spill_s *S, uint32_t offset )
+{
+	uint32_t len;
+	if( pread( S->fd, &len, sizeof( len ), offset ) != sizeof( len ) ) {
+		return -1;
+	}
+	if( len + 1 > S->buffer_size ) {
+		char *buffer = realloc( S->buffer, len + 1 );
+		if( !buffer ) {
+			return -1;
+		}
+		S->buffer = buffer;
+		S->buffer_size = len + 1;
+	}
+	if( pread( S->fd, S->buffer, len + 1, offset + sizeof( len ) ) != len + 1 ) {
+		return -1;
+	}
+	S->buffer[len] = 0;
+	return len;
+}
+
+/* Append str unless it is already there. Returns SUMMARY_SPILLED | offset, or 0 on failure. */
+uint32_t spill_append( struct spill_s *S, const char *str, int len )
+{
+	uint32_t hash;
+	uint32_t offset;
+	uint32_t rec;
+	uint32_t n;
+
+	if( S->fd == -2 || ( S->fd < 0 && !spill_open( S ) ) ) {
+		return 0;
+	}
+	if( ( S->index_count + 1 ) * 2 > S->index_size && !spill_grow_index( S ) ) {
+		return 0;
+	}
+	hash = hash_fnv1a( str, len );
+	n = hash & ( S->index_size - 1 );
+	while( S->index[n] ) {
+		if( ( S->index[n] >> 32 ) == hash ) {
+			offset = ( uint32_t ) S->index[n] - 1;
+			if( spill_read( S, offset ) == len && !memcmp( S->buffer, str, len ) ) {
+				return SUMMARY_SPILLED | offset;
+			}
+		}
+		n = ( n + 1 ) & ( S->index_size - 1 );
+	}
+	if( S->size + sizeof( rec ) + len + 1 >= SUMMARY_SPILLED ) {
+		return 0;
+	}
+	offset = S->size;
+	rec = len;
+	if( pwrite( S->fd, &rec, sizeof( rec ), offset ) != sizeof( rec ) ||
+		pwrite( S->fd, str, len, offset + sizeof( rec ) ) != len ||
+		pwrite( S->fd, "", 1, offset + sizeof( rec ) + len ) != 1 ) {
+		printf( "Spill: Error writing. %s\n", strerror( errno ) );
+		return 0;
+	}
+	S->size += sizeof( rec ) + len + 1;
+	S->count++;
+	S->index[n] = ( ( uint64_t ) hash << 32 ) | ( offset + 1 );
+	S->index_count++;
+	return SUMMARY_SPILLED | offset;
+}
+
+void spill_close( struct spill_s *S )
+{
+	if( S->fd >= 0 ) {
+		close( S->fd );
+	}
+	free( S->index );
+	free( S->buffer );
+	memset( S, 0, sizeof( *S ) );
+	S->fd = -1;
+}
+
+/* Keep a summary in the string pool while the budget allows, else spill it.
+ * The last quarter of the budget is left to titles and the tables, which
+ * have nowhere else to go. Returns 0 when it could be stored in neither.
+ */
+uint32_t summary_store( const char *str, int len )
+{
+	uint32_t ref;
+	if( !arena_has_room( &epg_arena, len + 1 + sizeof( struct pool_string_s ) + epg_arena.limit / 4 ) ) {
+		ref = spill_append( &summary_spill, str, len );
+		if( ref ) {
+			return ref;
+		}
+	}
+	return string_intern( &string_pool, str, len );
+}
+
+/* Text of a title or summary id. A spilled text stays valid until the next spilled one is read. */
+const char *event_string( uint32_t id )
+{
+	if( id & SUMMARY_SPILLED ) {
+		if( spill_read( &summary_spill, id & ~SUMMARY_SPILLED ) < 0 ) {
+			return "";
+		}
+		return summary_spill.buffer;
+	}
+	return string_get( &string_pool, id );
+}
+
+static void *event_table_grow_column( void *column, uint32_t old_size, uint32_t new_size, size_t width )
+{
+	return arena_grow( &epg_arena, column, old_size * width, new_size * width );
+}
+
+/* Add a zeroed row. Returns EVENT_NONE when out of memory. */
+uint32_t event_table_add( struct event_table_s *T )
+{
+	uint32_t row;
+	if( T->count >= T->size ) {
+		uint32_t size = T->size ? T->size * 2 : 1024;
+		if( !( T->start = event_table_grow_column( T->start, T->size, size, sizeof( uint32_t ) ) ) ||
+			!( T->duration = event_table_grow_column( T->duration, T->size, size, sizeof( uint32_t ) ) ) ||
+			!( T->channel = event_table_grow_column( T->channel, T->size, size, sizeof( uint16_t ) ) ) ||
+			!( T->event_id = event_table_grow_column( T->event_id, T->size, size, sizeof( uint16_t ) ) ) ||
+			!( T->theme = event_table_grow_column( T->theme, T->size, size, sizeof( uint16_t ) ) ) ||
+			!( T->flags = event_table_grow_column( T->flags, T->size, size, sizeof( uint8_t ) ) ) ||
+			!( T->title_id = event_table_grow_column( T->title_id, T->size, size, sizeof( uint32_t ) ) ) ||
+			!( T->summary_id = event_table_grow_column( T->summary_id, T->size, size, sizeof( uint32_t ) ) ) ||
+			!( T->prev_hash = event_table_grow_column( T->prev_hash, T->size, size, sizeof( uint32_t ) ) ) ||
+			!( T->seq = event_table_grow_column( T->seq, T->size, size, sizeof( uint32_t ) ) ) ) {
+			return EVENT_NONE;
+		}
+		T->size = size;
+	}
+	row = T->count++;
+	T->start[row] = 0;
+	T->duration[row] = 0;
+	T->channel[row] = 0;
+	T->event_id[row] = 0;
+	T->theme[row] = 0;
+	T->flags[row] = 0;
+	T->title_id[row] = 0;
+	T->summary_id[row] = 0;
+	T->prev_hash[row] = 0;
+	T->seq[row] = 0;
+	return row;
+}
+
+static inline void event_table_changed( struct event_table_s *T, uint32_t row )
+{
+	T->seq[row] = ++T->last_seq;
+}
+
+/* Returns 0 and leaves the row alone when start_time is 0, which is no
+ * time at all and would drag the epoch back to 1970.
+ */
+int event_table_set_start( struct event_table_s *T, uint32_t row, uint64_t start_time )
+{
+	uint32_t delta;
+	uint32_t n;
+	if( !start_time ) {
+		return 0;
+	}
+	if( !T->epoch ) {
+		T->epoch = start_time > EVENT_EPOCH_SLACK ? start_time - EVENT_EPOCH_SLACK : 1;
+	}
+	if( start_time < T->epoch ) {
+		/* Rebase. Rare, the epoch already allows for two weeks of history */
+		delta = T->epoch - start_time + EVENT_EPOCH_SLACK;
+		if( delta > T->epoch - 1 ) {
+			delta = T->epoch - 1;
+		}
+		for( n = 0; n < T->count; n++ ) {
+			T->start[n] += delta;
+		}
+		T->epoch -= delta;
+	}
+	T->start[row] = start_time - T->epoch;
+	return 1;
+}
+
+/* Row view adapter for code that wants one record per event */
+void event_row( struct event_table_s *T, uint32_t row, struct event_s *E )
+{
+	E->event_id = T->event_id[row];
+	E->channel_id = lChannels[T->channel[row]].ChannelId;
+	E->start_time_title = ( T->flags[row] & EVENT_FLAG_TITLE ) ? T->epoch + T->start[row] : 0;
+	E->start_time_summary = 0;
+	E->duration_title = T->duration[row];
+	E->theme_id = T->theme[row];
+	E->prefix_len = 0; /* FIXME: JCD TODO */
+	E->title_id = T->title_id[row];
+	E->summary_id = T->summary_id[row];
+}
+
+static void interval_index_hours( struct event_table_s *T, uint32_t row, uint32_t *first, uint32_t *last )
+{
+	uint64_t start = T->epoch + T->start[row];
+	uint32_t duration = T->duration[row] ? T->duration[row] : 1;
+	*first = start / INTERVAL_BUCKET_SECONDS;
+	*last = ( start + duration - 1 ) / INTERVAL_BUCKET_SECONDS;
+}
+
+/* First hour of the window and the one after it */
+static void interval_index_window( struct interval_index_s *I, uint32_t *low, uint32_t *high )
+{
+	if( !I->anchor_hour ) {
+		I->anchor_hour = time( NULL ) / INTERVAL_BUCKET_SECONDS;
+	}
+	*low = I->anchor_hour > INTERVAL_HISTORY_BUCKETS ? I->anchor_hour - INTERVAL_HISTORY_BUCKETS : 0;
+	*high = *low + INTERVAL_WINDOW_BUCKETS;
+}
+
+/* Make buckets first to last exist, moving existing ones up if first is
+ * earlier. Both have to be in the window. Returns 0 when out of memory.
+ */
+static int interval_index_cover( struct interval_index_s *I, uint32_t first, uint32_t last )
+{
+	struct interval_bucket_s *buckets;
+	uint32_t low;
+	uint32_t high;
+	uint32_t base;
+	uint32_t end;
+	uint32_t count;
+
+	if( I->bucket_count && first >= I->base_hour && last < I->base_hour + I->bucket_count ) {
+		return 1;
+	}
+	base = I->bucket_count && I->base_hour < first ? I->base_hour : first;
+	end = I->bucket_count && I->base_hour + I->bucket_count > last + 1 ? I->base_hour + I->bucket_count : last + 1;
+	/* Leave up to a day of room on the side that grew */
+	interval_index_window( I, &low, &high );
+	if( base < I->base_hour || !I->bucket_count ) {
+		base = base - low > 24 ? base - 24 : low;
+	}
+	if( end > I->base_hour + I->bucket_count || !I->bucket_count ) {
+		end = high - end > 24 ? end + 24 : high;
+	}
+	count = end - base;
+	buckets = arena_alloc( &epg_arena, count * sizeof( struct interval_bucket_s ) );
+	if( !buckets ) {
+		return 0;
+	}
+	memset( buckets, 0, count * sizeof( struct interval_bucket_s ) );
+	if( I->bucket_count ) {
+		memcpy( &buckets[I->base_hour - base], I->buckets, I->bucket_count * sizeof( struct interval_bucket_s ) );
+		arena_free( &epg_arena, I->buckets, I->bucket_count * sizeof( struct interval_bucket_s ) );
+	}
+	I->buckets = buckets;
+	I->base_hour = base;
+	I->bucket_count = count;
+	return 1;
+}
+
+/* List the row in every bucket its [start, start + duration) overlaps */
+int interval_index_insert( struct interval_index_s *I, struct event_table_s *T, uint32_t row )
+{
+	struct interval_bucket_s *B;
+	uint32_t first;
+	uint32_t last;
+	uint32_t low;
+	uint32_t high;
+	uint32_t h;
+
+	interval_index_hours( T, row, &first, &last );
+	interval_index_window( I, &low, &high );
+	if( last < low || first >= high ) {
+		I->outside++;
+		dlog( LOG_CAT_TITLES, "Titles: event 0x%x on channel 0x%x at %" PRIu64 " is outside the time index\n",
+			T->event_id[row], lChannels[T->channel[row]].ChannelId, T->epoch + T->start[row] );
+		return 1;
+	}
+	/* Only the part in the window is listed */
+	first = first < low ? low : first;
+	last = last >= high ? high - 1 : last;
+	if( !interval_index_cover( I, first, last ) ) {
+		return 0;
+	}
+	for( h = first; h <= last; h++ ) {
+		B = &I->buckets[h - I->base_hour];
+		if( B->count >= B->size ) {
+			uint32_t size = B->size ? B->size * 2 : 16;
+			uint32_t *rows = arena_grow( &epg_arena, B->rows, B->size * sizeof( uint32_t ), size * sizeof( uint32_t ) );
+			if( !rows ) {
+				return 0;
+			}
+			B->rows = rows;
+			B->size = size;
+		}
+		B->rows[B->count++] = row;
+		I->entries++;
+	}
+	return 1;
+}
+
+/* Call before changing the start or duration of an indexed row */
+void interval_index_remove( struct interval_index_s *I, struct event_table_s *T, uint32_t row )
+{
+	struct interval_bucket_s *B;
+	uint32_t first;
+	uint32_t last;
+	uint32_t h;
+	uint32_t n;
+
+	interval_index_hours( T, row, &first, &last );
+	for( h = first; h <= last; h++ ) {
+		if( h < I->base_hour || h >= I->base_hour + I->bucket_count ) {
+			continue;
+		}
+		B = &I->buckets[h - I->base_hour];
+		for( n = 0; n < B->count; n++ ) {
+			if( B->rows[n] == row ) {
+				B->rows[n] = B->rows[--B->count];
+				I->entries--;
+				break;
+			}
+		}
+	}
+}
+
+/* Rows of every event overlapping [from, to), each reported once.
+ * An event spanning several buckets is only taken from the first bucket
+ * both it and the query cover. Returns how many rows there are, of which
+ * at most max are stored.
+ */
+uint32_t interval_index_range( struct interval_index_s *I, struct event_table_s *T, uint64_t from, uint64_t to, uint32_t *rows, uint32_t max )
+{
+	struct interval_bucket_s *B;
+	uint64_t start;
+	uint64_t first_hour;
+	uint64_t h;
+	uint64_t from_hour;
+	uint64_t to_hour;
+	uint32_t found;
+	uint32_t row;
+	uint32_t n;
+
+	if( from >= to || !I->bucket_count ) {
+		return 0;
+	}
+	from_hour = from / INTERVAL_BUCKET_SECONDS;
+	to_hour = ( to - 1 ) / INTERVAL_BUCKET_SECONDS;
+	if( from_hour < I->base_hour ) {
+		from_hour = I->base_hour;
+	}
+	if( to_hour >= ( uint64_t ) I->base_hour + I->bucket_count ) {
+		to_hour = ( uint64_t ) I->base_hour + I->bucket_count - 1;
+	}
+	found = 0;
+	for( h = from_hour; h <= to_hour; h++ ) {
+		B = &I->buckets[h - I->base_hour];
+		for( n = 0; n < B->count; n++ ) {
+			row = B->rows[n];
+			start = T->epoch + T->start[row];
+			if( start >= to || start + T->duration[row] <= from ) {
+				continue;
+			}
+			first_hour = start / INTERVAL_BUCKET_SECONDS;
+			if( first_hour < from_hour ) {
+				first_hour = from_hour;
+			}
+			if( first_hour != h ) {
+				continue;
+			}
+			if( found < max ) {
+				rows[found] = row;
+			}
+			found++;
+		}
+	}
+	return found;
+}
+
+/* Rows of every event on air at time t */
+uint32_t interval_index_at( struct interval_index_s *I, struct event_table_s *T, uint64_t t, uint32_t *rows, uint32_t max )
+{
+	return interval_index_range( I, T, t, t + 1, rows, max );
+}
+
+/* Sort key of a row in its channel's events[] */
+static inline uint64_t event_order_key( struct event_table_s *T, uint32_t row )
+{
+	return ( T->flags[row] & EVENT_FLAG_TITLE ) ? T->start[row] : UINT64_MAX;
+}
+
+/* First position in C->events whose key is greater than key, or greater or equal when !after */
+static int channel_events_bound( struct channel_s *C, uint64_t key, int after )
+{
+	uint64_t k;
+	int low = 0;
+	int high = C->events_count;
+	int mid;
+
+	while( low < high ) {
+		mid = ( low + high ) / 2;
+		k = event_order_key( &events, C->events[mid] );
+		if( k < key || ( after && k == key ) ) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/* Position of row in C->events. Call before changing its start time. */
+int channel_event_position( struct channel_s *C, uint32_t row )
+{
+	int pos;
+
+	pos = channel_events_bound( C, event_order_key( &events, row ), 0 );
+	while( pos < C->events_count && C->events[pos] != row ) {
+		pos++;
+	}
+	return pos;
+}
+
+/* Move the row at pos to where its current start time belongs.
+ * The carousel sends a channel's titles mostly in time order, so check
+ * the neighbours first and only binary search when they do not fit.
+ */
+void channel_event_reorder( struct channel_s *C, int pos )
+{
+	uint32_t row = C->events[pos];
+	uint64_t key = event_order_key( &events, row );
+	int to;
+
+	if( ( pos == 0 || event_order_key( &events, C->events[pos - 1] ) <= key ) &&
+		( pos + 1 >= C->events_count || key <= event_order_key( &events, C->events[pos + 1] ) ) ) {
+		return;
+	}
+	memmove( &C->events[pos], &C->events[pos + 1], ( C->events_count - pos - 1 ) * sizeof( uint32_t ) );
+	C->events_count--;
+	to = channel_events_bound( C, key, 1 );
+	memmove( &C->events[to + 1], &C->events[to], ( C->events_count - to ) * sizeof( uint32_t ) );
+	C->events[to] = row;
+	C->events_count++;
+}
+
+/* Print what is on every channel at time t and what follows it */
+void print_now_next( uint64_t t )
+{
+	struct event_s E;
+	uint32_t *rows;
+	uint32_t count;
+	uint32_t n;
+	int m;
+	int c;
+
+	rows = malloc( ( events.count + 1 ) * sizeof( uint32_t ) );
+	if( !rows ) {
+		return;
+	}
+	count = interval_index_at( &events_by_time, &events, t, rows, events.count + 1 );
+	for( n = 0; n < count; n++ ) {
+		event_row( &events, rows[n], &E );
+		printf( "NOW 0x%04x %" PRIu64 " %" PRIu64 " %s\n",
+			E.channel_id, E.start_time_title, E.duration_title,
+			string_get( &string_pool, E.title_id ) );
+		/* Next is the earliest event on the same channel starting when this one ends */
+		c = events.channel[rows[n]];
+		m = channel_events_bound( &lChannels[c], ( uint64_t ) events.start[rows[n]] + events.duration[rows[n]], 0 );
+		if( m < lChannels[c].events_count && ( events.flags[lChannels[c].events[m]] & EVENT_FLAG_TITLE ) ) {
+			event_row( &events, lChannels[c].events[m], &E );
+			printf( "NEXT 0x%04x %" PRIu64 " %" PRIu64 " %s\n",
+				E.channel_id, E.start_time_title, E.duration_title,
+				string_get( &string_pool, E.title_id ) );
+		}
+	}
+	free( rows );
+}
+
+/* The channel, NULL if nothing has mentioned it yet */
+struct channel_s *channel_find( uint16_t ChannelId )
+{
+	uint16_t n = id_map_find( &channels_by_id, ChannelId );
+	return n == ID_MAP_NONE ? NULL : &lChannels[n];
+}
+
+/* Find the channel, adding it if it is new. NULL when out of memory. */
+struct channel_s *channel_add( uint16_t ChannelId )
+{
+	struct channel_s *C = channel_find( ChannelId );
+
+	if( C ) {
+		return C;
+	}
+	if( !table_reserve( ( void ** ) &lChannels, &channels_size, nChannels, sizeof( struct channel_s ) ) ||
+		!id_map_add( &channels_by_id, ChannelId, nChannels ) ) {
+		return NULL;
+	}
+	C = &lChannels[nChannels++];
+	C->ChannelId = ChannelId;
+	C->service = -1;
+	C->program = -1;
+	return C;
+}
+
+/* Fill an EventId index of size slots with the rows in C->events */
+static void channel_fill_events_index( struct channel_s *C, uint32_t *index, uint32_t size )
+{
+	uint32_t n;
+	int e;
+
+	memset( index, 0, size * sizeof( uint32_t ) );
+	for( e = 0; e < C->events_count; e++ ) {
+		n = ( events.event_id[C->events[e]] * 40503u ) & ( size - 1 );
+		while( index[n] ) {
+			n = ( n + 1 ) & ( size - 1 );
+		}
+		index[n] = C->events[e] + 1;
+	}
+}
+
+/* Build a new index of size slots and swap it in. Returns 0 and leaves the
+ * old one as it was if the arena refuses it.
+ */
+static int channel_resize_events_index( struct channel_s *C, uint32_t size )
+{
+	uint32_t *index;
+
+	index = arena_alloc( &epg_arena, size * sizeof( uint32_t ) );
+	if( !index ) {
+		return 0;
+	}
+	channel_fill_events_index( C, index, size );
+	arena_free( &epg_arena, C->events_index, C->events_index_size * sizeof( uint32_t ) );
+	C->events_index = index;
+	C->events_index_size = size;
+	return 1;
+}
+
+static int channel_grow_events_index( struct channel_s *C )
+{
+	return channel_resize_events_index( C, C->events_index_size ? C->events_index_size * 2 : 64 );
+}
+
+/* Find the event row of this channel with EventId, adding a zeroed one if it is new.
+ * New rows go at the end of C->events until they get a title.
+ * Returns EVENT_NONE when out of memory.
+ */
+uint32_t channel_event( struct channel_s *C, uint16_t EventId )
+{
+	uint32_t row;
+	uint32_t n;
+	uint32_t e;
+
+	/* Keep the index at most half full */
+	if( ( C->events_count + 1 ) * 2 > C->events_index_size ) {
+		if( !channel_grow_events_index( C ) ) {
+			return EVENT_NONE;
+		}
+	}
+	/* Fibonacci style multiplicative hash, EventIds are mostly sequential */
+	n = ( EventId * 40503u ) & ( C->events_index_size - 1 );
+	while( ( e = C->events_index[n] ) ) {
+		if( events.event_id[e - 1] == EventId ) {
+			return e - 1;
+		}
+		n = ( n + 1 ) & ( C->events_index_size - 1 );
+	}
+	if( C->events_count >= C->events_size ) {
+		uint32_t *rows;
+		int size = C->events_size ? C->events_size * 2 : 32;
+		rows = arena_grow( &epg_arena, C->events, C->events_size * sizeof( uint32_t ), size * sizeof( uint32_t ) );
+		if( !rows ) {
+			return EVENT_NONE;
+		}
+		C->events = rows;
+		C->events_size = size;
+	}
+	row = event_table_add( &events );
+	if( row == EVENT_NONE ) {
+		return EVENT_NONE;
+	}
+	events.event_id[row] = EventId;
+	events.channel[row] = C - lChannels;
+	/* No title yet, so it sorts last */
+	C->events[C->events_count] = row;
+	C->events_count++;
+	C->events_index[n] = row + 1;
+	return row;
+}
+
+#define EPGDB_ALIGN( n ) ( ( ( n ) + 7 ) & ~( uint64_t ) 7 )
+
+/* Identifies what an event says, independent of string ids and the table epoch */
+uint32_t event_content_hash( uint32_t row )
+{
+	uint64_t start = ( events.flags[row] & EVENT_FLAG_TITLE ) ? events.epoch + events.start[row] : 0;
+	uint32_t hash = FNV1A_BASIS;
+	const char *str;
+
+	hash = hash_fnv1a_update( hash, &start, sizeof( start ) );
+	hash = hash_fnv1a_update( hash, &events.duration[row], sizeof( uint32_t ) );
+	hash = hash_fnv1a_update( hash, &events.theme[row], sizeof( uint16_t ) );
+	str = string_get( &string_pool, events.title_id[row] );
+	hash = hash_fnv1a_update( hash, str, strlen( str ) + 1 );
+	str = event_string( events.summary_id[row] );
+	hash = hash_fnv1a_update( hash, str, strlen( str ) + 1 );
+	return hash;
+}
+
+static void delta_write_event( FILE *File, char Type, struct channel_s *C, uint32_t row )
+{
+	struct event_s E;
+	event_row( &events, row, &E );
+	if( Type == 'D' ) {
+		fprintf( File, "D\t%u\t%u\n", C->ChannelId, E.event_id );
+		return;
+	}
+	fprintf( File, "%c\t%u\t%u\t%" PRIu64 "\t%" PRIu64 "\t%u\t%s\t%s\n",
+		Type, C->ChannelId, E.event_id, E.start_time_title, E.duration_title, E.theme_id,
+		string_get( &string_pool, E.title_id ), event_string( E.summary_id ) );
+}
+
+int writer_open( struct writer_s *W, const char *FileName )
+{
+	memset( W, 0, sizeof( *W ) );
+	W->fd = open( FileName, O_CREAT | O_WRONLY | O_TRUNC, 0644 );
+	if( W->fd < 0 ) {
+		printf( "Writer: Error opening file '%s'. %s\n", FileName, strerror( errno ) );
+		return 0;
+	}
+	W->data = malloc( WRITER_BUFFER_SIZE );
+	if( !W->data ) {
+		close( W->fd );
+		W->fd = -1;
+		return 0;
+	}
+	W->size = WRITER_BUFFER_SIZE;
+	return 1;
+}
+
+void writer_flush( struct writer_s *W )
+{
+	size_t done = 0;
+	ssize_t tmp;
+	while( done < W->used && !W->error ) {
+		tmp = write( W->fd, W->data + done, W->used - done );
+		if( tmp < 0 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			printf( "Writer: Error writing. %s\n", strerror( errno ) );
+			W->error = 1;
+			break;
+		}
+		done += tmp;
+	}
+	W->written += done;
+	W->used = 0;
+}
+
+/* Returns 0 if anything failed to be written */
+int writer_close( struct writer_s *W )
+{
+	int result;
+	if( W->fd < 0 ) {
+		return 0;
+	}
+	writer_flush( W );
+	result = !W->error;
+	if( close( W->fd ) < 0 ) {
+		result = 0;
+	}
+	free( W->data );
+	W->data = NULL;
+	W->fd = -1;
+	return result;
+}
+
+static inline void writer_write( struct writer_s *W, const void *data, size_t len )
+{
+	if( W->used + len > W->size ) {
+		writer_flush( W );
+		if( len > W->size ) {
+			/* Bigger than the buffer, a buffer at a time */
+			while( len > 0 && !W->error ) {
+				size_t chunk = len < W->size ? len : W->size;
+				memcpy( W->data, data, chunk );
+				W->used = chunk;
+				writer_flush( W );
+				data = ( const char * ) data + chunk;
+				len -= chunk;
+			}
+			return;
+		}
+	}
+	memcpy( W->data + W->used, data, len );
+	W->used += len;
+}
+
+static inline void writer_puts( struct writer_s *W, const char *str )
+{
+	writer_write( W, str, strlen( str ) );
+}
+
+/* Decimal, zero padded to at least digits */
+void writer_uint( struct writer_s *W, uint64_t v, int digits )
+{
+	char buf[24];
+	int n = sizeof( buf );
+	do {
+		buf[--n] = '0' + v % 10;
+		v /= 10;
+		digits--;
+	} while( v || digits > 0 );
+	writer_write( W, buf + n, sizeof( buf ) - n );
+}
+
+/* Copy str, replacing each byte that has an entry in escape.
+ * Runs of plain bytes are copied in one go.
+ */
+void writer_escaped( struct writer_s *W, const char *str, const char *const *escape )
+{
+	const unsigned char *run = ( const unsigned char * ) str;
+	const unsigned char *p;
+	for( p = run; *p; p++ ) {
+		if( escape[*p] ) {
+			writer_write( W, run, p - run );
+			writer_puts( W, escape[*p] );
+			run = p + 1;
+		}
+	}
+	writer_write( W, run, p - run );
+}
+
+/* XML text and attribute values. Control characters other than tab and newline are not allowed, drop them. */
+static const char *const xml_escape[256] = {
+	[0x01] = "", [0x02] = "", [0x03] = "", [0x04] = "", [0x05] = "", [0x06] = "", [0x07] = "",
+	[0x08] = "", [0x0b] = "", [0x0c] = "", [0x0d] = "", [0x0e] = "", [0x0f] = "",
+	[0x10] = "", [0x11] = "", [0x12] = "", [0x13] = "", [0x14] = "", [0x15] = "", [0x16] = "", [0x17] = "",
+	[0x18] = "", [0x19] = "", [0x1a] = "", [0x1b] = "", [0x1c] = "", [0x1d] = "", [0x1e] = "", [0x1f] = "",
+	['&'] = "&amp;", ['<'] = "&lt;", ['>'] = "&gt;", ['"'] = "&quot;", ['\''] = "&apos;",
+};
+
+/* "YYYYMMDDhhmmss +hhmm" in local time. localtime_r() only runs when the
+ * local hour changes, the offset cannot change within one.
+ */
+static void xmltv_time( struct xmltv_s *X, uint64_t t )
+{
+	struct writer_s *W = &X->out;
+	time_t now;
+	long gmtoff;
+	uint32_t sec;
+
+	if( t < X->base || t - X->base >= X->left ) {
+		X->base = t;
+		now = t;
+		localtime_r( &now, &X->tm );
+		X->left = 3600 - X->tm.tm_min * 60 - X->tm.tm_sec;
+		gmtoff = X->tm.tm_gmtoff;
+		X->offset[0] = gmtoff < 0 ? '-' : '+';
+		if( gmtoff < 0 ) {
+			gmtoff = -gmtoff;
+		}
+		X->offset[1] = '0' + gmtoff / 36000;
+		X->offset[2] = '0' + gmtoff / 3600 % 10;
+		X->offset[3] = '0' + gmtoff / 600 % 6;
+		X->offset[4] = '0' + gmtoff / 60 % 10;
+		X->offset[5] = 0;
+	}
+	/* Seconds into the local hour */
+	sec = X->tm.tm_min * 60 + X->tm.tm_sec + ( t - X->base );
+	writer_uint( W, X->tm.tm_year + 1900, 4 );
+	writer_uint( W, X->tm.tm_mon + 1, 2 );
+	writer_uint( W, X->tm.tm_mday, 2 );
+	writer_uint( W, X->tm.tm_hour, 2 );
+	writer_uint( W, sec / 60, 2 );
+	writer_uint( W, sec % 60, 2 );
+	writer_write( W, " ", 1 );
+	writer_write( W, X->offset, 5 );
+}
+
+/* Program of the tuned transport stream, -1 if the PAT does not list it */
+static int join_program( uint16_t ProgramNumber )
+{
+	uint32_t n;
+
+	if( !join.index_size ) {
+		return -1;
+	}
+	n = ( ProgramNumber * 0x9e3779b1u ) >> 16 & ( join.index_size - 1 );
+	while( join.index[n] ) {
+		if( demux_ts.programs[join.index[n] - 1].program_id == ProgramNumber ) {
+			return join.index[n] - 1;
+		}
+		n = ( n + 1 ) & ( join.index_size - 1 );
+	}
+	return -1;
+}
+
+/* Resolve every BAT channel (Nid, Tid, Sid) to its SDT service and, when it
+ * is on the tuned transport stream, its PAT program, and every program to
+ * its service. One pass over each table, done again only when the BAT, SDT
+ * or PAT changed something. Exporters read the result from the channels.
+ */
+void channel_join( void )
+{
+	struct service_s *S;
+	struct channel_s *C;
+	uint32_t size;
+	uint32_t n;
+	int programs;
+	int p;
+
+	if( !join.stale && join.channels == nChannels ) {
+		return;
+	}
+	programs = demux_ts.number_of_programs;
+	for( size = 16; size < ( uint32_t ) programs * 2; size *= 2 ) {
+	}
+	if( size != join.index_size ) {
+		free( join.index );
+		join.index = malloc( size * sizeof( uint32_t ) );
+		join.index_size = join.index ? size : 0;
+	}
+	if( join.index ) {
+		memset( join.index, 0, join.index_size * sizeof( uint32_t ) );
+	}
+	for( p = 0; p < programs; p++ ) {
+		demux_ts.programs[p].service_count = -1;
+		if( !demux_ts.programs[p].program_id ) {
+			continue; /* The NIT */
+		}
+		if( join.index ) {
+			n = ( demux_ts.programs[p].program_id * 0x9e3779b1u ) >> 16 & ( join.index_size - 1 );
+			while( join.index[n] ) {
+				n = ( n + 1 ) & ( join.index_size - 1 );
+			}
+			join.index[n] = p + 1;
+		}
+		if( demux_ts.original_network_id >= 0 ) {
+			S = service_find( &demux_ts.services, demux_ts.original_network_id, demux_ts.transport_stream_id,
+				demux_ts.programs[p].program_id );
+			if( S ) {
+				demux_ts.programs[p].service_count = S - demux_ts.services.services;
+			}
+		}
+	}
+	for( C = lChannels; C < lChannels + nChannels; C++ ) {
+		S = service_find( &demux_ts.services, C->Nid, C->Tid, C->Sid );
+		C->service = S ? S - demux_ts.services.services : -1;
+		C->program = -1;
+		if( C->Tid == demux_ts.transport_stream_id &&
+			( demux_ts.original_network_id < 0 || C->Nid == demux_ts.original_network_id ) ) {
+			C->program = join_program( C->Sid );
+		}
+	}
+	join.stale = 0;
+	join.channels = nChannels;
+}
+
+/* SDT name of the channel's service, NULL if the SDT has not named it */
+char *channel_service_name( struct channel_s *C )
+{
+	struct service_s *S;
+
+	channel_join();
+	if( C->service < 0 ) {
+		return NULL;
+	}
+	S = &demux_ts.services.services[C->service];
+	if( !S->name_id ) {
+		return NULL;
+	}
+	return string_get( &string_pool, S->name_id );
+}
+
+static void xmltv_channel( struct xmltv_s *X, struct channel_s *C )
+{
+	struct writer_s *W = &X->out;
+	char *name = channel_service_name( C );
+
+	writer_puts( W, "  <channel id=\"" );
+	writer_uint( W, C->ChannelId, 0 );
+	writer_puts( W, ".sky\">\n    <display-name>" );
+	if( name ) {
+		writer_escaped( W, name, xml_escape );
+	} else {
+		writer_uint( W, C->ChannelId, 0 );
+	}
+	writer_puts( W, "</display-name>\n" );
+	if( C->SkyNumber1 ) {
+		writer_puts( W, "    <display-name>" );
+		writer_uint( W, C->SkyNumber1, 0 );
+		writer_puts( W, "</display-name>\n" );
+	}
+	writer_puts( W, "  </channel>\n" );
+	X->channels++;
+}
+
+/* Mark channel n as listed, returns whether it already was */
+static int xmltv_listed( struct xmltv_s *X, int n )
+{
+	while( n >= X->listed_size ) {
+		if( !table_reserve( ( void ** ) &X->listed, &X->listed_size, X->listed_size, 1 ) ) {
+			return 0;
+		}
+	}
+	if( X->listed[n] ) {
+		return 1;
+	}
+	X->listed[n] = 1;
+	return 0;
+}
+
+static void xmltv_header( struct xmltv_s *X )
+{
+	int n;
+	writer_puts( &X->out, "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n"
+		"<!DOCTYPE tv SYSTEM \"xmltv.dtd\">\n"
+		"<tv generator-info-name=\"loadepg\">\n" );
+	/* Channels known so far, normally all of them once the BAT is in */
+	for( n = 0; n < nChannels; n++ ) {
+		if( !xmltv_listed( X, n ) ) {
+			xmltv_channel( X, &lChannels[n] );
+		}
+	}
+	X->header_done = 1;
+}
+
+/* All programmes of a channel, in start time order */
+void xmltv_write_channel( struct xmltv_s *X, struct channel_s *C )
+{
+	struct writer_s *W = &X->out;
+	const char *str;
+	uint32_t row;
+	uint64_t start;
+	int m;
+
+	if( !X->header_done ) {
+		xmltv_header( X );
+	}
+	if( !xmltv_listed( X, C - lChannels ) ) {
+		/* Not in the BAT when the header went out. The DTD wants every
+		 * <channel> before the first <programme>, so it goes without.
+		 */
+		X->unlisted++;
+	}
+	for( m = 0; m < C->events_count; m++ ) {
+		row = C->events[m];
+		if( !( events.flags[row] & EVENT_FLAG_TITLE ) ) {
+			/* Titles come first in events[], nothing after this has a time */
+			break;
+		}
+		start = events.epoch + events.start[row];
+		writer_puts( W, "  <programme start=\"" );
+		xmltv_time( X, start );
+		writer_puts( W, "\" stop=\"" );
+		xmltv_time( X, start + events.duration[row] );
+		writer_puts( W, "\" channel=\"" );
+		writer_uint( W, C->ChannelId, 0 );
+		writer_puts( W, ".sky\">\n    <title>" );
+		writer_escaped( W, string_get( &string_pool, events.title_id[row] ), xml_escape );
+		writer_puts( W, "</title>\n" );
+		str = event_string( events.summary_id[row] );
+		if( *str ) {
+			writer_puts( W, "    <desc>" );
+			writer_escaped( W, str, xml_escape );
+			writer_puts( W, "</desc>\n" );
+		}
+		str = theme_name( tables, events.theme[row] );
+		if( *str ) {
+			writer_puts( W, "    <category>" );
+			writer_escaped( W, str, xml_escape );
+			writer_puts( W, "</category>\n" );
+		}
+		writer_puts( W, "  </programme>\n" );
+		X->programmes++;
+	}
+}
+
+int xmltv_open( struct xmltv_s *X, const char *FileName )
+{
+	if( !writer_open( &X->out, FileName ) ) {
+		return 0;
+	}
+	X->base = 0;
+	X->left = 0;
+	return 1;
+}
+
+int xmltv_close( struct xmltv_s *X )
+{
+	if( X->out.fd < 0 ) {
+		return 0;
+	}
+	if( !X->header_done ) {
+		xmltv_header( X );
+	}
+	writer_puts( &X->out, "</tv>\n" );
+	printf( "XMLTV: %u channels, %u programmes, %" PRIu64 " bytes\n",
+		X->channels, X->programmes, X->out.written + X->out.used );
+	if( X->unlisted ) {
+		printf( "XMLTV: %u channels found after the header have no <channel> element\n", X->unlisted );
+	}
+	free( X->listed );
+	X->listed = NULL;
+	X->listed_size = 0;
+	return writer_close( &X->out );
+}
+
+static void writer_hex( struct writer_s *W, uint32_t v )
+{
+	static const char digits[] = "0123456789ABCDEF";
+	char buf[8];
+	int n = sizeof( buf );
+	do {
+		buf[--n] = digits[v & 15];
+		v >>= 4;
+	} while( v );
+	writer_write( W, buf + n, sizeof( buf ) - n );
+}
+
+/* Lines are "<OriginalChannelId> <OtherChannelId> <ChannelName>" */
+int read_equiv( const char *FileName )
+{
+  FILE *File;
+  char *Line;
+  char Buffer[256];
+  struct equiv_s *E;
+  File = fopen( FileName, "r" );
+  if( File == NULL )
+  {
+    printf( "LoadEPG: Error opening file '%s'. %s\n", FileName, strerror( errno ) );
+    return 0;
+  }
+  if( !lEquiv )
+  {
+    lEquiv = calloc( MAX_EQUIV, sizeof( struct equiv_s ) );
+  }
+  nEquiv = 0;
+  while( lEquiv && ( Line = fgets( Buffer, sizeof( Buffer ), File ) ) != NULL && nEquiv < MAX_EQUIV )
+  {
+    if( isempty( Line ) || Line[0] == '#' )
+    {
+      continue;
+    }
+    E = &lEquiv[nEquiv];
+    if( sscanf( Line, "%63s %63s", E->original, E->other ) == 2 )
+    {
+      nEquiv ++;
+    }
+  }
+  fclose( File );
+  return 1;
+}
+
+/* VDR channel id, Source-Nid-Tid-Sid */
+static int vdr_channel_id( struct channel_s *C, char *Buffer, int Size )
+{
+	return snprintf( Buffer, Size, "%s-%u-%u-%u", vdr_source, C->Nid, C->Tid, C->Sid );
+}
+
+/* epg.data is line based, VDR turns '|' back into a newline when it reads a text */
+static const char *const vdr_escape[256] = {
+	['\n'] = "|", ['\r'] = "",
+};
+
+/* One C ... c block in epg.data format */
+static void vdr_write_channel_block( struct writer_s *W, struct channel_s *C, const char *ChannelIdString )
+{
+	const char *str;
+	char *name;
+	uint32_t row;
+	int m;
+
+	writer_puts( W, "C " );
+	writer_puts( W, ChannelIdString );
+	name = channel_service_name( C );
+	if( name ) {
+		writer_write( W, " ", 1 );
+		writer_escaped( W, name, vdr_escape );
+	}
+	writer_write( W, "\n", 1 );
+	for( m = 0; m < C->events_count; m++ ) {
+		row = C->events[m];
+		if( !( events.flags[row] & EVENT_FLAG_TITLE ) ) {
+			break;
+		}
+		/* Table id 0 marks external data, which VDR does not let EIT overwrite */
+		writer_puts( W, "E " );
+		writer_uint( W, events.event_id[row], 0 );
+		writer_write( W, " ", 1 );
+		writer_uint( W, events.epoch + events.start[row], 0 );
+		writer_write( W, " ", 1 );
+		writer_uint( W, events.duration[row], 0 );
+		writer_puts( W, " 0 " );
+		writer_hex( W, 0xff );
+		writer_puts( W, "\nT " );
+		writer_escaped( W, string_get( &string_pool, events.title_id[row] ), vdr_escape );
+		writer_write( W, "\n", 1 );
+		str = event_string( events.summary_id[row] );
+		if( *str ) {
+			writer_puts( W, "D " );
+			writer_escaped( W, str, vdr_escape );
+			writer_write( W, "\n", 1 );
+		}
+		writer_puts( W, "e\n" );
+	}
+	writer_puts( W, "c\n" );
+}
+
+/* The channel's events under its own id and every equivalent one */
+void vdr_write_channel( struct writer_s *W, struct channel_s *C )
+{
+	char ChannelIdString[64];
+	int n;
+
+	if( !C->Sid || !C->events_count ) {
+		/* Not in the BAT, VDR could not place it */
+		return;
+	}
+	vdr_channel_id( C, ChannelIdString, sizeof( ChannelIdString ) );
+	vdr_write_channel_block( W, C, ChannelIdString );
+	for( n = 0; n < nEquiv; n++ ) {
+		if( !strcmp( lEquiv[n].original, ChannelIdString ) ) {
+			vdr_write_channel_block( W, C, lEquiv[n].other );
+		}
+	}
+}
+
+
+/* Read one SVDRP reply, skipping continuation lines. Returns its code or -1. */
+static int svdrp_reply( int fd )
+{
+	char line[512];
+	int len = 0;
+	char c;
+
+	for( ;; ) {
+		if( read( fd, &c, 1 ) != 1 ) {
+			return -1;
+		}
+		if( c != '\n' ) {
+			if( len < ( int ) sizeof( line ) - 1 ) {
+				line[len++] = c;
+			}
+			continue;
+		}
+		line[len] = 0;
+		if( len >= 4 && line[3] == '-' ) {
+			len = 0;
+			continue;
+		}
+		printf( "SVDRP: %s\n", line );
+		return atoi( line );
+	}
+}
+
+static int svdrp_command( int fd, const char *Command, int Expect )
+{
+	if( write( fd, Command, strlen( Command ) ) != ( ssize_t ) strlen( Command ) ) {
+		return 0;
+	}
+	return svdrp_reply( fd ) == Expect;
+}
+
+/* Send everything to a local VDR with PUTE, a block of channels at a time */
+int vdr_svdrp_push( int Port )
+{
+	struct sockaddr_in addr;
+	struct writer_s W;
+	int fd;
+	int n;
+	int result = 0;
+
+	fd = socket( AF_INET, SOCK_STREAM, 0 );
+	if( fd < 0 ) {
+		return 0;
+	}
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( Port );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if( connect( fd, ( struct sockaddr * ) &addr, sizeof( addr ) ) < 0 ) {
+		printf( "SVDRP: Error connecting to port %d. %s\n", Port, strerror( errno ) );
+		close( fd );
+		return 0;
+	}
+	if( svdrp_reply( fd ) != 220 ) {
+		close( fd );
+		return 0;
+	}
+	memset( &W, 0, sizeof( W ) );
+	W.fd = fd;
+	W.size = VDR_PUTE_BLOCK + 64 * 1024;
+	W.data = malloc( W.size );
+	if( !W.data ) {
+		close( fd );
+		return 0;
+	}
+	for( n = 0; n < nChannels; ) {
+		if( !svdrp_command( fd, "PUTE\r\n", 354 ) ) {
+			goto out;
+		}
+		/* Whole channels until the block is full, flushing as the buffer fills */
+		do {
+			vdr_write_channel( &W, &lChannels[n++] );
+		} while( n < nChannels && W.written + W.used < VDR_PUTE_BLOCK );
+		writer_puts( &W, ".\n" );
+		writer_flush( &W );
+		W.written = 0;
+		if( W.error || svdrp_reply( fd ) != 250 ) {
+			goto out;
+		}
+	}
+	result = 1;
+out:
+	svdrp_command( fd, "QUIT\r\n", 221 );
+	free( W.data );
+	close( fd );
+	return result;
+}
+
+/* JSON strings. The decoded text is Latin-1, bytes from 0x80 become
+ * two byte UTF-8 sequences. Built on first use.
+ */
+static char json_escape_storage[256][8];
+static const char *json_escape[256];
+
+static void json_build_escape( void )
+{
+	static const char hex[] = "0123456789abcdef";
+	int c;
+	for( c = 1; c < 256; c++ ) {
+		char *e = json_escape_storage[c];
+		if( c < 0x20 ) {
+			sprintf( e, "\\u00%c%c", hex[c >> 4], hex[c & 15] );
+		} else if( c == '"' || c == '\\' ) {
+			e[0] = '\\';
+			e[1] = c;
+		} else if( c >= 0x80 ) {
+			e[0] = 0xc0 | ( c >> 6 );
+			e[1] = 0x80 | ( c & 0x3f );
+		} else {
+			continue;
+		}
+		json_escape[c] = e;
+	}
+	json_escape_storage['\n'][1] = 'n';
+	json_escape_storage['\n'][2] = 0;
+	json_escape_storage['\t'][1] = 't';
+	json_escape_storage['\t'][2] = 0;
+}
+
+static void json_string( struct writer_s *W, const char *str )
+{
+	writer_write( W, "\"", 1 );
+	writer_escaped( W, str, json_escape );
+	writer_write( W, "\"", 1 );
+}
+
+struct writer_s jsonl_out = { -1 };
+
+static int jsonl_open( const char *FileName )
+{
+	if( !json_escape['"'] ) {
+		json_build_escape();
+	}
+	return writer_open( &jsonl_out, FileName );
+}
+
+/* One object per event and line */
+static void jsonl_channel( struct channel_s *C )
+{
+	struct writer_s *W = &jsonl_out;
+	char *name = channel_service_name( C );
+	uint32_t row;
+	int m;
+
+	for( m = 0; m < C->events_count; m++ ) {
+		row = C->events[m];
+		if( !( events.flags[row] & EVENT_FLAG_TITLE ) ) {
+			break;
+		}
+		writer_puts( W, "{\"channel_id\":" );
+		writer_uint( W, C->ChannelId, 0 );
+		writer_puts( W, ",\"sid\":" );
+		writer_uint( W, C->Sid, 0 );
+		writer_puts( W, ",\"sky_number\":" );
+		writer_uint( W, C->SkyNumber1, 0 );
+		writer_puts( W, ",\"channel\":" );
+		json_string( W, name ? name : "" );
+		writer_puts( W, ",\"event_id\":" );
+		writer_uint( W, events.event_id[row], 0 );
+		writer_puts( W, ",\"start\":" );
+		writer_uint( W, events.epoch + events.start[row], 0 );
+		writer_puts( W, ",\"duration\":" );
+		writer_uint( W, events.duration[row], 0 );
+		writer_puts( W, ",\"theme\":" );
+		json_string( W, theme_name( tables, events.theme[row] ) );
+		writer_puts( W, ",\"title\":" );
+		json_string( W, string_get( &string_pool, events.title_id[row] ) );
+		writer_puts( W, ",\"summary\":" );
+		json_string( W, event_string( events.summary_id[row] ) );
+		writer_puts( W, "}\n" );
+	}
+}
+
+static int jsonl_close( void )
+{
+	printf( "JSONL: %" PRIu64 " bytes\n", jsonl_out.written + jsonl_out.used );
+	return writer_close( &jsonl_out );
+}
+
+/* Columnar file, in native byte order:
+ *   "EPGC" version
+ *   row groups, each: rows, column count, then per column
+ *     type, name length, name, data length, data
+ *   footer: row group count, offset of each row group, footer length, "EPGC"
+ * String columns hold rows + 1 uint32_t offsets followed by the bytes.
+ * A row group is written once it reaches COLUMNAR_GROUP_ROWS events.
+ */
+#define COLUMNAR_MAGIC "EPGC"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_GROUP_ROWS 65536
+#define COLUMNAR_U16 1
+#define COLUMNAR_U32 2
+#define COLUMNAR_U64 3
+#define COLUMNAR_STRING 4
+#define COLUMNAR_COLUMNS 7
+
+struct columnar_s {
+	struct writer_s out;
+	uint32_t rows;
+	uint16_t *channel_id;
+	uint16_t *event_id;
+	uint64_t *start;
+	uint32_t *duration;
+	uint16_t *theme;
+	uint32_t *title_id;
+	uint32_t *summary_id;
+	uint64_t *groups; /* File offset of each row group */
+	uint32_t group_count;
+	uint32_t group_size;
+	uint64_t total_rows;
+};
+struct columnar_s columnar = { { -1 } };
+
+static void columnar_free( struct columnar_s *X )
+{
+	free( X->channel_id );
+	free( X->event_id );
+	free( X->start );
+	free( X->duration );
+	free( X->theme );
+	free( X->title_id );
+	free( X->summary_id );
+	free( X->groups );
+	X->channel_id = X->event_id = X->theme = NULL;
+	X->start = NULL;
+	X->duration = X->title_id = X->summary_id = NULL;
+	X->groups = NULL;
+}
+
+static int columnar_open( const char *FileName )
+{
+	struct columnar_s *X = &columnar;
+	uint32_t version = COLUMNAR_VERSION;
+	if( !writer_open( &X->out, FileName ) ) {
+		return 0;
+	}
+	X->channel_id = malloc( COLUMNAR_GROUP_ROWS * sizeof( uint16_t ) );
+	X->event_id = malloc( COLUMNAR_GROUP_ROWS * sizeof( uint16_t ) );
+	X->start = malloc( COLUMNAR_GROUP_ROWS * sizeof( uint64_t ) );
+	X->duration = malloc( COLUMNAR_GROUP_ROWS * sizeof( uint32_t ) );
+	X->theme = malloc( COLUMNAR_GROUP_ROWS * sizeof( uint16_t ) );
+	X->title_id = malloc( COLUMNAR_GROUP_ROWS * sizeof( uint32_t ) );
+	X->summary_id = malloc( COLUMNAR_GROUP_ROWS * sizeof( uint32_t ) );
+	if( !X->channel_id || !X->event_id || !X->start || !X->duration ||
+		!X->theme || !X->title_id || !X->summary_id ) {
+		printf( "Columnar: out of memory\n" );
+		writer_close( &X->out );
+		columnar_free( X );
+		return 0;
+	}
+	writer_write( &X->out, COLUMNAR_MAGIC, 4 );
+	writer_write( &X->out, &version, sizeof( version ) );
+	return 1;
+}
+
+static void columnar_column( struct writer_s *W, uint8_t type, const char *name, const void *data, uint32_t len )
+{
+	uint8_t name_len = strlen( name );
+	writer_write( W, &type, 1 );
+	writer_write( W, &name_len, 1 );
+	writer_write( W, name, name_len );
+	writer_write( W, &len, sizeof( len ) );
+	writer_write( W, data, len );
+}
+
+/* Offsets then bytes, the text is fetched twice rather than buffered */
+static void columnar_string_column( struct columnar_s *X, const char *name, const uint32_t *ids )
+{
+	struct writer_s *W = &X->out;
+	uint8_t type = COLUMNAR_STRING;
+	uint8_t name_len = strlen( name );
+	uint32_t offset = 0;
+	uint32_t len;
+	uint32_t n;
+
+	for( n = 0; n < X->rows; n++ ) {
+		offset += strlen( event_string( ids[n] ) );
+	}
+	len = ( X->rows + 1 ) * sizeof( uint32_t ) + offset;
+	writer_write( W, &type, 1 );
+	writer_write( W, &name_len, 1 );
+	writer_write( W, name, name_len );
+	writer_write( W, &len, sizeof( len ) );
+	offset = 0;
+	writer_write( W, &offset, sizeof( offset ) );
+	for( n = 0; n < X->rows; n++ ) {
+		offset += strlen( event_string( ids[n] ) );
+		writer_write( W, &offset, sizeof( offset ) );
+	}
+	for( n = 0; n < X->rows; n++ ) {
+		writer_puts( W, event_string( ids[n] ) );
+	}
+}
+
+static void columnar_flush_group( struct columnar_s *X )
+{
+	struct writer_s *W = &X->out;
+	uint32_t columns = COLUMNAR_COLUMNS;
+
+	if( !X->rows ) {
+		return;
+	}
+	if( X->group_count >= X->group_size ) {
+		uint32_t size = X->group_size ? X->group_size * 2 : 16;
+		uint64_t *groups = realloc( X->groups, size * sizeof( uint64_t ) );
+		if( !groups ) {
+			W->error = 1;
+			return;
+		}
+		X->groups = groups;
+		X->group_size = size;
+	}
+	X->groups[X->group_count++] = W->written + W->used;
+	writer_write( W, &X->rows, sizeof( X->rows ) );
+	writer_write( W, &columns, sizeof( columns ) );
+	columnar_column( W, COLUMNAR_U16, "channel_id", X->channel_id, X->rows * sizeof( uint16_t ) );
+	columnar_column( W, COLUMNAR_U16, "event_id", X->event_id, X->rows * sizeof( uint16_t ) );
+	columnar_column( W, COLUMNAR_U64, "start", X->start, X->rows * sizeof( uint64_t ) );
+	columnar_column( W, COLUMNAR_U32, "duration", X->duration, X->rows * sizeof( uint32_t ) );
+	columnar_column( W, COLUMNAR_U16, "theme", X->theme, X->rows * sizeof( uint16_t ) );
+	columnar_string_column( X, "title", X->title_id );
+	columnar_string_column( X, "summary", X->summary_id );
+	X->total_rows += X->rows;
+	X->rows = 0;
+}
+
+/* Gather the channel's rows from the event table columns */
+static void columnar_channel( struct channel_s *C )
+{
+	struct columnar_s *X = &columnar;
+	uint32_t row;
+	int m;
+
+	for( m = 0; m < C->events_count; m++ ) {
+		row = C->events[m];
+		if( !( events.flags[row] & EVENT_FLAG_TITLE ) ) {
+			break;
+		}
+		X->channel_id[X->rows] = C->ChannelId;
+		X->event_id[X->rows] = events.event_id[row];
+		X->start[X->rows] = events.epoch + events.start[row];
+		X->duration[X->rows] = events.duration[row];
+		X->theme[X->rows] = events.theme[row];
+		X->title_id[X->rows] = events.title_id[row];
+		X->summary_id[X->rows] = events.summary_id[row];
+		if( ++X->rows == COLUMNAR_GROUP_ROWS ) {
+			columnar_flush_group( X );
+		}
+	}
+}
+
+static int columnar_close( void )
+{
+	struct columnar_s *X = &columnar;
+	uint32_t footer_len;
+	int result;
+
+	columnar_flush_group( X );
+	footer_len = sizeof( uint32_t ) + X->group_count * sizeof( uint64_t );
+	writer_write( &X->out, &X->group_count, sizeof( X->group_count ) );
+	writer_write( &X->out, X->groups, X->group_count * sizeof( uint64_t ) );
+	writer_write( &X->out, &footer_len, sizeof( footer_len ) );
+	writer_write( &X->out, COLUMNAR_MAGIC, 4 );
+	printf( "Columnar: %" PRIu64 " rows in %u row groups, %" PRIu64 " bytes\n",
+		X->total_rows, X->group_count, X->out.written + X->out.used );
+	result = writer_close( &X->out );
+	columnar_free( X );
+	return result;
+}
+
+static int xmltv_export_open( const char *FileName )
+{
+	return xmltv_open( &xmltv, FileName );
+}
+
+static void xmltv_export_channel( struct channel_s *C )
+{
+	xmltv_write_channel( &xmltv, C );
+}
+
+static int xmltv_export_close( void )
+{
+	return xmltv_close( &xmltv );
+}
+
+struct writer_s vdr_out = { -1 };
+
+static int vdr_export_open( const char *FileName )
+{
+	return writer_open( &vdr_out, FileName );
+}
+
+static void vdr_export_channel( struct channel_s *C )
+{
+	vdr_write_channel( &vdr_out, C );
+}
+
+static int vdr_export_close( void )
+{
+	printf( "VDR: %" PRIu64 " bytes\n", vdr_out.written + vdr_out.used );
+	return writer_close( &vdr_out );
+}
+
+#ifdef HAVE_SQLITE
+#ifndef SQLITE_BATCH_ROWS
+#define SQLITE_BATCH_ROWS 50000 /* Events per transaction, -D to compare others */
+#endif
+
+/* Events are keyed by (channel_id, event_id). The start index is only
+ * built after the first bulk load, and an existing row is only rewritten
+ * when its content hash differs.
+ */
+struct sqlite_s {
+	sqlite3 *db;
+	sqlite3_stmt *channel;
+	sqlite3_stmt *event;
+	sqlite3_stmt *remove;
+	int create_index; /* The events table was empty, index after loading */
+	uint32_t pending; /* Rows in the open transaction */
+	uint64_t events;
+	uint64_t changed;
+	uint64_t deleted;
+	double seconds; /* Spent inside SQLite, decoding excluded */
+};
+struct sqlite_s sqlite_out;
+
+static double sqlite_clock( void )
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int sqlite_exec( const char *Sql )
+{
+	char *error = NULL;
+	if( sqlite3_exec( sqlite_out.db, Sql, NULL, NULL, &error ) != SQLITE_OK ) {
+		printf( "SQLite: %s: %s\n", Sql, error );
+		sqlite3_free( error );
+		return 0;
+	}
+	return 1;
+}
+
+static int sqlite_export_open( const char *FileName )
+{
+	struct sqlite_s *Q = &sqlite_out;
+	double started = sqlite_clock();
+	sqlite3_stmt *stmt;
+	int result;
+
+	memset( Q, 0, sizeof( *Q ) );
+	if( sqlite3_open( FileName, &Q->db ) != SQLITE_OK ) {
+		printf( "SQLite: Error opening '%s'. %s\n", FileName, sqlite3_errmsg( Q->db ) );
+		sqlite3_close( Q->db );
+		return 0;
+	}
+	if( !sqlite_exec( "PRAGMA journal_mode=WAL" ) ||
+		!sqlite_exec( "PRAGMA synchronous=NORMAL" ) ||
+		!sqlite_exec( "CREATE TABLE IF NOT EXISTS channels ("
+			"channel_id INTEGER PRIMARY KEY, nid INTEGER, tid INTEGER, sid INTEGER, "
+			"sky_number INTEGER, name TEXT)" ) ||
+		!sqlite_exec( "CREATE TABLE IF NOT EXISTS themes (theme_id INTEGER PRIMARY KEY, name TEXT)" ) ||
+		!sqlite_exec( "CREATE TABLE IF NOT EXISTS events ("
+			"channel_id INTEGER NOT NULL, event_id INTEGER NOT NULL, start INTEGER, duration INTEGER, "
+			"theme_id INTEGER, title TEXT, summary TEXT, hash INTEGER, "
+			"PRIMARY KEY (channel_id, event_id)) WITHOUT ROWID" ) ) {
+		sqlite3_close( Q->db );
+		return 0;
+	}
+	if( sqlite3_prepare_v2( Q->db, "SELECT 1 FROM events LIMIT 1", -1, &stmt, NULL ) == SQLITE_OK ) {
+		Q->create_index = sqlite3_step( stmt ) != SQLITE_ROW;
+		sqlite3_finalize( stmt );
+	}
+	if( sqlite3_prepare_v2( Q->db, "INSERT INTO channels VALUES (?, ?, ?, ?, ?, ?) "
+			"ON CONFLICT (channel_id) DO UPDATE SET nid = excluded.nid, tid = excluded.tid, "
+			"sid = excluded.sid, sky_number = excluded.sky_number, name = excluded.name",
+			-1, &Q->channel, NULL ) != SQLITE_OK ||
+		sqlite3_prepare_v2( Q->db, "INSERT INTO events VALUES (?, ?, ?, ?, ?, ?, ?, ?) "
+			"ON CONFLICT (channel_id, event_id) DO UPDATE SET start = excluded.start, "
+			"duration = excluded.duration, theme_id = excluded.theme_id, title = excluded.title, "
+			"summary = excluded.summary, hash = excluded.hash WHERE hash != excluded.hash",
+			-1, &Q->event, NULL ) != SQLITE_OK ||
+		sqlite3_prepare_v2( Q->db, "DELETE FROM events WHERE channel_id = ? AND event_id = ?",
+			-1, &Q->remove, NULL ) != SQLITE_OK ) {
+		printf( "SQLite: %s\n", sqlite3_errmsg( Q->db ) );
+		sqlite3_finalize( Q->channel );
+		sqlite3_finalize( Q->event );
+		sqlite3_close( Q->db );
+		return 0;
+	}
+	result = sqlite_exec( "BEGIN" );
+	Q->seconds += sqlite_clock() - started;
+	return result;
+}
+
+/* Count a row against the open transaction, starting a new one when it is full */
+static void sqlite_batch( struct sqlite_s *Q )
+{
+	if( ++Q->pending >= SQLITE_BATCH_ROWS ) {
+		sqlite_exec( "COMMIT" );
+		sqlite_exec( "BEGIN" );
+		Q->pending = 0;
+	}
+}
+
+static void sqlite_export_channel( struct channel_s *C )
+{
+	struct sqlite_s *Q = &sqlite_out;
+	char *name = channel_service_name( C );
+	double started = sqlite_clock();
+	const char *str;
+	uint32_t row;
+	int m;
+
+	sqlite3_bind_int( Q->channel, 1, C->ChannelId );
+	sqlite3_bind_int( Q->channel, 2, C->Nid );
+	sqlite3_bind_int( Q->channel, 3, C->Tid );
+	sqlite3_bind_int( Q->channel, 4, C->Sid );
+	sqlite3_bind_int( Q->channel, 5, C->SkyNumber1 );
+	if( name ) {
+		sqlite3_bind_text( Q->channel, 6, name, -1, SQLITE_STATIC );
+	} else {
+		sqlite3_bind_null( Q->channel, 6 );
+	}
+	if( sqlite3_step( Q->channel ) != SQLITE_DONE ) {
+		printf( "SQLite: %s\n", sqlite3_errmsg( Q->db ) );
+	}
+	sqlite3_reset( Q->channel );
+	for( m = 0; m < C->events_count; m++ ) {
+		row = C->events[m];
+		if( !( events.flags[row] & EVENT_FLAG_TITLE ) ) {
+			break;
+		}
+		sqlite3_bind_int( Q->event, 1, C->ChannelId );
+		sqlite3_bind_int( Q->event, 2, events.event_id[row] );
+		sqlite3_bind_int64( Q->event, 3, events.epoch + events.start[row] );
+		sqlite3_bind_int( Q->event, 4, events.duration[row] );
+		sqlite3_bind_int( Q->event, 5, events.theme[row] );
+		sqlite3_bind_text( Q->event, 6, string_get( &string_pool, events.title_id[row] ), -1, SQLITE_STATIC );
+		/* A spilled summary only lives until the next read, let SQLite copy it */
+		str = event_string( events.summary_id[row] );
+		sqlite3_bind_text( Q->event, 7, str, -1, SQLITE_TRANSIENT );
+		sqlite3_bind_int64( Q->event, 8, event_content_hash( row ) );
+		if( sqlite3_step( Q->event ) != SQLITE_DONE ) {
+			printf( "SQLite: %s\n", sqlite3_errmsg( Q->db ) );
+		}
+		Q->changed += sqlite3_changes( Q->db );
+		sqlite3_reset( Q->event );
+		Q->events++;
+		sqlite_batch( Q );
+	}
+	Q->seconds += sqlite_clock() - started;
+}
+
+/* An event the delta reports as deleted ('D') */
+static void sqlite_export_deleted( struct channel_s *C, uint32_t row )
+{
+	struct sqlite_s *Q = &sqlite_out;
+	double started = sqlite_clock();
+
+	sqlite3_bind_int( Q->remove, 1, C->ChannelId );
+	sqlite3_bind_int( Q->remove, 2, events.event_id[row] );
+	if( sqlite3_step( Q->remove ) != SQLITE_DONE ) {
+		printf( "SQLite: %s\n", sqlite3_errmsg( Q->db ) );
+	}
+	Q->deleted += sqlite3_changes( Q->db );
+	sqlite3_reset( Q->remove );
+	sqlite_batch( Q );
+	Q->seconds += sqlite_clock() - started;
+}
+
+static int sqlite_export_close( void )
+{
+	struct sqlite_s *Q = &sqlite_out;
+	double started = sqlite_clock();
+	sqlite3_stmt *stmt;
+	int result = 1;
+	int n;
+
+	if( sqlite3_prepare_v2( Q->db, "INSERT OR REPLACE INTO themes VALUES (?, ?)", -1, &stmt, NULL ) == SQLITE_OK ) {
+		for( n = 0; n < MAX_THEMES; n++ ) {
+			if( tables->themes[n] ) {
+				sqlite3_bind_int( stmt, 1, n );
+				sqlite3_bind_text( stmt, 2, tables->themes[n], -1, SQLITE_STATIC );
+				sqlite3_step( stmt );
+				sqlite3_reset( stmt );
+			}
+		}
+		sqlite3_finalize( stmt );
+	}
+	result &= sqlite_exec( "COMMIT" );
+	if( Q->create_index ) {
+		result &= sqlite_exec( "CREATE INDEX IF NOT EXISTS events_start ON events (start)" );
+	}
+	sqlite3_finalize( Q->channel );
+	sqlite3_finalize( Q->event );
+	sqlite3_finalize( Q->remove );
+	if( sqlite3_close( Q->db ) != SQLITE_OK ) {
+		result = 0;
+	}
+	Q->seconds += sqlite_clock() - started;
+	printf( "SQLite: %" PRIu64 " events, %" PRIu64 " written, %" PRIu64 " deleted, %.3f s, %.0f events/s\n",
+		Q->events, Q->changed, Q->deleted, Q->seconds, Q->seconds > 0 ? Q->events / Q->seconds : 0.0 );
+	return result;
+}
+#endif
+
+/* DVB EIT schedule for re-broadcast, see ETSI EN 300 468. Each channel
+ * becomes a service with up to 16 schedule tables (0x50 - 0x5f) of four
+ * days each, counted from midnight UTC today. A table has 32 segments of
+ * three hours and a segment up to 8 sections. The sections go back to back
+ * into TS packets on PID 0x12, a section may start in the packet where the
+ * previous one ended.
+ */
+#define EIT_PID 0x12
+#define EIT_TABLE_SCHEDULE 0x50
+#define EIT_TABLES 16
+#define EIT_SEGMENT_SECONDS ( 3 * 3600 )
+#define EIT_TABLE_SECONDS ( 4 * 86400 )
+#define EIT_SECTIONS 256
+#define EIT_MAX_SECTION 4096
+#define EIT_HEADER 14
+#define EIT_MAX_EVENTS ( EIT_MAX_SECTION - EIT_HEADER - 4 ) /* Event loop of one section */
+#define EIT_EXTENDED_TEXT 249
+#define EIT_LANGUAGE "eng"
+
+struct eit_s {
+	struct writer_s out;
+	uint8_t *stream; /* Sections not cut into packets yet */
+	uint32_t used;
+	uint32_t size;
+	uint32_t *starts; /* Offsets in stream where a section starts */
+	uint32_t starts_count;
+	uint32_t starts_size;
+	uint8_t *loops; /* Event loop of each section of the table being built */
+	uint16_t loop_length[EIT_SECTIONS];
+	uint8_t segment_sections[EIT_SECTIONS / 8];
+	uint8_t section[EIT_MAX_SECTION];
+	uint8_t cc;
+	uint64_t base; /* Midnight UTC, the start of table 0x50 */
+	uint64_t bitrate; /* Bits per second, 0 writes as fast as it can */
+	struct timespec started;
+	uint64_t packets;
+	uint32_t sections;
+	uint32_t dropped;
+	uint32_t lost; /* Sections there was no memory to queue */
+};
+struct eit_s eit = { { -1 } };
+uint64_t eit_bitrate; /* -b */
+
+static inline uint8_t eit_bcd( int v )
+{
+	return ( ( v / 10 ) << 4 ) | ( v % 10 );
+}
+
+/* DVB text, with the ISO 8859-1 selector in front unless it is plain ASCII */
+static int eit_text( uint8_t *Out, const char *str, int len, int max )
+{
+	int n, p = 0;
+	for( n = 0; n < len && !( str[n] & 0x80 ); n++ ) {
+	}
+	if( n < len ) {
+		Out[0] = 0x10;
+		Out[1] = 0x00;
+		Out[2] = 0x01;
+		p = 3;
+	}
+	if( len > max - p ) {
+		len = max - p;
+	}
+	memcpy( Out + p, str, len );
+	return p + len;
+}
+
+/* One entry of the event loop: the title in a short event descriptor and
+ * the summary split over extended event descriptors. Returns its length.
+ */
+static int eit_event( uint8_t *Out, uint32_t row, uint64_t start )
+{
+	const char *title = string_get( &string_pool, events.title_id[row] );
+	const char *summary = event_string( events.summary_id[row] );
+	uint32_t duration = events.duration[row];
+	uint32_t mjd = start / 86400 + 40587;
+	uint32_t t = start % 86400;
+	int p, n, len, chunk, count, text;
+
+	Out[0] = events.event_id[row] >> 8;
+	Out[1] = events.event_id[row];
+	Out[2] = mjd >> 8;
+	Out[3] = mjd;
+	Out[4] = eit_bcd( t / 3600 );
+	Out[5] = eit_bcd( t / 60 % 60 );
+	Out[6] = eit_bcd( t % 60 );
+	if( duration > 99 * 3600 + 59 * 60 + 59 ) {
+		duration = 99 * 3600 + 59 * 60 + 59;
+	}
+	Out[7] = eit_bcd( duration / 3600 );
+	Out[8] = eit_bcd( duration / 60 % 60 );
+	Out[9] = eit_bcd( duration % 60 );
+	p = 12;
+	Out[p] = 0x4d;
+	memcpy( &Out[p + 2], EIT_LANGUAGE, 3 );
+	len = eit_text( &Out[p + 6], title, strlen( title ), 255 - 5 );
+	Out[p + 5] = len;
+	Out[p + 6 + len] = 0; /* No text, the summary goes in 0x4e */
+	Out[p + 1] = 5 + len;
+	p += 2 + 5 + len;
+	len = strlen( summary );
+	chunk = EIT_EXTENDED_TEXT - 3;
+	count = ( len + chunk - 1 ) / chunk;
+	if( count > 16 ) {
+		count = 16;
+	}
+	if( count > ( EIT_MAX_EVENTS - p ) / 257 ) {
+		count = ( EIT_MAX_EVENTS - p ) / 257;
+	}
+	for( n = 0; n < count; n++ ) {
+		Out[p] = 0x4e;
+		Out[p + 2] = ( n << 4 ) | ( count - 1 );
+		memcpy( &Out[p + 3], EIT_LANGUAGE, 3 );
+		Out[p + 6] = 0; /* No items */
+		text = len - n * chunk < chunk ? len - n * chunk : chunk;
+		text = eit_text( &Out[p + 8], summary + n * chunk, text, EIT_EXTENDED_TEXT );
+		Out[p + 7] = text;
+		Out[p + 1] = 6 + text;
+		p += 8 + text;
+	}
+	/* running_status 0, free_CA_mode 0 */
+	Out[10] = ( ( p - 12 ) >> 8 ) & 0x0f;
+	Out[11] = p - 12;
+	return p;
+}
+
+static void eit_pace( struct eit_s *X )
+{
+	struct timespec now, delay;
+	double due, elapsed;
+
+	due = X->packets * 188.0 * 8 / X->bitrate;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	elapsed = ( now.tv_sec - X->started.tv_sec ) + ( now.tv_nsec - X->started.tv_nsec ) / 1e9;
+	if( due > elapsed + 0.01 ) {
+		writer_flush( &X->out );
+		delay.tv_sec = due - elapsed;
+		delay.tv_nsec = ( due - elapsed - delay.tv_sec ) * 1e9;
+		nanosleep( &delay, NULL );
+	}
+}
+
+/* Cut the queued sections into packets. Unless Final, only whole packets
+ * are cut, so every section start that can fall in a packet is known.
+ */
+static void eit_packets( struct eit_s *X, int Final )
+{
+	uint8_t packet[188];
+	uint32_t pos = 0;
+	uint32_t next = 0;
+	uint32_t take;
+	int n;
+
+	while( X->used - pos >= 184 || ( Final && pos < X->used ) ) {
+		while( next < X->starts_count && X->starts[next] < pos ) {
+			next++;
+		}
+		packet[0] = 0x47;
+		packet[1] = EIT_PID >> 8;
+		packet[2] = EIT_PID & 0xff;
+		packet[3] = 0x10 | X->cc;
+		X->cc = ( X->cc + 1 ) & 0x0f;
+		n = 4;
+		take = 184;
+		if( next < X->starts_count && X->starts[next] < pos + 183 ) {
+			/* A section starts here, pointer_field to it */
+			packet[1] |= 0x40;
+			packet[4] = X->starts[next] - pos;
+			n = 5;
+			take = 183;
+		} else if( next < X->starts_count && X->starts[next] == pos + 183 ) {
+			/* It would start in the last byte without a pointer_field,
+			 * stuff that byte and start it in the next packet.
+			 */
+			take = 183;
+		}
+		if( take > X->used - pos ) {
+			take = X->used - pos;
+		}
+		memcpy( &packet[n], &X->stream[pos], take );
+		memset( &packet[n + take], 0xff, 188 - n - take );
+		pos += take;
+		writer_write( &X->out, packet, 188 );
+		X->packets++;
+		if( X->bitrate ) {
+			eit_pace( X );
+		}
+	}
+	memmove( X->stream, &X->stream[pos], X->used - pos );
+	X->used -= pos;
+	for( n = 0; next < X->starts_count; next++ ) {
+		X->starts[n++] = X->starts[next] - pos;
+	}
+	X->starts_count = n;
+}
+
+static void eit_queue( struct eit_s *X, const uint8_t *Section, uint32_t Length )
+{
+	uint32_t *starts;
+	uint8_t *stream;
+
+	if( X->used + Length > X->size ) {
+		stream = realloc( X->stream, X->size * 2 );
+		if( !stream ) {
+			goto lost;
+		}
+		X->stream = stream;
+		X->size *= 2;
+	}
+	if( X->starts_count == X->starts_size ) {
+		starts = realloc( X->starts, X->starts_size * 2 * sizeof( uint32_t ) );
+		if( !starts ) {
+			goto lost;
+		}
+		X->starts = starts;
+		X->starts_size *= 2;
+	}
+	X->starts[X->starts_count++] = X->used;
+	memcpy( &X->stream[X->used], Section, Length );
+	X->used += Length;
+	X->sections++;
+	if( X->used >= 65536 ) {
+		eit_packets( X, 0 );
+	}
+	return;
+lost:
+	if( !X->lost ) {
+		printf( "EIT: out of memory, sections are being dropped\n" );
+	}
+	X->lost++;
+}
+
+static inline int eit_version( uint32_t hash )
+{
+	return ( hash ^ ( hash >> 5 ) ^ ( hash >> 10 ) ) & 0x1f;
+}
+
+/* Write out the sections of one schedule table of a service */
+static void eit_table( struct eit_s *X, struct channel_s *C, int Table, int LastTable, int Version )
+{
+	uint8_t *S = X->section;
+	int segment, last_segment, last_section, count, n, number, length;
+	uint32_t crc32;
+
+	for( last_segment = EIT_SECTIONS / 8 - 1; last_segment > 0 && !X->segment_sections[last_segment]; last_segment-- ) {
+	}
+	last_section = last_segment * 8 + ( X->segment_sections[last_segment] ? X->segment_sections[last_segment] - 1 : 0 );
+	for( segment = 0; segment <= last_segment; segment++ ) {
+		/* An empty segment still gets one empty section */
+		count = X->segment_sections[segment] ? X->segment_sections[segment] : 1;
+		for( n = 0; n < count; n++ ) {
+			number = segment * 8 + n;
+			length = EIT_HEADER + X->loop_length[number] + 4;
+			S[0] = EIT_TABLE_SCHEDULE + Table;
+			S[1] = 0xf0 | ( ( length - 3 ) >> 8 );
+			S[2] = length - 3;
+			S[3] = C->Sid >> 8;
+			S[4] = C->Sid;
+			S[5] = 0xc1 | ( Version << 1 );
+			S[6] = number;
+			S[7] = last_section;
+			S[8] = C->Tid >> 8;
+			S[9] = C->Tid;
+			S[10] = C->Nid >> 8;
+			S[11] = C->Nid;
+			S[12] = segment * 8 + count - 1;
+			S[13] = EIT_TABLE_SCHEDULE + LastTable;
+			memcpy( &S[EIT_HEADER], &X->loops[number * EIT_MAX_EVENTS], X->loop_length[number] );
+			crc32 = demux_ts_compute_crc32( &demux_ts, S, length - 4, 0xffffffff );
+			S[length - 4] = crc32 >> 24;
+			S[length - 3] = crc32 >> 16;
+			S[length - 2] = crc32 >> 8;
+			S[length - 1] = crc32;
+			eit_queue( X, S, length );
+		}
+	}
+}
+
+static int eit_open( const char *FileName )
+{
+	struct eit_s *X = &eit;
+
+	if( !writer_open( &X->out, FileName ) ) {
+		return 0;
+	}
+	X->size = 1 << 17;
+	X->stream = malloc( X->size );
+	X->starts_size = 256;
+	X->starts = malloc( X->starts_size * sizeof( uint32_t ) );
+	X->loops = malloc( EIT_SECTIONS * EIT_MAX_EVENTS );
+	if( !X->stream || !X->starts || !X->loops ) {
+		printf( "EIT: out of memory\n" );
+		writer_close( &X->out );
+		free( X->stream );
+		free( X->starts );
+		free( X->loops );
+		X->stream = NULL;
+		X->starts = NULL;
+		X->loops = NULL;
+		return 0;
+	}
+	X->base = time( NULL ) / 86400 * 86400;
+	X->bitrate = eit_bitrate;
+	clock_gettime( CLOCK_MONOTONIC, &X->started );
+	return 1;
+}
+
+static void eit_channel( struct channel_s *C )
+{
+	struct eit_s *X = &eit;
+	uint64_t start, offset;
+	uint32_t row, hash = FNV1A_BASIS;
+	int m, table = -1, last_table = -1, segment, number, length;
+
+	/* The last table is in every section, find it first */
+	for( m = 0; m < C->events_count; m++ ) {
+		row = C->events[m];
+		if( !( events.flags[row] & EVENT_FLAG_TITLE ) ) {
+			break;
+		}
+		start = events.epoch + events.start[row];
+		if( start + events.duration[row] > X->base && start < X->base + EIT_TABLES * EIT_TABLE_SECONDS ) {
+			last_table = ( start < X->base ? 0 : start - X->base ) / EIT_TABLE_SECONDS;
+		}
+	}
+	if( last_table < 0 ) {
+		return;
+	}
+	for( m = 0; m <= C->events_count; m++ ) {
+		row = m < C->events_count ? C->events[m] : EVENT_NONE;
+		if( row != EVENT_NONE && !( events.flags[row] & EVENT_FLAG_TITLE ) ) {
+			row = EVENT_NONE;
+		}
+		if( row != EVENT_NONE ) {
+			start = events.epoch + events.start[row];
+			if( start + events.duration[row] <= X->base ) {
+				continue;
+			}
+			offset = start < X->base ? 0 : start - X->base;
+		}
+		if( row == EVENT_NONE || offset / EIT_TABLE_SECONDS != table ) {
+			if( table >= 0 ) {
+				eit_table( X, C, table, last_table, eit_version( hash ) );
+			}
+			if( row == EVENT_NONE || offset / EIT_TABLE_SECONDS > last_table ) {
+				break;
+			}
+			memset( X->loop_length, 0, sizeof( X->loop_length ) );
+			memset( X->segment_sections, 0, sizeof( X->segment_sections ) );
+			hash = FNV1A_BASIS;
+			/* Every table up to last_table_id must be there, one without events is one empty section */
+			while( ++table < offset / EIT_TABLE_SECONDS ) {
+				eit_table( X, C, table, last_table, eit_version( hash ) );
+			}
+		}
+		segment = offset % EIT_TABLE_SECONDS / EIT_SEGMENT_SECONDS;
+		number = segment * 8 + ( X->segment_sections[segment] ? X->segment_sections[segment] - 1 : 0 );
+		length = eit_event( X->section, row, start );
+		if( X->loop_length[number] + length > EIT_MAX_EVENTS ) {
+			if( ( number & 7 ) == 7 ) {
+				/* The segment is full */
+				X->dropped++;
+				continue;
+			}
+			number++;
+		}
+		memcpy( &X->loops[number * EIT_MAX_EVENTS + X->loop_length[number]], X->section, length );
+		X->loop_length[number] += length;
+		X->segment_sections[segment] = ( number & 7 ) + 1;
+		hash = event_content_hash( row ) ^ ( hash * 16777619 );
+	}
+}
+
+static int eit_close( void )
+{
+	struct eit_s *X = &eit;
+	int result;
+
+	eit_packets( X, 1 );
+	result = writer_close( &X->out );
+	printf( "EIT: %u sections in %" PRIu64 " packets", X->sections, X->packets );
+	if( X->dropped ) {
+		printf( ", %u events dropped from full segments", X->dropped );
+	}
+	if( X->lost ) {
+		printf( ", %u sections lost for lack of memory", X->lost );
+		result = 0;
+	}
+	printf( "\n" );
+	free( X->stream );
+	free( X->starts );
+	free( X->loops );
+	return result;
+}
+
+/* Output formats. Each gets the channels one at a time, in channel order
+ * at exit or as their carousels complete when streaming. Those that keep
+ * state across runs also get the events the delta reports as deleted.
+ */
+struct exporter_s {
+	const char *name;
+	int ( *open )( const char *FileName );
+	void ( *channel )( struct channel_s *C );
+	int ( *close )( void );
+	void ( *deleted )( struct channel_s *C, uint32_t row ); /* NULL if not needed */
+	int active;
+};
+
+struct exporter_s exporters[] = {
+	{ "xmltv", xmltv_export_open, xmltv_export_channel, xmltv_export_close },
+	{ "vdr", vdr_export_open, vdr_export_channel, vdr_export_close },
+	{ "jsonl", jsonl_open, jsonl_channel, jsonl_close },
+	{ "columnar", columnar_open, columnar_channel, columnar_close },
+	{ "eit", eit_open, eit_channel, eit_close },
+#ifdef HAVE_SQLITE
+	{ "sqlite", sqlite_export_open, sqlite_export_channel, sqlite_export_close, sqlite_export_deleted },
+#endif
+	{ NULL }
+};
+int export_streaming;
+
+int export_start( const char *Format, const char *FileName )
+{
+	struct exporter_s *X;
+	for( X = exporters; X->name; X++ ) {
+		if( !strcmp( X->name, Format ) ) {
+			if( X->active ) {
+				printf( "Export: %s given twice\n", Format );
+				return 0;
+			}
+			X->active = X->open( FileName );
+			return X->active;
+		}
+	}
+	printf( "Export: unknown format '%s'\n", Format );
+	return 0;
+}
+
+void export_channel_complete( struct channel_s *C )
+{
+	struct exporter_s *X;
+	if( C->exported ) {
+		return;
+	}
+	C->exported = 1;
+	for( X = exporters; X->name; X++ ) {
+		if( X->active ) {
+			X->channel( C );
+		}
+	}
+}
+
+void export_event_deleted( struct channel_s *C, uint32_t row )
+{
+	struct exporter_s *X;
+	for( X = exporters; X->name; X++ ) {
+		if( X->active && X->deleted ) {
+			X->deleted( C, row );
+		}
+	}
+}
+
+/* Hand over the channels not streamed yet and close every output */
+int export_finish( void )
+{
+	struct exporter_s *X;
+	int result = 1;
+	int n;
+	for( n = 0; n < nChannels; n++ ) {
+		export_channel_complete( &lChannels[n] );
+	}
+	for( X = exporters; X->name; X++ ) {
+		if( X->active ) {
+			result &= X->close();
+			X->active = 0;
+		}
+	}
+	return result;
+}
+
+/* Close every output opened so far, for when loadepg gives up early */
+void export_abort( void )
+{
+	struct exporter_s *X;
+	for( X = exporters; X->name; X++ ) {
+		if( X->active ) {
+			X->close();
+			X->active = 0;
+		}
+	}
+}
+
+/* Called for each title or summary section before it is decoded.
+ * When the channel's first section of that kind comes round again the
+ * carousel has been seen in full; once both kinds have, the channel is
+ * complete and can be streamed out.
+ */
+static inline int channel_carousel_complete( const struct channel_s *C )
+{
+	return C->carousel_wrapped[CAROUSEL_TITLES] && C->carousel_wrapped[CAROUSEL_SUMMARIES];
+}
+
+int carousel_lapped; /* A channel went round its carousel since epg_generation_complete() looked */
+
+void channel_carousel_section( struct channel_s *C, int kind, uint32_t key )
+{
+	if( !C->carousel_first[kind] ) {
+		C->carousel_first[kind] = key;
+		return;
+	}
+	if( key != C->carousel_first[kind] ) {
+		C->carousel_sections[kind]++;
+		return;
+	}
+	if( C->carousel_sections[kind] ) {
+		C->carousel_wrapped[kind] = 1;
+	}
+	if( channel_carousel_complete( C ) ) {
+		C->carousel_laps++;
+		carousel_lapped = 1;
+		if( export_streaming ) {
+			export_channel_complete( C );
+		}
+	}
+}
+
+/* Compare this run with the snapshot loaded by epgdb_load() and write
+ * one record per change: A(dded), M(odified) or D(eleted), tab separated.
+ * Snapshot events that did not come round again are only deleted on
+ * channels whose carousel this run saw in full, so a partial capture
+ * deletes nothing. Deleted rows leave the channel and the time index and
+ * become EVENT_FLAG_DELETED tombstones in the event table.
+ */
+int delta_write( const char *FileName )
+{
+	struct channel_s *C;
+	FILE *File;
+	uint32_t row;
+	uint64_t added = 0, modified = 0, deleted = 0, unchanged = 0;
+	uint32_t size;
+	int result = 1;
+	int kept;
+	int n;
+	int m;
+
+	File = fopen( FileName, "w" );
+	if( File == NULL ) {
+		printf( "Delta: Error opening file '%s'. %s\n", FileName, strerror( errno ) );
+		return 0;
+	}
+	for( n = 0; n < nChannels; n++ ) {
+		C = &lChannels[n];
+		kept = 0;
+		for( m = 0; m < C->events_count; m++ ) {
+			row = C->events[m];
+			if( !( events.flags[row] & EVENT_FLAG_SNAPSHOT ) ) {
+				delta_write_event( File, 'A', C, row );
+				added++;
+			} else if( events.flags[row] & EVENT_FLAG_SEEN ) {
+				if( event_content_hash( row ) != events.prev_hash[row] ) {
+					delta_write_event( File, 'M', C, row );
+					modified++;
+				} else {
+					unchanged++;
+				}
+			} else if( channel_carousel_complete( C ) ) {
+				delta_write_event( File, 'D', C, row );
+				export_event_deleted( C, row );
+				deleted++;
+				if( events.flags[row] & EVENT_FLAG_TITLE ) {
+					interval_index_remove( &events_by_time, &events, row );
+				}
+				events.flags[row] = EVENT_FLAG_DELETED;
+				event_table_changed( &events, row );
+				continue;
+			}
+			C->events[kept++] = row;
+		}
+		if( kept != C->events_count ) {
+			/* Rebuild the EventId index without the deleted rows, smaller if it can be */
+			C->events_count = kept;
+			for( size = 64; ( kept + 1 ) * 2 > size; size *= 2 ) {
+			}
+			if( size >= C->events_index_size ) {
+				channel_fill_events_index( C, C->events_index, C->events_index_size );
+			} else if( !channel_resize_events_index( C, size ) ) {
+				/* The old table is big enough, rebuild it in place */
+				printf( "Delta: Error shrinking the EventId index of channel %u, out of memory\n", C->ChannelId );
+				channel_fill_events_index( C, C->events_index, C->events_index_size );
+				result = 0;
+			}
+		}
+	}
+	if( fclose( File ) != 0 ) {
+		printf( "Delta: Error writing '%s'. %s\n", FileName, strerror( errno ) );
+		return 0;
+	}
+	printf( "Delta: %" PRIu64 " added, %" PRIu64 " modified, %" PRIu64 " deleted, %" PRIu64 " unchanged\n",
+		added, modified, deleted, unchanged );
+	return result;
+}
+
+static int epgdb_write_column( FILE *File, uint64_t offset, const void *data, size_t size )
+{
+	if( fseeko( File, offset, SEEK_SET ) < 0 ) {
+		return 0;
+	}
+	return size == 0 || fwrite( data, size, 1, File ) == 1;
+}
+
+/* Write channels, events and the strings they use to File, which has to
+ * be seekable, and its header to Header. Name is only for messages.
+ * Returns the image size, 0 on error.
+ */
+static uint64_t epgdb_write_image( FILE *File, const char *Name, struct epgdb_header_s *Header )
+{
+	struct epgdb_header_s H;
+	struct epgdb_channel_s *channels = NULL;
+	uint32_t *start = NULL;
+	uint32_t *duration = NULL;
+	uint16_t *event_id = NULL;
+	uint16_t *theme = NULL;
+	uint8_t *flags = NULL;
+	uint32_t *title_id = NULL;
+	uint32_t *summary_id = NULL;
+	uint32_t *hash = NULL;
+	uint32_t *string_map = NULL; /* Pool id to database id + 1 */
+	uint32_t *string_offsets = NULL;
+	uint32_t *ids[2];
+	uint32_t count;
+	uint32_t spilled;
+	uint32_t row;
+	uint32_t id;
+	uint32_t e;
+	uint64_t result = 0;
+	int len;
+	int n;
+	int m;
+	int k;
+
+	memset( &H, 0, sizeof( H ) );
+	H.magic = EPGDB_MAGIC;
+	H.version = EPGDB_VERSION;
+	H.created = time( NULL );
+	H.epoch = events.epoch;
+	H.channel_count = nChannels;
+	spilled = 0;
+	for( n = 0; n < nChannels; n++ ) {
+		H.event_count += lChannels[n].events_count;
+		for( m = 0; m < lChannels[n].events_count; m++ ) {
+			spilled += ( events.summary_id[lChannels[n].events[m]] & SUMMARY_SPILLED ) != 0;
+		}
+	}
+	count = H.event_count ? H.event_count : 1;
+	channels = calloc( nChannels ? nChannels : 1, sizeof( struct epgdb_channel_s ) );
+	start = malloc( count * sizeof( uint32_t ) );
+	duration = malloc( count * sizeof( uint32_t ) );
+	event_id = malloc( count * sizeof( uint16_t ) );
+	theme = malloc( count * sizeof( uint16_t ) );
+	flags = malloc( count * sizeof( uint8_t ) );
+	title_id = malloc( count * sizeof( uint32_t ) );
+	summary_id = malloc( count * sizeof( uint32_t ) );
+	hash = malloc( count * sizeof( uint32_t ) );
+	string_map = calloc( string_pool.count + 1, sizeof( uint32_t ) );
+	string_offsets = malloc( ( string_pool.count + spilled + 1 ) * sizeof( uint32_t ) );
+	if( !channels || !start || !duration || !event_id || !theme || !flags ||
+		!title_id || !summary_id || !hash || !string_map || !string_offsets ) {
+		printf( "EpgDB: out of memory\n" );
+		goto out;
+	}
+
+	/* Only strings still referenced are kept, renumbered in order of use */
+	string_offsets[0] = 0;
+	H.string_count = 1;
+	H.strings_size = 1;
+	e = 0;
+	for( n = 0; n < nChannels; n++ ) {
+		struct channel_s *C = &lChannels[n];
+		channels[n].ChannelId = C->ChannelId;
+		channels[n].Nid = C->Nid;
+		channels[n].Tid = C->Tid;
+		channels[n].Sid = C->Sid;
+		channels[n].SkyNumber1 = C->SkyNumber1;
+		channels[n].SkyNumber2 = C->SkyNumber2;
+		channels[n].info = C->info;
+		channels[n].first_event = e;
+		channels[n].event_count = C->events_count;
+		for( m = 0; m < C->events_count; m++, e++ ) {
+			row = C->events[m];
+			start[e] = events.start[row];
+			duration[e] = events.duration[row];
+			event_id[e] = events.event_id[row];
+			theme[e] = events.theme[row];
+			flags[e] = events.flags[row] & ( EVENT_FLAG_TITLE | EVENT_FLAG_SUMMARY );
+			title_id[e] = events.title_id[row];
+			summary_id[e] = events.summary_id[row];
+			hash[e] = event_content_hash( row );
+			ids[0] = &title_id[e];
+			ids[1] = &summary_id[e];
+			for( k = 0; k < 2; k++ ) {
+				id = *ids[k];
+				if( id & SUMMARY_SPILLED ) {
+					/* Not shared, each reference gets its own copy */
+					len = spill_read( &summary_spill, id & ~SUMMARY_SPILLED );
+					string_offsets[H.string_count] = H.strings_size;
+					H.strings_size += ( len < 0 ? 0 : len ) + 1;
+					*ids[k] = H.string_count++;
+					continue;
+				}
+				if( id == 0 || id >= string_pool.count ) {
+					*ids[k] = 0;
+					continue;
+				}
+				if( !string_map[id] ) {
+					string_offsets[H.string_count] = H.strings_size;
+					H.strings_size += string_pool.strings[id].len + 1;
+					string_map[id] = ++H.string_count;
+				}
+				*ids[k] = string_map[id] - 1;
+			}
+		}
+	}
+
+	H.channels = EPGDB_ALIGN( sizeof( H ) );
+	H.start = EPGDB_ALIGN( H.channels + ( uint64_t ) H.channel_count * sizeof( struct epgdb_channel_s ) );
+	H.duration = EPGDB_ALIGN( H.start + ( uint64_t ) H.event_count * sizeof( uint32_t ) );
+	H.event_id = EPGDB_ALIGN( H.duration + ( uint64_t ) H.event_count * sizeof( uint32_t ) );
+	H.theme = EPGDB_ALIGN( H.event_id + ( uint64_t ) H.event_count * sizeof( uint16_t ) );
+	H.flags = EPGDB_ALIGN( H.theme + ( uint64_t ) H.event_count * sizeof( uint16_t ) );
+	H.title_id = EPGDB_ALIGN( H.flags + ( uint64_t ) H.event_count * sizeof( uint8_t ) );
+	H.summary_id = EPGDB_ALIGN( H.title_id + ( uint64_t ) H.event_count * sizeof( uint32_t ) );
+	H.hash = EPGDB_ALIGN( H.summary_id + ( uint64_t ) H.event_count * sizeof( uint32_t ) );
+	H.string_offsets = EPGDB_ALIGN( H.hash + ( uint64_t ) H.event_count * sizeof( uint32_t ) );
+	H.strings = EPGDB_ALIGN( H.string_offsets + ( uint64_t ) H.string_count * sizeof( uint32_t ) );
+	H.size = H.strings + H.strings_size;
+
+	if( !epgdb_write_column( File, 0, &H, sizeof( H ) ) ||
+		!epgdb_write_column( File, H.channels, channels, H.channel_count * sizeof( struct epgdb_channel_s ) ) ||
+		!epgdb_write_column( File, H.start, start, H.event_count * sizeof( uint32_t ) ) ||
+		!epgdb_write_column( File, H.duration, duration, H.event_count * sizeof( uint32_t ) ) ||
+		!epgdb_write_column( File, H.event_id, event_id, H.event_count * sizeof( uint16_t ) ) ||
+		!epgdb_write_column( File, H.theme, theme, H.event_count * sizeof( uint16_t ) ) ||
+		!epgdb_write_column( File, H.flags, flags, H.event_count * sizeof( uint8_t ) ) ||
+		!epgdb_write_column( File, H.title_id, title_id, H.event_count * sizeof( uint32_t ) ) ||
+		!epgdb_write_column( File, H.summary_id, summary_id, H.event_count * sizeof( uint32_t ) ) ||
+		!epgdb_write_column( File, H.hash, hash, H.event_count * sizeof( uint32_t ) ) ||
+		!epgdb_write_column( File, H.string_offsets, string_offsets, H.string_count * sizeof( uint32_t ) ) ||
+		!epgdb_write_column( File, H.strings, "", 1 ) ) {
+		printf( "EpgDB: Error writing '%s'. %s\n", Name, strerror( errno ) );
+		goto out;
+	}
+	/* Strings were numbered in order of first use, write them in that order */
+	for( n = 0; n < nChannels; n++ ) {
+		for( m = 0; m < lChannels[n].events_count; m++ ) {
+			row = lChannels[n].events[m];
+			ids[0] = &events.title_id[row];
+			ids[1] = &events.summary_id[row];
+			for( k = 0; k < 2; k++ ) {
+				id = *ids[k];
+				if( id & SUMMARY_SPILLED ) {
+					len = spill_read( &summary_spill, id & ~SUMMARY_SPILLED );
+					if( fwrite( len > 0 ? summary_spill.buffer : "", len > 0 ? len + 1 : 1, 1, File ) != 1 ) {
+						printf( "EpgDB: Error writing '%s'. %s\n", Name, strerror( errno ) );
+						goto out;
+					}
+					continue;
+				}
+				if( id == 0 || id >= string_pool.count || !string_map[id] ) {
+					continue;
+				}
+				if( fwrite( string_pool.strings[id].str, string_pool.strings[id].len + 1, 1, File ) != 1 ) {
+					printf( "EpgDB: Error writing '%s'. %s\n", Name, strerror( errno ) );
+					goto out;
+				}
+				/* Written, do not write it again */
+				string_map[id] = 0;
+			}
+		}
+	}
+	*Header = H;
+	result = H.size;
+out:
+	free( channels );
+	free( start );
+	free( duration );
+	free( event_id );
+	free( theme );
+	free( flags );
+	free( title_id );
+	free( summary_id );
+	free( hash );
+	free( string_map );
+	free( string_offsets );
+	return result;
+}
+
+/* Write the database to FileName. Goes through a temporary file and
+ * rename so readers never see a partial database.
+ */
+int epgdb_write( const char *FileName )
+{
+	struct epgdb_header_s H;
+	char *TmpName;
+	FILE *File;
+	uint64_t size;
+
+	if( asprintf( &TmpName, "%s.tmp", FileName ) < 0 ) {
+		return 0;
+	}
+	File = fopen( TmpName, "w" );
+	if( File == NULL ) {
+		printf( "EpgDB: Error opening file '%s'. %s\n", TmpName, strerror( errno ) );
+		free( TmpName );
+		return 0;
+	}
+	size = epgdb_write_image( File, TmpName, &H );
+	if( fclose( File ) != 0 && size ) {
+		printf( "EpgDB: Error writing '%s'. %s\n", TmpName, strerror( errno ) );
+		size = 0;
+	}
+	if( size && rename( TmpName, FileName ) < 0 ) {
+		printf( "EpgDB: Error renaming '%s'. %s\n", TmpName, strerror( errno ) );
+		size = 0;
+	}
+	if( !size ) {
+		unlink( TmpName );
+	} else {
+		printf( "EpgDB: wrote %u channels, %u events, %u strings to %s\n",
+			H.channel_count, H.event_count, H.string_count, FileName );
+	}
+	free( TmpName );
+	return size != 0;
+}
+
+/* -M: the database image in a shared memory object for epgshm.h readers.
+ * Republished at most every SHM_PUBLISH_SECONDS while events change and
+ * once more at the end.
+ */
+#define SHM_PUBLISH_SECONDS 1
+
+struct shm_publisher_s {
+	struct epgshm_s shm;
+	const char *name;
+	uint32_t seq; /* events.last_seq of the last image */
+	time_t published;
+	uint64_t count;
+	uint64_t bytes;
+};
+struct shm_publisher_s shm_publisher;
+
+int shm_publish_open( const char *Name )
+{
+	if( !epgshm_create( &shm_publisher.shm, Name ) ) {
+		printf( "Shm: cannot create '%s'. %s\n", Name, strerror( errno ) );
+		return 0;
+	}
+	shm_publisher.name = Name;
+	return 1;
+}
+
+/* Publish if anything changed, unless Force not before SHM_PUBLISH_SECONDS have passed */
+void shm_publish( int Force )
+{
+	struct shm_publisher_s *P = &shm_publisher;
+	struct epgdb_header_s H;
+	char *image = NULL;
+	size_t size = 0;
+	uint64_t length;
+	FILE *File;
+
+	if( !P->name || ( P->count && P->seq == events.last_seq ) ) {
+		return;
+	}
+	if( !Force && time( NULL ) < P->published + SHM_PUBLISH_SECONDS ) {
+		return;
+	}
+	File = open_memstream( &image, &size );
+	if( !File ) {
+		return;
+	}
+	length = epgdb_write_image( File, P->name, &H );
+	if( fclose( File ) != 0 || size != length ) {
+		length = 0;
+	}
+	if( length && !epgshm_publish( &P->shm, ( uint8_t * ) image, length ) ) {
+		printf( "Shm: cannot publish to '%s'. %s\n", P->name, strerror( errno ) );
+	} else if( length ) {
+		P->count++;
+		P->bytes += length;
+	}
+	free( image );
+	P->seq = events.last_seq;
+	P->published = time( NULL );
+}
+
+void shm_publish_close( void )
+{
+	if( !shm_publisher.name ) {
+		return;
+	}
+	printf( "Shm: %" PRIu64 " images, %" PRIu64 " bytes published to '%s'\n",
+		shm_publisher.count, shm_publisher.bytes, shm_publisher.name );
+	/* The object stays for readers, only the mapping goes */
+	munmap( shm_publisher.shm.base, shm_publisher.shm.size );
+	close( shm_publisher.shm.fd );
+	shm_publisher.name = NULL;
+}
+
+/* Start from what a previous run saved. New sections then update it.
+ * Returns 1 when loaded, 0 when there is no database yet and -1 when
+ * there is a file that is not a database this version can read.
+ */
+int epgdb_load( const char *FileName )
+{
+	struct epgdb_s db;
+	const struct epgdb_channel_s *D;
+	struct channel_s *C;
+	uint32_t *string_map;
+	const char *str;
+	uint32_t id;
+	uint32_t row;
+	uint32_t e;
+	uint32_t n;
+
+	if( !epgdb_open( &db, FileName ) ) {
+		if( access( FileName, F_OK ) == 0 ) {
+			printf( "EpgDB: '%s' is not a usable database\n", FileName );
+			return -1;
+		}
+		printf( "EpgDB: no database in '%s', starting empty\n", FileName );
+		return 0;
+	}
+	string_map = malloc( db.header->string_count * sizeof( uint32_t ) );
+	if( !string_map ) {
+		epgdb_close( &db );
+		return -1;
+	}
+	/* Titles are interned as they are met, summaries go through the budget */
+	memset( string_map, 0xff, db.header->string_count * sizeof( uint32_t ) );
+	for( n = 0; n < db.header->channel_count; n++ ) {
+		D = &db.channels[n];
+		if( D->ChannelId == 0 ) {
+			continue;
+		}
+		C = channel_add( D->ChannelId );
+		if( !C ) {
+			printf( "EpgDB: Error, out of memory for channels\n" );
+			break;
+		}
+		join.stale = 1;
+		C->Nid = D->Nid;
+		C->Tid = D->Tid;
+		C->Sid = D->Sid;
+		C->SkyNumber1 = D->SkyNumber1;
+		C->SkyNumber2 = D->SkyNumber2;
+		C->info = D->info;
+		for( e = D->first_event; e < D->first_event + D->event_count; e++ ) {
+			row = channel_event( C, db.event_id[e] );
+			if( row == EVENT_NONE ) {
+				break;
+			}
+			events.theme[row] = db.theme[e];
+			events.flags[row] = ( db.flags[e] & ( EVENT_FLAG_TITLE | EVENT_FLAG_SUMMARY ) ) | EVENT_FLAG_SNAPSHOT;
+			events.prev_hash[row] = db.hash[e];
+			id = db.title_id[e];
+			if( id < db.header->string_count && string_map[id] == EVENT_NONE ) {
+				str = epgdb_string( &db, id );
+				string_map[id] = string_intern( &string_pool, str, strlen( str ) );
+				if( *str && !string_map[id] ) {
+					break;
+				}
+			}
+			events.title_id[row] = id < db.header->string_count ? string_map[id] : 0;
+			str = epgdb_string( &db, db.summary_id[e] );
+			events.summary_id[row] = *str ? summary_store( str, strlen( str ) ) : 0;
+			if( *str && !events.summary_id[row] ) {
+				break;
+			}
+			if( ( events.flags[row] & EVENT_FLAG_TITLE ) && !event_table_set_start( &events, row, epgdb_start( &db, e ) ) ) {
+				/* Keep the text, drop the time */
+				events.flags[row] &= ~EVENT_FLAG_TITLE;
+			}
+			if( events.flags[row] & EVENT_FLAG_TITLE ) {
+				events.duration[row] = db.duration[e];
+				channel_event_reorder( C, channel_event_position( C, row ) );
+				if( !interval_index_insert( &events_by_time, &events, row ) ) {
+					break;
+				}
+			}
+			event_table_changed( &events, row );
+		}
+		if( e < D->first_event + D->event_count ) {
+			printf( "EpgDB: Error, out of memory, '%s' only partly loaded\n", FileName );
+			break;
+		}
+	}
+	printf( "EpgDB: loaded %u channels, %u events, %u strings from %s\n",
+		db.header->channel_count, db.header->event_count, db.header->string_count, FileName );
+	free( string_map );
+	epgdb_close( &db );
+	return 1;
+}
+
+/* Whether every channel with a carousel has been round it in full since
+ * the last time this said so, which ends a generation. Call between TS
+ * packets, it is cheap while no channel has finished a lap.
+ */
+int epg_generation_complete( void )
+{
+	struct channel_s *C;
+	int n;
+
+	if( !carousel_lapped ) {
+		return 0;
+	}
+	carousel_lapped = 0;
+	for( n = 0; n < nChannels; n++ ) {
+		C = &lChannels[n];
+		if( C->carousel_first[CAROUSEL_TITLES] && C->carousel_first[CAROUSEL_SUMMARIES] && !C->carousel_laps ) {
+			return 0;
+		}
+	}
+	for( n = 0; n < nChannels; n++ ) {
+		lChannels[n].carousel_laps = 0;
 	}
-	else
-	{
-	  T->Name[0] = '\0';
+	return 1;
+}
+
+static void *epg_rotate_column( const void *column, uint32_t count, uint32_t size, size_t width )
+{
+	void *copy = arena_alloc( &epg_arena, size * width );
+	if( copy ) {
+		memcpy( copy, column, count * width );
 	}
-	id ++;
-      }
-    }
-    fclose( FileThemes );
-  }
-  free( FileName );
-  return true;
+	return copy;
+}
 
-#endif
+/* Id in the new pool of a string in the old one, EVENT_NONE when out of memory */
+static uint32_t epg_rotate_string( struct string_pool_s *Pool, uint32_t *Map, uint32_t id )
+{
+	struct pool_string_s *S;
 
-void clean_string( unsigned char *String )
+	if( id & SUMMARY_SPILLED || id >= string_pool.count ) {
+		return id;
+	}
+	if( Map[id] == EVENT_NONE ) {
+		S = &string_pool.strings[id];
+		Map[id] = string_intern( Pool, S->str, S->len );
+		if( !Map[id] && S->len ) {
+			Map[id] = EVENT_NONE;
+			return EVENT_NONE;
+		}
+	}
+	return Map[id];
+}
+
+/* Copy what the events still use to a fresh arena and release the old one,
+ * so a daemon that stays up (-u) does not keep every generation's strings
+ * and the tables left behind by growth. Row numbers, sequence numbers and
+ * spilled summaries stay as they were, string ids change. The copy is not
+ * held to -m, the old arena goes as soon as it is done. Returns 0 and
+ * keeps the old arena when out of memory.
+ */
+int epg_rotate( void )
 {
-  unsigned char *Src;
-  unsigned char *Dst;
-  int Spaces;
-  int pC;
-  Src = String;
-  Dst = String;
-  Spaces = 0;
-  pC = 0;
-  while( *Src )
-  {
-    // corrections
-    if( *Src == 0x8c ) // iso-8859-2 LATIN CAPITAL LETTER S WITH ACUTE
-    {
-      *Src = 0xa6;
-    }
-    if( *Src == 0x8f ) // iso-8859-2 LATIN CAPITAL LETTER Z WITH ACUTE
-    {
-      *Src = 0xac;
-    }
-    
-    if( *Src < 0x20 )
-    {
-      *Src = 0x20;
-    }
-    if( *Src == 0x20 )
-    {
-      Spaces ++;
-      if( pC == 0 )
-      {
-        Spaces ++;
-      }
-    }
-    else
-    {
-      Spaces = 0;
-    }
-    if( Spaces < 2 )
-    {
-      *Dst = *Src;
-      *Dst ++;
-      pC ++;
-    }
-    *Src ++;
-  }
-  if( Spaces > 0 )
-  {
-    Dst --;
-    *Dst = 0;
-  }
-  else
-  {
-    *Dst = 0;
-  }
+	struct arena_s old = epg_arena;
+	struct string_pool_s pool;
+	struct event_table_s T;
+	struct interval_index_s I;
+	struct service_s *S;
+	struct channel_s *C;
+	uint32_t *string_map;
+	uint32_t **rows;
+	uint32_t **index;
+	uint32_t row;
+	int n;
+
+	/* Row groups of the columnar export hold string ids */
+	if( columnar.out.fd >= 0 ) {
+		columnar_flush_group( &columnar );
+	}
+	memset( &epg_arena, 0, sizeof( epg_arena ) );
+	string_map = malloc( ( string_pool.count + 1 ) * sizeof( uint32_t ) );
+	rows = calloc( nChannels + 1, sizeof( uint32_t * ) );
+	index = calloc( nChannels + 1, sizeof( uint32_t * ) );
+	if( !string_map || !rows || !index ) {
+		goto failed;
+	}
+	memset( string_map, 0xff, ( string_pool.count + 1 ) * sizeof( uint32_t ) );
+	string_map[0] = 0;
+	memset( &pool, 0, sizeof( pool ) );
+	memset( &I, 0, sizeof( I ) );
+	T = events;
+	if( events.size ) {
+		if( !( T.start = epg_rotate_column( events.start, events.count, events.size, sizeof( uint32_t ) ) ) ||
+			!( T.duration = epg_rotate_column( events.duration, events.count, events.size, sizeof( uint32_t ) ) ) ||
+			!( T.channel = epg_rotate_column( events.channel, events.count, events.size, sizeof( uint16_t ) ) ) ||
+			!( T.event_id = epg_rotate_column( events.event_id, events.count, events.size, sizeof( uint16_t ) ) ) ||
+			!( T.theme = epg_rotate_column( events.theme, events.count, events.size, sizeof( uint16_t ) ) ) ||
+			!( T.flags = epg_rotate_column( events.flags, events.count, events.size, sizeof( uint8_t ) ) ) ||
+			!( T.title_id = epg_rotate_column( events.title_id, events.count, events.size, sizeof( uint32_t ) ) ) ||
+			!( T.summary_id = epg_rotate_column( events.summary_id, events.count, events.size, sizeof( uint32_t ) ) ) ||
+			!( T.prev_hash = epg_rotate_column( events.prev_hash, events.count, events.size, sizeof( uint32_t ) ) ) ||
+			!( T.seq = epg_rotate_column( events.seq, events.count, events.size, sizeof( uint32_t ) ) ) ) {
+			goto failed;
+		}
+	}
+	for( row = 0; row < T.count; row++ ) {
+		if( ( T.title_id[row] = epg_rotate_string( &pool, string_map, events.title_id[row] ) ) == EVENT_NONE ||
+			( T.summary_id[row] = epg_rotate_string( &pool, string_map, events.summary_id[row] ) ) == EVENT_NONE ) {
+			goto failed;
+		}
+	}
+	for( n = 0; n < demux_ts.services.count; n++ ) {
+		S = &demux_ts.services.services[n];
+		if( epg_rotate_string( &pool, string_map, S->provider_id ) == EVENT_NONE ||
+			epg_rotate_string( &pool, string_map, S->name_id ) == EVENT_NONE ) {
+			goto failed;
+		}
+	}
+	for( n = 0; n < nChannels; n++ ) {
+		C = &lChannels[n];
+		if( C->events_size && !( rows[n] = epg_rotate_column( C->events, C->events_count, C->events_size, sizeof( uint32_t ) ) ) ) {
+			goto failed;
+		}
+		if( C->events_index_size ) {
+			if( !( index[n] = arena_alloc( &epg_arena, C->events_index_size * sizeof( uint32_t ) ) ) ) {
+				goto failed;
+			}
+			channel_fill_events_index( C, index[n], C->events_index_size );
+		}
+	}
+	/* Rebuilt around the current time, the window moves on with the daemon */
+	for( row = 0; row < events.count; row++ ) {
+		if( ( events.flags[row] & EVENT_FLAG_TITLE ) && !interval_index_insert( &I, &events, row ) ) {
+			goto failed;
+		}
+	}
+
+	/* Nothing can fail from here on */
+	pool.requested_count = string_pool.requested_count;
+	pool.requested_bytes = string_pool.requested_bytes;
+	for( n = 0; n < demux_ts.services.count; n++ ) {
+		S = &demux_ts.services.services[n];
+		S->provider_id = epg_rotate_string( &pool, string_map, S->provider_id );
+		S->name_id = epg_rotate_string( &pool, string_map, S->name_id );
+	}
+	for( n = 0; n < nChannels; n++ ) {
+		lChannels[n].events = rows[n];
+		lChannels[n].events_index = index[n];
+	}
+	printf( "Arena: generation done, kept %" PRIu64 " of %" PRIu64 " bytes and %u of %u strings\n",
+		epg_arena.allocated, old.allocated, pool.count, string_pool.count );
+	string_pool = pool;
+	events = T;
+	events_by_time = I;
+	epg_arena.limit = old.limit;
+	epg_arena.refused = old.refused;
+	arena_release( &old );
+	free( string_map );
+	free( rows );
+	free( index );
+	return 1;
+failed:
+	printf( "Arena: out of memory, keeping this generation\n" );
+	arena_release( &epg_arena );
+	epg_arena = old;
+	free( string_map );
+	free( rows );
+	free( index );
+	return 0;
+}
+
+/* Release every decoded string and event of this generation in one go.
+ * Channels, bouquets and services are kept.
+ */
+void epg_release( void )
+{
+	struct channel_s *C;
+	int n;
+	printf( "Arena: %" PRIu64 " bytes allocated, %" PRIu64 " bytes reserved\n",
+		epg_arena.allocated, epg_arena.reserved );
+	if( epg_arena.refused ) {
+		printf( "Arena: %" PRIu64 " allocations refused by the %" PRIu64 " MB limit\n",
+			epg_arena.refused, epg_arena.limit / ( 1024 * 1024 ) );
+	}
+	if( summary_spill.count ) {
+		printf( "Spill: %" PRIu64 " summaries, %" PRIu64 " bytes\n",
+			summary_spill.count, summary_spill.size );
+	}
+	if( events_by_time.outside ) {
+		printf( "Index: %" PRIu64 " events more than two weeks before or six after %" PRIu64 " not indexed by time\n",
+			events_by_time.outside, ( uint64_t ) events_by_time.anchor_hour * INTERVAL_BUCKET_SECONDS );
+	}
+	for( n = 0; n < nChannels; n++ ) {
+		C = &lChannels[n];
+		C->events_count = 0;
+		C->events_size = 0;
+		C->events = NULL;
+		C->events_index_size = 0;
+		C->events_index = NULL;
+	}
+	memset( &string_pool, 0, sizeof( string_pool ) );
+	memset( &events, 0, sizeof( events ) );
+	memset( &events_by_time, 0, sizeof( events_by_time ) );
+	spill_close( &summary_spill );
+	arena_release( &epg_arena );
 }
 
 /* No huffman is a5 */
@@ -1649,17 +5971,10 @@ void clean_string( unsigned char *String )
 /* Similar to C1 */
 void process_epg_test_a5_a6_a7( uint8_t *Data, int Length )
 {
-	int i, n;
 	int tmp;
-	printf("epg_test: TODO\n");  
-	printf("MATCHA567 ");
-	for(n = 0; n < 0x1c; n++) {
-		printf("%02x ", Data[n]);
-		if ((n % 32) == 31) {
-			printf("\n");
-		}
-	}
-	printf("\n");
+	dlog( LOG_CAT_TABLES, "epg_test: TODO\n");  
+	xlog( LOG_CAT_TABLES, "MATCHA567 ");
+	xlog_hex( LOG_CAT_TABLES, Data, 0x1c, 32 );
 	if (1) {
 //		int satMJD = ( Data[3] << 8 ) | Data[4];
 //		int satH = BcdToInt( Data[5] );
@@ -1674,38 +5989,20 @@ void process_epg_test_a5_a6_a7( uint8_t *Data, int Length )
 //		}
 //		printf("\n");
 	/* Offset i == 11 seems to be good */
-		for(n = 0; n < 0xa; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+		xlog_hex( LOG_CAT_TABLES, Data, 0xa, 32 );
 		int p1 = 0xa;
 		while( p1 < Length ) {
 			switch (Data[p1 + 4]) {
 			case 0xbc:
-				for(n = 0; n < 4; n++) {
-					printf("%02x ", Data[p1 + n]);
-					if ((n % 32) == 31) {
-						printf("\n");
-					}
-				}
-				printf("\n");
+				xlog_hex( LOG_CAT_TABLES, &Data[p1], 4, 32 );
 				tmp = Data[p1 + 5];
-				printf("%02x %02x\n", Data[p1 + 4], tmp);
-				for(n = 0; n < tmp; n++) {
-					printf("%02x ", Data[p1 + n + 6]);
-					if ((n % 9) == 8) {
-						printf("\n");
-					}
-				}
-				printf("\n");
+				xlog( LOG_CAT_TABLES, "%02x %02x\n", Data[p1 + 4], tmp);
+				xlog_hex( LOG_CAT_TABLES, &Data[p1 + 6], tmp, 9 );
 				tmp =
 				p1 = p1 + tmp + 6;
 				break;
 			default:
-				printf("ERROR A5 A6 A7 0x%x\n", Data[p1]);
+				elog( LOG_CAT_TABLES, "ERROR A5 A6 A7 0x%x\n", Data[p1]);
 				exit(0);
 				break;
 			}
@@ -1726,17 +6023,10 @@ void process_epg_test_a5_a6_a7( uint8_t *Data, int Length )
 void process_epg_test_b5( uint8_t *Data, int Length )
 {
 	uint8_t SatelliteCountryCode[4];
-	int i, n;
 	int tmp;
-	printf("epg_test: TODO\n");  
-		printf("MATCHB5 ");
-		for(n = 0; n < 0x1c; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+	dlog( LOG_CAT_TABLES, "epg_test: TODO\n");  
+		xlog( LOG_CAT_TABLES, "MATCHB5 ");
+		xlog_hex( LOG_CAT_TABLES, Data, 0x1c, 32 );
 	/* Offset i == 11 seems to be good */
 	//  if ((Data[0x12] == 0) && (Data[0x13] == 0) )
 	if (1) {
@@ -1760,18 +6050,12 @@ void process_epg_test_b5( uint8_t *Data, int Length )
 			int SatelliteTimeOffsetPolarity;
 			int SatelliteTimeOffsetH;
 			int SatelliteTimeOffsetM;
-			printf("\nDescriptorTag = 0x%x\n", DescriptorTag);
-			printf("\nDescriptorLength = 0x%x\n", DescriptorLength);
-			printf("\nHuffLength = 0x%x\n", HuffLength);
+			dlog( LOG_CAT_TABLES, "\nDescriptorTag = 0x%x\n", DescriptorTag);
+			dlog( LOG_CAT_TABLES, "\nDescriptorLength = 0x%x\n", DescriptorLength);
+			dlog( LOG_CAT_TABLES, "\nHuffLength = 0x%x\n", HuffLength);
 			switch( DescriptorTag ) {
 			case 0xb9:
-				for(n = 0; n < DescriptorLength; n++) {
-					printf("%02x ", Data[p1 + n]);
-					if ((n % 32) == 31) {
-						printf("\n");
-					}
-				}
-				printf("\n");
+				xlog_hex( LOG_CAT_TABLES, &Data[p1], DescriptorLength, 32 );
 	/* Offset i == 11 seems to be good */
 //		tmp = decode_huffman_code(&Data[p1 + 4], HuffLength, buffer_for_decode);
 //		printf("Title:%d:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
@@ -1785,7 +6069,7 @@ void process_epg_test_b5( uint8_t *Data, int Length )
 	/* Offset i == 11 seems to be good */
 				break;
 			default:
-				printf( "ERROR 0x%02x\n", DescriptorTag );
+				elog( LOG_CAT_TABLES, "ERROR 0x%02x\n", DescriptorTag );
 				return;
 				break;
 			}
@@ -1805,17 +6089,11 @@ void process_epg_test_b5( uint8_t *Data, int Length )
 void process_epg_test_b6( uint8_t *Data, int Length )
 {
 	uint8_t SatelliteCountryCode[4];
-	int i, n;
+	int n;
 	int tmp;
-	printf("epg_test: TODO\n");  
-		printf("MATCHB6 ");
-		for(n = 0; n < 0x1c; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+	dlog( LOG_CAT_TABLES, "epg_test: TODO\n");  
+		xlog( LOG_CAT_TABLES, "MATCHB6 ");
+		xlog_hex( LOG_CAT_TABLES, Data, 0x1c, 32 );
 	/* Offset i == 11 seems to be good */
 //  if ((Data[0x12] == 0) && (Data[0x13] == 0) )
   if (0)
@@ -1827,7 +6105,7 @@ void process_epg_test_b6( uint8_t *Data, int Length )
     int DescriptorsLoopLength = ( ( Data[8] & 0x0f ) << 8 ) | Data[9];
 		for(n = 0; n < 0x400; n++) {
 			tmp = decode_huffman_code(&Data[n + 4], 0x20, buffer_for_decode);
-			printf("Title:0x%x:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
+			dlog( LOG_CAT_TABLES, "Title:0x%x:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
 			//tmp = Data[n] + n;
 			//printf("MATCH n = 0x%x, tmp = 0x%x\n", n, tmp);
 		}
@@ -1842,22 +6120,16 @@ void process_epg_test_b6( uint8_t *Data, int Length )
       int SatelliteTimeOffsetPolarity;
       int SatelliteTimeOffsetH;
       int SatelliteTimeOffsetM;
-	printf("\nDescriptorTag = 0x%x\n", DescriptorTag);
-	printf("\nDescriptorLength = 0x%x\n", DescriptorLength);
-	printf("\nHuffLength = 0x%x\n", HuffLength);
+	dlog( LOG_CAT_TABLES, "\nDescriptorTag = 0x%x\n", DescriptorTag);
+	dlog( LOG_CAT_TABLES, "\nDescriptorLength = 0x%x\n", DescriptorLength);
+	dlog( LOG_CAT_TABLES, "\nHuffLength = 0x%x\n", HuffLength);
       switch( DescriptorTag )
       {
         case 0xb0:
-		for(n = 0; n < 11; n++) {
-			printf("%02x ", Data[p1 + n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+		xlog_hex( LOG_CAT_TABLES, &Data[p1], 11, 32 );
 	/* Offset i == 11 seems to be good */
 		tmp = decode_huffman_code(&Data[p1 + 4], HuffLength, buffer_for_decode);
-		printf("Title:%d:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
+		dlog( LOG_CAT_TABLES, "Title:%d:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
 
 
 //		for(n = 0; n < HuffLength; n++) {
@@ -1883,17 +6155,11 @@ void process_epg_test_b6( uint8_t *Data, int Length )
 void process_epg_test_c2( uint8_t *Data, int Length )
 {
 	uint8_t SatelliteCountryCode[4];
-	int i, n;
+	int n;
 	int tmp;
-	printf("epg_test: TODO\n");  
-		printf("MATCHC2 ");
-		for(n = 0; n < 0x1c; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+	dlog( LOG_CAT_TABLES, "epg_test: TODO\n");  
+		xlog( LOG_CAT_TABLES, "MATCHC2 ");
+		xlog_hex( LOG_CAT_TABLES, Data, 0x1c, 32 );
 	/* Offset i == 11 seems to be good */
 //  if ((Data[0x12] == 0) && (Data[0x13] == 0) )
   if (0)
@@ -1905,11 +6171,11 @@ void process_epg_test_c2( uint8_t *Data, int Length )
     int DescriptorsLoopLength = ( ( Data[8] & 0x0f ) << 8 ) | Data[9];
 		for(n = 0; n < 0x46; n++) {
 			tmp = decode_huffman_code(&Data[n + 4], 0x46 - n, buffer_for_decode);
-			printf("Title:0x%x:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
+			dlog( LOG_CAT_TABLES, "Title:0x%x:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
 			//tmp = Data[n] + n;
 			//printf("MATCH n = 0x%x, tmp = 0x%x\n", n, tmp);
 		}
-		printf("\n");
+		xlog( LOG_CAT_TABLES, "\n");
 	/* Offset i == 11 seems to be good */
 //    int p1 = 0x46;
     int p1 = 0x24;
@@ -1921,22 +6187,16 @@ void process_epg_test_c2( uint8_t *Data, int Length )
       int SatelliteTimeOffsetPolarity;
       int SatelliteTimeOffsetH;
       int SatelliteTimeOffsetM;
-	printf("\nDescriptorTag = 0x%x\n", DescriptorTag);
-	printf("\nDescriptorLength = 0x%x\n", DescriptorLength);
-	printf("\nHuffLength = 0x%x\n", HuffLength);
+	dlog( LOG_CAT_TABLES, "\nDescriptorTag = 0x%x\n", DescriptorTag);
+	dlog( LOG_CAT_TABLES, "\nDescriptorLength = 0x%x\n", DescriptorLength);
+	dlog( LOG_CAT_TABLES, "\nHuffLength = 0x%x\n", HuffLength);
       switch( DescriptorTag )
       {
         case 0xb0:
-		for(n = 0; n < 11; n++) {
-			printf("%02x ", Data[p1 + n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+		xlog_hex( LOG_CAT_TABLES, &Data[p1], 11, 32 );
 	/* Offset i == 11 seems to be good */
 		tmp = decode_huffman_code(&Data[p1 + 4], HuffLength, buffer_for_decode);
-		printf("Title:%d:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
+		dlog( LOG_CAT_TABLES, "Title:%d:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
 
 
 //		for(n = 0; n < HuffLength; n++) {
@@ -1961,17 +6221,10 @@ void process_epg_test_c2( uint8_t *Data, int Length )
 void process_epg_test_c1( uint8_t *Data, int Length )
 {
 	uint8_t SatelliteCountryCode[4];
-	int i, n;
 	int tmp;
-	printf("epg_test: TODO\n");  
-		printf("MATCHC1 ");
-		for(n = 0; n < 0x1c; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+	dlog( LOG_CAT_TABLES, "epg_test: TODO\n");  
+		xlog( LOG_CAT_TABLES, "MATCHC1 ");
+		xlog_hex( LOG_CAT_TABLES, Data, 0x1c, 32 );
 	/* Offset i == 11 seems to be good */
 //  if ((Data[0x12] == 0) && (Data[0x13] == 0) )
   if (1) {
@@ -1986,24 +6239,18 @@ void process_epg_test_c1( uint8_t *Data, int Length )
 //			//tmp = Data[n] + n;
 //			//printf("MATCH n = 0x%x, tmp = 0x%x\n", n, tmp);
 //		}
-		printf("\n");
+		xlog( LOG_CAT_TABLES, "\n");
 	/* Offset i == 11 seems to be good */
 //    int p1 = 0x46;
 	int p1 = 0x8;
 	while( p1 < Length ) {
-		for(n = 0; n < 9; n++) {
-			printf("%02x ", Data[p1 + n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+		xlog_hex( LOG_CAT_TABLES, &Data[p1], 9, 32 );
 	        unsigned short int Sid = ( Data[p1] << 8 ) | Data[p1 + 1];
 	        unsigned short int Info = Data[p1 + 2];
 	        unsigned short int ChannelId = ( Data[p1 + 3] << 8 ) | Data[p1 + 4];
 	        unsigned short int SkyNumber = ( Data[p1 + 5] << 8 ) | Data[p1 + 6];
 		/* FIXME: JCD Not really sure what this SkyNumber2 is. */
-	        printf( "Sid2 = 0x%x, ChannelId = 0x%x, Info = 0x%x, SkyNumber2 = 0x%x , %d\n", Sid, ChannelId, Info, SkyNumber, SkyNumber );
+	        dlog( LOG_CAT_TABLES, "Sid2 = 0x%x, ChannelId = 0x%x, Info = 0x%x, SkyNumber2 = 0x%x , %d\n", Sid, ChannelId, Info, SkyNumber, SkyNumber );
 	/* Offset i == 11 seems to be good */
 //		tmp = decode_huffman_code(&Data[p1 + 4], HuffLength, buffer_for_decode);
 //		printf("Title:%d:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
@@ -2038,27 +6285,21 @@ void process_epg_test_c0( uint8_t *Data, int Length )
 	uint16_t ChannelId;
 	uint16_t MjdTime;
 	uint16_t EventId;
-	printf("epg_test: TODO Length=0x%x\n", Length);  
-		printf("MATCHC0 ");
-		for(n = 0; n < 0x28; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+	dlog( LOG_CAT_TABLES, "epg_test: TODO Length=0x%x\n", Length);  
+		xlog( LOG_CAT_TABLES, "MATCHC0 ");
+		xlog_hex( LOG_CAT_TABLES, Data, 0x28, 32 );
 
-	printf("Offset 0x01: %x\n", Data[1]);
-	printf("Offset 0x03: %x\n", Data[3]);
+	dlog( LOG_CAT_TABLES, "Offset 0x01: %x\n", Data[1]);
+	dlog( LOG_CAT_TABLES, "Offset 0x03: %x\n", Data[3]);
 	id = Data[4];
-	printf("Offset 0x04 (Unique ID): %x\n", id);
-	printf("Offset 0x05: %x\n", Data[5]);
-	printf("Offset 0x15: %x\n", Data[0x15]);
+	dlog( LOG_CAT_TABLES, "Offset 0x04 (Unique ID): %x\n", id);
+	dlog( LOG_CAT_TABLES, "Offset 0x05: %x\n", Data[5]);
+	dlog( LOG_CAT_TABLES, "Offset 0x15: %x\n", Data[0x15]);
 	offset = Data[0x10] << 24 | Data[0x11] << 16 | Data[0x12] << 8 | Data[0x13];
 	total_length = Data[0x14] << 24 | Data[0x15] << 16 | Data[0x16] << 8 | Data[0x17];
-	printf("offset (0x10): %x\n", offset);
-	printf("total length (0x14): %x\n", total_length);
-	printf("Offset 0x18 (payload type when offset == 0)): %x\n", Data[0x18]);
+	dlog( LOG_CAT_TABLES, "offset (0x10): %x\n", offset);
+	dlog( LOG_CAT_TABLES, "total length (0x14): %x\n", total_length);
+	dlog( LOG_CAT_TABLES, "Offset 0x18 (payload type when offset == 0)): %x\n", Data[0x18]);
 
 	if (Data[3] == 1) {
 		if (offset == 0) {
@@ -2068,7 +6309,7 @@ void process_epg_test_c0( uint8_t *Data, int Length )
 			section_c0[id].summary = calloc( 1, total_length);
 			section_c0[id].summary_length = total_length;
 			memcpy( &section_c0[id].summary[0], &Data[0x18], tmp);
-			printf("ID:0x%x, offset = 0x%x, len=0x%x, total=0x%x\n",
+			dlog( LOG_CAT_TABLES, "ID:0x%x, offset = 0x%x, len=0x%x, total=0x%x\n",
 				id, offset, tmp, total_length);
 		}
 		if ((offset != 0) && (section_c0[id].total_length != 0)) {
@@ -2076,10 +6317,10 @@ void process_epg_test_c0( uint8_t *Data, int Length )
 				tmp = Length - 0x18;
 				memcpy( &section_c0[id].summary[offset], &Data[0x18], tmp);
 				section_c0[id].offset += tmp;
-				printf("ID:0x%x, offset = 0x%x, len=0x%x, total=0x%x\n",
+				dlog( LOG_CAT_TABLES, "ID:0x%x, offset = 0x%x, len=0x%x, total=0x%x\n",
 					id, offset, tmp, total_length);
 			} else {
-				printf("ID FAILED:0x%x, offset = 0x%x, len=0x%x, total=0x%x\n",
+				elog( LOG_CAT_TABLES, "ID FAILED:0x%x, offset = 0x%x, len=0x%x, total=0x%x\n",
 					id, offset, tmp, total_length);
 			}
 		}
@@ -2087,9 +6328,9 @@ void process_epg_test_c0( uint8_t *Data, int Length )
     			int DescriptorsLoopLength = section_c0[id].total_length;
 			data2 = section_c0[id].summary;
 			for(n = 0; n < 0x40; n++) {
-				printf("%02x ", data2[n]);
+				xlog( LOG_CAT_TABLES, "%02x ", data2[n]);
 				if ((n % 32) == 31) {
-					printf("\n");
+					xlog( LOG_CAT_TABLES, "\n");
 				}
 			}
 //printf("ID:0x%x FINISHED\n", id);
@@ -2107,7 +6348,7 @@ void process_epg_test_c0( uint8_t *Data, int Length )
 			while( p1 < section_c0[id].total_length ) {
 				int DescriptorLength = data2[p1 + 1];
 				if (DescriptorLength == 0) {
-					printf("Skipping 4\n");
+					dlog( LOG_CAT_TABLES, "Skipping 4\n");
 					//p1 += 4;
 				}
 				int Unknown1 = ( data2[p1 - 4] << 8 ) | data2[p1 - 3];
@@ -2116,89 +6357,89 @@ void process_epg_test_c0( uint8_t *Data, int Length )
 				DescriptorLength = data2[p1 + 1];
 				int HuffTag = data2[p1 + 2];
 				int HuffLength = data2[p1 + 3];
-				printf("\nUnknown = 0x%x\n", Unknown1);
-				printf("EventId = 0x%x\n", EventId);
-				printf("DescriptorTag = 0x%x\n", DescriptorTag);
-				printf("DescriptorLength = 0x%x\n", DescriptorLength);
-				printf("HuffTag = 0x%x\n", HuffTag);
-				printf("HuffLength = 0x%x\n", HuffLength);
-				printf("p1= 0x%x\n", p1);
+				dlog( LOG_CAT_TABLES, "\nUnknown = 0x%x\n", Unknown1);
+				dlog( LOG_CAT_TABLES, "EventId = 0x%x\n", EventId);
+				dlog( LOG_CAT_TABLES, "DescriptorTag = 0x%x\n", DescriptorTag);
+				dlog( LOG_CAT_TABLES, "DescriptorLength = 0x%x\n", DescriptorLength);
+				dlog( LOG_CAT_TABLES, "HuffTag = 0x%x\n", HuffTag);
+				dlog( LOG_CAT_TABLES, "HuffLength = 0x%x\n", HuffLength);
+				dlog( LOG_CAT_TABLES, "p1= 0x%x\n", p1);
 				switch( HuffTag ) {
 				case 0xb9:
 					for(n = -4; n < DescriptorLength + 4; n++) {
-						printf("%02x ", data2[p1 + n]);
+						xlog( LOG_CAT_TABLES, "%02x ", data2[p1 + n]);
 						if ((n % 32) == 31) {
-							printf("\n");
+							xlog( LOG_CAT_TABLES, "\n");
 						}
 					}
-					printf("\n");
+					xlog( LOG_CAT_TABLES, "\n");
 					tmp = decode_huffman_code(&data2[p1 + 4], HuffLength, buffer_for_decode);
-					printf("TitleC0:%d:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
+					dlog( LOG_CAT_TABLES, "TitleC0:%d:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
 					break;
 				case 0xa8:
 				case 0xa9:
 				case 0xaa:
 				case 0xab:
 					/* Have to work out what really determine the space between a 0xa8-0xab and a 0xb9.*/
-					printf("MATCHC01:");
+					xlog( LOG_CAT_TABLES, "MATCHC01:");
 					for(n = -7; n < 0x0a + 8; n++) {
-						printf("%02x ", data2[p1 + n]);
+						xlog( LOG_CAT_TABLES, "%02x ", data2[p1 + n]);
 						if ((n % 32) == 31) {
-							printf("\n");
+							xlog( LOG_CAT_TABLES, "\n");
 						}
 					}
-					printf("\n");
+					xlog( LOG_CAT_TABLES, "\n");
 					p1 += 0x02;
 					ChannelId = ( data2[p1 + 3] << 8 ) | data2[p1 + 4];
 					MjdTime = ( ( data2[p1 + 8] << 8 ) | data2[p1 + 9] );
-					printf("MATCHC01: ChannelID = 0x%x, MjdTime = 0x%x\n", ChannelId, MjdTime);
+					dlog( LOG_CAT_TABLES, "MATCHC01: ChannelID = 0x%x, MjdTime = 0x%x\n", ChannelId, MjdTime);
 					p1 += 0x08;
 					DescriptorLength = 0;
 					break;
 				case 0xd0:
-					printf( "d0-Descriptor Tag=0x%02x, HuffTag=0x%x, offset=0x%x\n", DescriptorTag, HuffTag, p1 );
+					dlog( LOG_CAT_TABLES, "d0-Descriptor Tag=0x%02x, HuffTag=0x%x, offset=0x%x\n", DescriptorTag, HuffTag, p1 );
 					tmp = DescriptorLength + 4;
 					if (tmp + p1 > section_c0[id].total_length) {
-						printf("Overflowed\n");
+						elog( LOG_CAT_TABLES, "Overflowed\n");
 						tmp = section_c0[id].total_length - p1;
 					}
 					for(n = -4; n < tmp; n++) {
-						printf("%02x ", data2[p1 + n]);
+						xlog( LOG_CAT_TABLES, "%02x ", data2[p1 + n]);
 						if ((n % 16) == 15) {
 							for(i = 0; i < 16; i++) {
 								tmp = data2[p1 -16 - 4 + n + i];
 								if (tmp < 32 || tmp > 127) {
 									tmp='.';
 								}
-								printf("%c ", tmp);
+								xlog( LOG_CAT_TABLES, "%c ", tmp);
 							} 
-							printf("\n");
+							xlog( LOG_CAT_TABLES, "\n");
 						}
 					}
-					printf("\n");
+					xlog( LOG_CAT_TABLES, "\n");
 					for(n = 0; n < 0x46; n++) {
 						tmp = decode_huffman_code(&data2[p1 + n], 0x46, buffer_for_decode);
-						printf("TitleC02:0x%x:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
+						dlog( LOG_CAT_TABLES, "TitleC02:0x%x:%d:%s:::::::%s\n", n, tmp, DecodeText, DecodeErrorText);
 						//tmp = Data[n] + n;
 						//printf("MATCH n = 0x%x, tmp = 0x%x\n", n, tmp);
 					}
-					printf("\n");
+					xlog( LOG_CAT_TABLES, "\n");
 	/* Offset i == 11 seems to be good */
 	  				break;
 				default:
-					printf( "C0-Descriptor unknown Tag=0x%02x, HuffTag=0x%x, offset=0x%x\n", DescriptorTag, HuffTag, p1 );
+					dlog( LOG_CAT_TABLES, "C0-Descriptor unknown Tag=0x%02x, HuffTag=0x%x, offset=0x%x\n", DescriptorTag, HuffTag, p1 );
 					tmp = DescriptorLength + 4;
 					if (tmp + p1 > section_c0[id].total_length) {
-						printf("Overflowed\n");
+						elog( LOG_CAT_TABLES, "Overflowed\n");
 						tmp = section_c0[id].total_length - p1;
 					}
 					for(n = -4; n < tmp; n++) {
-						printf("%02x ", data2[p1 + n]);
+						xlog( LOG_CAT_TABLES, "%02x ", data2[p1 + n]);
 						if ((n % 32) == 31) {
-							printf("\n");
+							xlog( LOG_CAT_TABLES, "\n");
 						}
 					}
-					printf("\n");
+					xlog( LOG_CAT_TABLES, "\n");
 	  				break;
 				}
 				p1 += ( DescriptorLength + 4 );
@@ -2228,16 +6469,9 @@ b2 87 1d 01 30 22 af d5 50 b2 86 ab 8c 21 f4 2a 40 da ae 30 24 d5 71 82 27 d6 60
 /* This is really process_sdt_actual, but need to merge it */
 void process_epg_suppliment_channels(uint8_t *Data, int Length)
 {
-	int n;
 
-	printf("MATCHSUP0 ");
-	for(n = 0; n < Length; n++) {
-		printf("%02x ", Data[n]);
-		if ((n % 32) == 31) {
-			printf("\n");
-		}
-	}
-	printf("\n");
+	xlog( LOG_CAT_BAT, "MATCHSUP0 ");
+	xlog_hex( LOG_CAT_BAT, Data, Length, 32 );
 #if 0
 	/* Offset i == 11 seems to be good */
     if (!EndBAT) {
@@ -2246,7 +6480,7 @@ void process_epg_suppliment_channels(uint8_t *Data, int Length)
 
     if (EndSDT) {
 	//Filters[FilterId].Step = 2;
-	printf("endsdt");
+	dlog( LOG_CAT_BAT, "endsdt");
 	return;
     }
 
@@ -2348,16 +6582,10 @@ void process_epg_suppliment_channels(uint8_t *Data, int Length)
 void process_epg_time_offset( uint8_t *Data, int Length )
 {
 	uint8_t SatelliteCountryCode[4];
-	int i, n;
-	printf("Time_offset: TODO\n");  
-		printf("MATCHTO0 ");
-		for(n = 0; n < 0x1c; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+	int i;
+	dlog( LOG_CAT_TABLES, "Time_offset: TODO\n");  
+		xlog( LOG_CAT_TABLES, "MATCHTO0 ");
+		xlog_hex( LOG_CAT_TABLES, Data, 0x1c, 32 );
 	/* Offset i == 11 seems to be good */
   if( Data[0] == 0x73 )
   {
@@ -2375,7 +6603,7 @@ void process_epg_time_offset( uint8_t *Data, int Length )
       int SatelliteTimeOffsetPolarity;
       int SatelliteTimeOffsetH;
       int SatelliteTimeOffsetM;
-	printf("\nDescriptorLength = 0x%x\n", DescriptorLength);
+	dlog( LOG_CAT_TABLES, "\nDescriptorLength = 0x%x\n", DescriptorLength);
       switch( DescriptorTag )
       {
         case 0x58:
@@ -2420,22 +6648,54 @@ void process_epg_time_offset( uint8_t *Data, int Length )
 //  Filters[FilterId].Step = 2;
 }
 
+static inline void section_tracker_init( struct section_tracker_s *T )
+{
+	memset( T->received, 0, sizeof( T->received ) );
+	T->last_section_number = -1;
+	T->outstanding = 0;
+}
+
+/* Note section Number of a table that goes up to section Last. Returns 1
+ * if it is new. *Outstanding is shared by the tables of a set and counts
+ * the sections they still miss. A different Last means the table changed,
+ * it starts again.
+ */
+static inline int section_tracker_mark( struct section_tracker_s *T, uint8_t Number, uint8_t Last, uint32_t *Outstanding )
+{
+	uint64_t bit = 1ULL << ( Number & 63 );
+
+	if( T->last_section_number != Last ) {
+		*Outstanding -= T->outstanding;
+		memset( T->received, 0, sizeof( T->received ) );
+		T->last_section_number = Last;
+		T->outstanding = Last + 1;
+		*Outstanding += T->outstanding;
+	}
+	if( Number > Last || ( T->received[Number >> 6] & bit ) ) {
+		return 0;
+	}
+	T->received[Number >> 6] |= bit;
+	T->outstanding--;
+	( *Outstanding )--;
+	return 1;
+}
+
+static inline int section_tracker_complete( const struct section_tracker_s *T )
+{
+	return T->last_section_number >= 0 && !T->outstanding;
+}
+
 int process_epg_channels( unsigned char *Data, int Length )
 {
-	int i, ii, n;
+	struct bouquet_s *B;
+	uint16_t n;
 	unsigned char SectionNumber = Data[6];
 	unsigned char LastSectionNumber = Data[7];
-	printf("MATCHCH0 ");
-	for(n = 0; n < 0x1c; n++) {
-		printf("%02x ", Data[n]);
-		if ((n % 32) == 31) {
-			printf("\n");
-		}
-	}
-	printf("\n");
+	xlog( LOG_CAT_BAT, "MATCHCH0 ");
+	xlog_hex( LOG_CAT_BAT, Data, 0x1c, 32 );
 	/* Offset i == 11 seems to be good */
 
-	printf("Channels: Data[0] = 0x%x, SectionNumber = 0x%x, LastSectionNumber = 0x%x.\n", Data[0], SectionNumber, LastSectionNumber);  
+	dlog( LOG_CAT_BAT, "Channels: Data[0] = 0x%x, SectionNumber = 0x%x, LastSectionNumber = 0x%x.\n", Data[0], SectionNumber, LastSectionNumber);  
 	if( SectionNumber == 0x00 && nBouquets == 0 ) {
 		return 0;
 	}
@@ -2446,12 +6706,12 @@ int process_epg_channels( unsigned char *Data, int Length )
 			//Filters[FilterId].Step = 2;
 			return 0;
 		}
-		printf("Channels: Bouquets\n");
+		dlog( LOG_CAT_BAT, "Channels: Bouquets\n");
 		unsigned short int BouquetId = ( Data[3] << 8 ) | Data[4];
 		int BouquetDescriptorsLength = ( ( Data[8] & 0x0f ) << 8 ) | Data[9];
 		int TransportStreamLoopLength = ( ( Data[BouquetDescriptorsLength+10] & 0x0f ) << 8 ) | Data[BouquetDescriptorsLength+11];
 		int p1 = ( BouquetDescriptorsLength + 12 );
-		printf("Channels: BouquetID = 0x%x, BouquetDescLength = 0x%x, TransportStreamLoopLen = 0x%x, p1 = 0x%x\n", BouquetId, BouquetDescriptorsLength, TransportStreamLoopLength, p1);
+		dlog( LOG_CAT_BAT, "Channels: BouquetID = 0x%x, BouquetDescLength = 0x%x, TransportStreamLoopLen = 0x%x, p1 = 0x%x\n", BouquetId, BouquetDescriptorsLength, TransportStreamLoopLength, p1);
 		while( TransportStreamLoopLength > 0 ) {
 			unsigned short int Tid = ( Data[p1] << 8 ) | Data[p1+1];
 			unsigned short int Nid = ( Data[p1+2] << 8 ) | Data[p1+3];
@@ -2467,7 +6727,7 @@ int process_epg_channels( unsigned char *Data, int Length )
 				TransportDescriptorsLength -= ( DescriptorLength + 2 );
 				switch( DescriptorTag ) {
 				case 0xb1:
-					printf( "Found Tag 0x%02x\n", DescriptorTag );
+					dlog( LOG_CAT_BAT, "Found Tag 0x%02x\n", DescriptorTag );
 					p3 += 2;
 					DescriptorLength -= 2;
 					while( DescriptorLength > 0 ) {
@@ -2480,7 +6740,8 @@ int process_epg_channels( unsigned char *Data, int Length )
 						uint16_t Info = Data[p3 + 2];
 						uint16_t ChannelId = ( Data[p3 + 3] << 8 ) | Data[p3 + 4];
 						uint16_t SkyNumber = ( Data[p3 + 5] << 8 ) | Data[p3 + 6];
-						printf( "Sid = 0x%x, ChannelId = 0x%x, Info = 0x%x, SkyNumber = 0x%x , %d\n", Sid, ChannelId, Info, SkyNumber, SkyNumber );
+						dlog( LOG_CAT_BAT, "Sid = 0x%x, ChannelId = 0x%x, Info = 0x%x, SkyNumber = 0x%x , %d\n", Sid, ChannelId, Info, SkyNumber, SkyNumber );
+						channel_filter_resolve( &channel_filter, ChannelId, Sid, SkyNumber );
 						//if( SkyNumber > 100 && SkyNumber < 1000 )
 						{
 							if( ChannelId > 0 ) {
@@ -2489,17 +6750,15 @@ int process_epg_channels( unsigned char *Data, int Length )
 								Key.Nid = Nid;
 								Key.Tid = Tid;
 								Key.Sid = Sid;
-								printf("nChannels=0x%x, ChannelID=0x%x, Nid=0x%x, Tid=0x%x, Sid=0x%x, C=%p\n", nChannels, ChannelId, Nid, Tid, Sid, C);
-								if (channels_all[ChannelId] == 0xffff) {
-									channels_all[ChannelId] = nChannels;
-									nChannels ++;
-									if( nChannels >= MAX_CHANNELS ) {
-										printf( "Channels: Error, channels found more than %i", MAX_CHANNELS );
-										return 0;
-									}
+								dlog( LOG_CAT_BAT, "nChannels=0x%x, ChannelID=0x%x, Nid=0x%x, Tid=0x%x, Sid=0x%x, C=%p\n", nChannels, ChannelId, Nid, Tid, Sid, C);
+								C = channel_add(ChannelId);
+								if (!C) {
+									elog( LOG_CAT_BAT, "Channels: Error, out of memory for channels\n" );
+									return 0;
+								}
+								if (C->Nid != Nid || C->Tid != Tid || C->Sid != Sid) {
+									join.stale = 1;
 								}
-								C = &lChannels[channels_all[ChannelId]];
-								C->ChannelId = ChannelId;
 								C->Nid = Nid;
 								C->Tid = Tid;
 								C->Sid = Sid;
@@ -2521,38 +6780,30 @@ int process_epg_channels( unsigned char *Data, int Length )
 					}
 					break;
 					default:
-						printf( "Channels: Unknown Tag 0x%02x\n", DescriptorTag );
+						dlog( LOG_CAT_BAT, "Channels: Unknown Tag 0x%02x\n", DescriptorTag );
 						break;
 				}
 			}
 		}
 		//	return 1; /* FIXME: JCD */
-		struct bouquet_s *B;
-		for( i = 0; i < nBouquets; i ++ ) {
-			B = ( lBouquets + i );
-			if( B->BouquetId == BouquetId ) {
-				goto CheckBouquetSections;
-			}
-		}
-		B = ( lBouquets + nBouquets );
-		B->BouquetId = BouquetId;
-		for( i = 0; i <= LastSectionNumber; i ++ ) {
-			B->SectionNumber[i] = -1;
-		}
-		B->LastSectionNumber = LastSectionNumber;
-		nBouquets ++;
-		CheckBouquetSections:;
-		B->SectionNumber[SectionNumber] = SectionNumber;
-		EndBAT = 1;
-		for( i = 0; i < nBouquets; i ++ ) {
-			B = ( lBouquets + i );
-			for( ii = 0; ii <= B->LastSectionNumber; ii ++ ) {
-				if( B->SectionNumber[ii] == -1 ) {
-					EndBAT = 0;
-					break;
-				}
+		n = id_map_find( &bouquets_by_id, BouquetId );
+		if( n == ID_MAP_NONE ) {
+			if( !table_reserve( ( void ** ) &lBouquets, &bouquets_size, nBouquets, sizeof( struct bouquet_s ) ) ||
+				!id_map_add( &bouquets_by_id, BouquetId, nBouquets ) ) {
+				elog( LOG_CAT_BAT, "Channels: Error, out of memory for bouquets\n" );
+				return 0;
 			}
+			n = nBouquets++;
+			lBouquets[n].BouquetId = BouquetId;
+			section_tracker_init( &lBouquets[n].sections );
 		}
+		B = &lBouquets[n];
+		if( section_tracker_mark( &B->sections, SectionNumber, LastSectionNumber, &bat_outstanding ) &&
+			section_tracker_complete( &B->sections ) ) {
+			dlog( LOG_CAT_BAT, "Channels: bouquet 0x%x complete, %u sections\n", BouquetId, LastSectionNumber + 1 );
+		}
+		/* Every bouquet seen so far is complete */
+		EndBAT = !bat_outstanding;
 	}
 	return 1;
 }
@@ -2571,48 +6822,43 @@ int process_epg_titles(uint8_t * Data, int Length) {
 	int Len1;
 	int Len2;
 	int p;
-	int n;
 	int tmp;
 	struct channel_s *C;
-	int found;
+	uint32_t row;
+	uint32_t title_id;
+	int pos;
+	int changed;
 	struct tm tm1, *tm2;
 	tm2 = &tm1;
 
-		printf("MATCHT0 ");
-		for(n = 0; n < 0x1c; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+		xlog( LOG_CAT_TITLES, "MATCHT0 ");
+		xlog_hex( LOG_CAT_TITLES, Data, 0x1c, 32 );
 	if (Length < 0x16) {
-		printf("ERROR Title too short. Length=0x%04x\n", Length);
+		elog( LOG_CAT_TITLES, "ERROR Title too short. Length=0x%04x\n", Length);
 		return 1;
 	}
 	/* Offset i == 11 seems to be good */
 	ChannelId = ( Data[3] << 8 ) | Data[4];
-/* FIXME: JCD temp added */
-	if (ChannelId != 0x540) return;
+	/* Drop unwanted channels before any huffman work */
+	if (!channel_wanted(ChannelId)) {
+		channel_filter.skipped++;
+		return 1;
+	}
 	MjdTime = ( ( Data[8] << 8 ) | Data[9] );
 	group_time = ( ( MjdTime - 40587 ) * 86400 );
 	tm2 = gmtime_r(&group_time, &tm1);
-	printf("Titles: ChannelID = 0x%x, group_time = %lx, MjdTime = %04d-%02d-%02d %02d:%02d:%02d\n", ChannelId,
+	dlog( LOG_CAT_TITLES, "Titles: ChannelID = 0x%x, group_time = %lx, MjdTime = %04d-%02d-%02d %02d:%02d:%02d\n", ChannelId,
 				group_time,
 				tm1.tm_year + 1900, tm1.tm_mon + 1, tm1.tm_mday,
 				tm1.tm_hour, tm1.tm_min, tm1.tm_sec);
 	if( ChannelId > 0 ) {
-		if (channels_all[ChannelId] == 0xffff) {
-			channels_all[ChannelId] = nChannels;
-			nChannels ++;
-			if( nChannels >= MAX_CHANNELS ) {
-				printf( "Titles: Error, channels found more than %i", MAX_CHANNELS );
-				return 0;
-			}
+		C = channel_add(ChannelId);
+		if (!C) {
+			elog( LOG_CAT_TITLES, "Titles: Error, out of memory for channels\n" );
+			return 0;
 		}
-		C = &lChannels[channels_all[ChannelId]];
-		C->ChannelId = ChannelId;
 		if( MjdTime > 0 ) {
+			channel_carousel_section(C, CAROUSEL_TITLES, (MjdTime << 16) | (Data[10] << 8) | Data[11]);
 			p = 10;
 			loop1:;
 			//sSummary *S = ( lSummaries + nSummaries );
@@ -2620,19 +6866,19 @@ int process_epg_titles(uint8_t * Data, int Length) {
 			//S->MjdTime = MjdTime;
 			EventId = ( Data[p] << 8 ) | Data[p + 1];
 			Len1 = ( ( Data[p + 2] & 0x0f ) << 8 ) | Data[p + 3];
-			printf("Titles: ChannelID = 0x%x, EventID = 0x%x, Len1 = 0x%x\n", ChannelId, EventId, Len1);
+			dlog( LOG_CAT_TITLES, "Titles: ChannelID = 0x%x, EventID = 0x%x, Len1 = 0x%x\n", ChannelId, EventId, Len1);
 			//if( Data[p + 4] != 0xb5 ) {
 			//	printf("LoadEPG: Data error signature for titles Data[p+4] == 0x%x\n", Data[p + 4]);
 			//	goto endloop1;
 			//}
-			printf("LoadEPG: Data signature for titles Data[p+4] == 0x%x\n", Data[p + 4]);
+			dlog( LOG_CAT_TITLES, "LoadEPG: Data signature for titles Data[p+4] == 0x%x\n", Data[p + 4]);
 			if( Len1 > Length ) {
-				printf("LoadEPG: Data error length for titles\n");
+				elog( LOG_CAT_TITLES, "LoadEPG: Data error length for titles\n");
 				goto endloop1;
 			}
 			p += 4;
 			Len2 = Data[p + 1] - 7;
-			printf("Titles: Len2 = 0x%x\n", Len2);
+			dlog( LOG_CAT_TITLES, "Titles: Len2 = 0x%x\n", Len2);
 			/* This event_offset_word data is a 16bit unsigned integer. */
 			/* Event start times can be less that MjdTime */
 			/* If it is >0xc000 treat it as negative. */
@@ -2649,7 +6895,7 @@ int process_epg_titles(uint8_t * Data, int Length) {
 			theme_id = Data[p + 6];
 					
 			tm2 = gmtime_r(&start_time, &tm1);
-			printf("Titles: ChannelID2 = 0x%x, event_offset_word = 0x%x, event_offset_time = 0x%lx, starttime=0x%lx, StartTime = %04d-%02d-%02d %02d:%02d:%02d, Duration = 0x%x, ThemeID = 0x%x\n",
+			dlog( LOG_CAT_TITLES, "Titles: ChannelID2 = 0x%x, event_offset_word = 0x%x, event_offset_time = 0x%lx, starttime=0x%lx, StartTime = %04d-%02d-%02d %02d:%02d:%02d, Duration = 0x%x, ThemeID = 0x%x\n",
 				ChannelId,
 				event_offset_word,
 				event_offset_time,
@@ -2657,61 +6903,51 @@ int process_epg_titles(uint8_t * Data, int Length) {
 				tm1.tm_year + 1900, tm1.tm_mon + 1, tm1.tm_mday,
 				tm1.tm_hour, tm1.tm_min, tm1.tm_sec,
 				duration, theme_id);
-			for(n = 0; n < Len2; n++) {
-				printf("%02x ", Data[p + 9 + n]);
-				if ((n % 32) == 31) {
-					printf("\n");
-				}
-			}
-			printf("\n");
+			xlog_hex( LOG_CAT_TITLES, &Data[p + 9], Len2, 32 );
 			tmp = decode_huffman_code(&Data[p + 9], Len2, buffer_for_decode);
-			printf("Title:%d:%s:%s\n", tmp, DecodeText, DecodeErrorText);
-			printf("ChannelID = 0x%x, EventID = 0x%x, %04d-%02d-%02d %02d:%02d:%02d, Len1 = 0x%x, Len2 = 0x%x TITLE %s\n", ChannelId, EventId,
+			dlog( LOG_CAT_TITLES, "Title:%d:%s:%s\n", tmp, DecodeText, DecodeErrorText);
+			dlog( LOG_CAT_TITLES, "ChannelID = 0x%x, EventID = 0x%x, %04d-%02d-%02d %02d:%02d:%02d, Len1 = 0x%x, Len2 = 0x%x TITLE %s\n", ChannelId, EventId,
 				tm1.tm_year + 1900, tm1.tm_mon + 1, tm1.tm_mday,
 				tm1.tm_hour, tm1.tm_min, tm1.tm_sec,
 				Len1, Len2,
 				DecodeText);
-			if (!(C->events_count)) {
-				C->events = calloc(1, sizeof(struct event_s));
-				C->events[0].event_id = EventId;
-				C->events[0].channel_id = ChannelId;
-				C->events[0].start_time_title = start_time;
-				C->events[0].duration_title = duration;
-				C->events[0].theme_id = theme_id;
-				C->events[0].prefix_len = 0; /* FIXME: JCD TODO */
-				C->events[0].title_len = tmp;
-				C->events[0].title = malloc(tmp + 1);
-				memcpy(C->events[0].title, DecodeText, tmp);
-				C->events[0].title[tmp] = 0;
-				C->events_count = 1;
-			} else {
-				found = -1;
-				for(n = 0; n < C->events_count; n++) {
-					if (C->events[n].event_id == EventId) {
-						found = n;
-						break;
-					}
+			row = channel_event(C, EventId);
+			if (row == EVENT_NONE) {
+				return 0;
+			}
+			if (!start_time) {
+				elog( LOG_CAT_TITLES, "Titles: Error, event 0x%x on channel 0x%x has no start time\n", EventId, ChannelId);
+				return 0;
+			}
+			/* The carousel repeats titles, only re-index when the times change */
+			changed = 0;
+			if (!(events.flags[row] & EVENT_FLAG_TITLE) ||
+				events.epoch + events.start[row] != start_time ||
+				events.duration[row] != duration) {
+				if (events.flags[row] & EVENT_FLAG_TITLE) {
+					interval_index_remove(&events_by_time, &events, row);
 				}
-				if (found == -1) {
-					found = C->events_count;
-					C->events_count++;
-					C->events = realloc( C->events, C->events_count * sizeof(struct event_s));
-					/* Zero out fields that are not set in a moment */
-					C->events[found].start_time_summary = 0;
-					C->events[found].summary_len = 0;
-					C->events[found].summary = NULL;
+				pos = channel_event_position(C, row);
+				event_table_set_start(&events, row, start_time);
+				events.duration[row] = duration;
+				events.flags[row] |= EVENT_FLAG_TITLE;
+				channel_event_reorder(C, pos);
+				if (!interval_index_insert(&events_by_time, &events, row)) {
+					return 0;
 				}
-				C->events[found].event_id = EventId;
-				C->events[found].channel_id = ChannelId;
-				C->events[found].start_time_title = start_time;
-				C->events[found].duration_title = duration;
-				C->events[found].theme_id = theme_id;
-				C->events[found].prefix_len = 0; /* FIXME: JCD TODO */
-				C->events[found].title_len = tmp;
-				C->events[found].title = malloc(tmp + 1);
-				memcpy(C->events[found].title, DecodeText, tmp);
-				C->events[found].title[tmp] = 0;
+				changed = 1;
+			}
+			title_id = string_intern(&string_pool, (char *)DecodeText, tmp);
+			if (tmp > 0 && !title_id) {
+				elog( LOG_CAT_TITLES, "Titles: Error, out of memory for titles\n" );
+				return 0;
+			}
+			if (changed || events.theme[row] != theme_id || events.title_id[row] != title_id) {
+				event_table_changed(&events, row);
 			}
+			events.theme[row] = theme_id;
+			events.title_id[row] = title_id;
+			events.flags[row] |= EVENT_FLAG_TITLE | EVENT_FLAG_SEEN;
 
 			p += Len1;
 			if( p < Length ) {
@@ -2730,38 +6966,31 @@ int process_epg_summary(uint8_t * Data, int Length) {
 	int Len1;
 	int Len2;
 	int p;
-	int n;
 	int tmp;
 	struct channel_s *C;
-	int found;
+	uint32_t row;
+	uint32_t summary_id;
 	struct tm tm1, *tm2;
 	tm2 = &tm1;
 
-		printf("MATCHS0 ");
-		for(n = 0; n < 0x1c; n++) {
-			printf("%02x ", Data[n]);
-			if ((n % 32) == 31) {
-				printf("\n");
-			}
-		}
-		printf("\n");
+		xlog( LOG_CAT_SUMMARY, "MATCHS0 ");
+		xlog_hex( LOG_CAT_SUMMARY, Data, 0x1c, 32 );
 	/* Offset i == 11 seems to be good */
 	ChannelId = ( Data[3] << 8 ) | Data[4];
-	if (ChannelId != 0x540) return;
+	if (!channel_wanted(ChannelId)) {
+		channel_filter.skipped++;
+		return 1;
+	}
 	MjdTime = ( ( Data[8] << 8 ) | Data[9] );
-	printf("Summary: ChannelID = 0x%x, MjdTime = 0x%x\n", ChannelId, MjdTime);
+	dlog( LOG_CAT_SUMMARY, "Summary: ChannelID = 0x%x, MjdTime = 0x%x\n", ChannelId, MjdTime);
 	if( ChannelId > 0 ) {
-		if (channels_all[ChannelId] == 0xffff) {
-			channels_all[ChannelId] = nChannels;
-			nChannels ++;
-			if( nChannels >= MAX_CHANNELS ) {
-				printf( "Titles: Error, channels found more than %i", MAX_CHANNELS );
-				return 0;
-			}
+		C = channel_add(ChannelId);
+		if (!C) {
+			elog( LOG_CAT_SUMMARY, "Summary: Error, out of memory for channels\n" );
+			return 0;
 		}
-		C = &lChannels[channels_all[ChannelId]];
-		C->ChannelId = ChannelId;
 		if( MjdTime > 0 ) {
+			channel_carousel_section(C, CAROUSEL_SUMMARIES, (MjdTime << 16) | (Data[10] << 8) | Data[11]);
 			p = 10;
 			loop1:;
 			//sSummary *S = ( lSummaries + nSummaries );
@@ -2770,27 +6999,27 @@ int process_epg_summary(uint8_t * Data, int Length) {
 			EventId = ( Data[p] << 8 ) | Data[p+1];
 			Type = Data[p + 2];
 			if (Type != 0xb0) {
-				printf("Summary: No 0xb0 found. Found 0x%x\n", Type);
+				dlog( LOG_CAT_SUMMARY, "Summary: No 0xb0 found. Found 0x%x\n", Type);
 				goto endloop1;
 			}
 			Len1 = Data[p + 3];
-			printf("Summary: ChannelID = 0x%x, EventID = 0x%x, Len1 = 0x%x\n", ChannelId, EventId, Len1);
+			dlog( LOG_CAT_SUMMARY, "Summary: ChannelID = 0x%x, EventID = 0x%x, Len1 = 0x%x\n", ChannelId, EventId, Len1);
 			if (Len1 < 4) {
-				printf("Summary too short\n");
+				elog( LOG_CAT_SUMMARY, "Summary too short\n");
 				p += Len1 + 4;
 				goto reloop;
 			}
 			if( Data[p+4] != 0xb9 ) {
-				printf("LoadEPG: Data error signature for summary\n");
+				elog( LOG_CAT_SUMMARY, "LoadEPG: Data error signature for summary\n");
 				goto endloop1;
 			}
 			if( Len1 > Length ) {
-				printf("LoadEPG: Data error length for summary\n");
+				elog( LOG_CAT_SUMMARY, "LoadEPG: Data error length for summary\n");
 				goto endloop1;
 			}
 			p += 4;
 			Len2 = Data[p+1];
-			printf("Summary: Len2 = 0x%x\n", Len2);
+			dlog( LOG_CAT_SUMMARY, "Summary: Len2 = 0x%x\n", Len2);
 //			S->pData = pS;
 //			S->lenData = Len2;
 //			if( ( pS + Len2 + 2 ) > MAX_BUFFER_SIZE_SUMMARIES) {
@@ -2799,55 +7028,25 @@ int process_epg_summary(uint8_t * Data, int Length) {
 //				return;
 //			}
 //			memcpy( &bSummaries[pS], &Data[p+2], Len2 );
-			for(n = 0; n < Len2; n++) {
-				printf("%02x ", Data[p + 2 + n]);
-				if ((n % 32) == 31) {
-					printf("\n");
-				}
-			}
-	printf("\n");
+			xlog_hex( LOG_CAT_SUMMARY, &Data[p + 2], Len2, 32 );
 			tmp = decode_huffman_code(&Data[p + 2], Len2, buffer_for_decode);
-			printf("Summary:%d:%s:%s\n", tmp, DecodeText, DecodeErrorText);
-			printf("ChannelID = 0x%x, EventID = 0x%x, Len1 = 0x%x, Len2=0x%x SUMMARY %s\n", ChannelId, EventId, Len1, Len2, DecodeText);
-
-			if (!(C->events_count)) {
-				C->events = calloc(1, sizeof(struct event_s));
-				C->events[0].event_id = EventId;
-				C->events[0].channel_id = ChannelId;
-				C->events[0].prefix_len = 0; /* FIXME: JCD TODO */
-				C->events[0].summary_len = tmp;
-				C->events[0].summary = malloc(tmp + 1);
-				memcpy(C->events[0].summary, DecodeText, tmp);
-				C->events[0].summary[tmp] = 0;
-				C->events_count = 1;
-			} else {
-				found = -1;
-				for(n = 0; n < C->events_count; n++) {
-					if (C->events[n].event_id == EventId) {
-						found = n;
-						break;
-					}
-				}
-				if (found == -1) {
-					found = C->events_count;
-					C->events_count++;
-					C->events = realloc( C->events, C->events_count * sizeof(struct event_s));
-					/* Zero out fields that are not set in a moment */
-					C->events[found].start_time_title = 0;
-					C->events[found].duration_title = 0;
-					C->events[found].theme_id = 0;
-					C->events[found].start_time_summary = 0;
-					C->events[found].title_len = 0;
-					C->events[found].title = NULL;
-				}
-				C->events[found].event_id = EventId;
-				C->events[found].channel_id = ChannelId;
-				C->events[found].prefix_len = 0; /* FIXME: JCD TODO */
-				C->events[found].summary_len = tmp;
-				C->events[found].summary = malloc(tmp + 1);
-				memcpy(C->events[found].summary, DecodeText, tmp);
-				C->events[found].summary[tmp] = 0;
+			dlog( LOG_CAT_SUMMARY, "Summary:%d:%s:%s\n", tmp, DecodeText, DecodeErrorText);
+			dlog( LOG_CAT_SUMMARY, "ChannelID = 0x%x, EventID = 0x%x, Len1 = 0x%x, Len2=0x%x SUMMARY %s\n", ChannelId, EventId, Len1, Len2, DecodeText);
+
+			row = channel_event(C, EventId);
+			if (row == EVENT_NONE) {
+				return 0;
 			}
+			summary_id = summary_store((char *)DecodeText, tmp);
+			if (tmp > 0 && !summary_id) {
+				elog( LOG_CAT_SUMMARY, "Summary: Error, out of memory for summaries\n" );
+				return 0;
+			}
+			if (events.summary_id[row] != summary_id) {
+				event_table_changed(&events, row);
+			}
+			events.summary_id[row] = summary_id;
+			events.flags[row] |= EVENT_FLAG_SUMMARY | EVENT_FLAG_SEEN;
 //			pS += ( Len2 + 1 );
 			p += Len1;
 //			nSummaries ++;
@@ -2872,7 +7071,6 @@ static void process_epg(struct demux_ts_s *this, int pid)
 	uint32_t crc32;
 	uint32_t calc_crc32;
 	uint8_t *buffer;
-	int n;
 	uint32_t	reserved1;
 	uint32_t	pcr_pid;
 	uint32_t	reserved2;
@@ -2886,42 +7084,17 @@ static void process_epg(struct demux_ts_s *this, int pid)
 	uint32_t	ca_pid;
 	uint32_t	offset;
 	int		program_count;
-	int		i;
-	int		m;
 
 #ifdef TS_PMT_LOG
-  printf ("ts_demux: have all TS packets for the EPG section\n");
+  dlog( LOG_CAT_DEMUX, "ts_demux: have all TS packets for the EPG section\n");
 #endif
 	program_count = this->pids[pid].program_count;
 	program = &(this->programs[program_count]);
 	buffer = this->pids[pid].section.whole_section;
 	section_length = this->pids[pid].section.size;
-	printf("buffer=%p, len=0x%x\n", buffer, section_length);
-	printf("printing bytes=0x%x\n", section_length + 7);
-	i = 0;
-	for(n = 0; n < section_length + 7; n++) {
-		printf("%02x ", buffer[n]);
-		
-		if ((n % 32) == 31) {
-			for (m = i; m < (i + 32); m++) {
-				if (buffer[m] > 31 && buffer[m] < 127) {
-					printf("%c", buffer[m]);
-				} else {
-					printf(".", buffer[m]);
-				}
-			}
-			i = n + 1;
-			printf("\n");
-		}
-	}
-	for (m = i; m < (n); m++) {
-		if (buffer[m] > 31 && buffer[m] < 127) {
-			printf("%c", buffer[m]);
-		} else {
-			printf(".", buffer[m]);
-		}
-	}
-	printf("\n");
+	xlog( LOG_CAT_DEMUX, "buffer=%p, len=0x%x\n", buffer, section_length);
+	xlog( LOG_CAT_DEMUX, "printing bytes=0x%x\n", section_length + 7);
+	xlog_hex_ascii( LOG_CAT_DEMUX, buffer, section_length + 7 );
 
 	crc32  = (uint32_t) buffer[section_length  - 4] << 24;
 	crc32 |= (uint32_t) buffer[section_length  - 3] << 16;
@@ -2933,12 +7106,12 @@ static void process_epg(struct demux_ts_s *this, int pid)
 		buffer,
 		section_length - 4, 0xffffffff);
 	if (crc32 != calc_crc32) {
-		printf ("demux_ts: demux error! EPG CRC32 invalid: packet_crc32: %#.8x calc_crc32: %#.8x\n",
+		elog( LOG_CAT_DEMUX, "demux_ts: demux error! EPG CRC32 invalid: packet_crc32: %#.8x calc_crc32: %#.8x\n",
 			crc32,calc_crc32);
 		return;
 	}
 #ifdef TS_PMT_LOG
-	printf ("demux_ts: EPG CRC32 ok: %#.8x\n", crc32);
+	dlog( LOG_CAT_DEMUX, "demux_ts: EPG CRC32 ok: %#.8x\n", crc32);
 #endif
 	/* SKY BOX */	
 	switch( buffer[0] ) {
@@ -2970,35 +7143,35 @@ static void process_epg(struct demux_ts_s *this, int pid)
 	case 0xa7:
 	/* Unknown but a5, a6, a7 are the same */
 		process_epg_test_a5_a6_a7(buffer, section_length - 4);
-		printf("demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
+		dlog( LOG_CAT_DEMUX, "demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
 		break;
 	case 0xb5:
 	/* Firmware */
 		//process_epg_test_b5(buffer, section_length - 4);
-		printf("demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
+		dlog( LOG_CAT_DEMUX, "demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
 		break;
 	case 0xb6:
 	/* Firmware */
 		//process_epg_test_b6(buffer, section_length - 4);
-		printf("demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
+		dlog( LOG_CAT_DEMUX, "demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
 		break;
 	case 0xc0:
 	/* Unknown */
 		process_epg_test_c0(buffer, section_length - 4);
-		printf("demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
+		dlog( LOG_CAT_DEMUX, "demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
 		break;
 	case 0xc1:
 	/* Unknown */
 		process_epg_test_c1(buffer, section_length - 4);
-		printf("demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
+		dlog( LOG_CAT_DEMUX, "demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
 		break;
 	case 0xc2:
 	/* Unknown */
 		process_epg_test_c2(buffer, section_length - 4);
-		printf("demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
+		dlog( LOG_CAT_DEMUX, "demux_ts: Mystery EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
 		break;
 	default:
-		printf("demux_ts: Unknown EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
+		dlog( LOG_CAT_DEMUX, "demux_ts: Unknown EPG type 0x%x, PID=0x%x\n", buffer[0], pid);
 		break;
 	}
 #if 0
@@ -3007,7 +7180,7 @@ static void process_epg(struct demux_ts_s *this, int pid)
 		calc_crc32 = demux_ts_compute_crc32(this,
 			buffer,
 			n, 0xffffffff);
-		printf("%04x:%04x\n", n, calc_crc32);
+		dlog( LOG_CAT_DEMUX, "%04x:%04x\n", n, calc_crc32);
 	}
 #endif
 
@@ -3020,7 +7193,6 @@ static void process_sdt(struct demux_ts_s *this, int pid)
 	uint32_t crc32;
 	uint32_t calc_crc32;
 	uint8_t *buffer;
-	int n;
 	uint32_t	reserved1;
 	uint32_t	pcr_pid;
 	uint32_t	reserved2;
@@ -3034,41 +7206,16 @@ static void process_sdt(struct demux_ts_s *this, int pid)
 	uint32_t	ca_pid;
 	uint32_t	offset;
 	int		program_count;
-	int		i;
-	int		m;
 
 #ifdef TS_PMT_LOG
-  printf ("ts_demux: have all TS packets for the SDT section\n");
+  dlog( LOG_CAT_SDT, "ts_demux: have all TS packets for the SDT section\n");
 #endif
 	program_count = this->pids[pid].program_count;
 	program = &(this->programs[program_count]);
 	buffer = this->pids[pid].section.buffer;
 	section_length = this->pids[pid].section.size;
-	printf("buffer=%p\n", buffer);
-	i = 0;
-	for(n = 0; n < section_length + 3; n++) {
-		printf("%02x ", buffer[n]);
-		
-		if ((n % 32) == 31) {
-			for (m = i; m < (i + 32); m++) {
-				if (buffer[m] > 31 && buffer[m] < 127) {
-					printf("%c", buffer[m]);
-				} else {
-					printf(".", buffer[m]);
-				}
-			}
-			i = n + 1;
-			printf("\n");
-		}
-	}
-	for (m = i; m < (n); m++) {
-		if (buffer[m] > 31 && buffer[m] < 127) {
-			printf("%c", buffer[m]);
-		} else {
-			printf(".", buffer[m]);
-		}
-	}
-	printf("\n");
+	xlog( LOG_CAT_SDT, "buffer=%p\n", buffer);
+	xlog_hex_ascii( LOG_CAT_SDT, buffer, section_length + 3 );
 
 	crc32  = (uint32_t) buffer[section_length-4] << 24;
 	crc32 |= (uint32_t) buffer[section_length-3] << 16;
@@ -3080,12 +7227,12 @@ static void process_sdt(struct demux_ts_s *this, int pid)
 		buffer,
 		section_length - 4, 0xffffffff);
 	if (crc32 != calc_crc32) {
-		printf ("demux_ts: demux error! SDT with invalid CRC32: packet_crc32: %#.8x calc_crc32: %#.8x\n",
+		elog( LOG_CAT_SDT, "demux_ts: demux error! SDT with invalid CRC32: packet_crc32: %#.8x calc_crc32: %#.8x\n",
 			crc32,calc_crc32);
 		return;
 	} else {
 #ifdef TS_PMT_LOG
-		printf ("demux_ts: SDT CRC32 ok: %#.8x\n", crc32);
+		dlog( LOG_CAT_SDT, "demux_ts: SDT CRC32 ok: %#.8x\n", crc32);
 #endif
 	}
 	switch (buffer[0]) {
@@ -3102,7 +7249,7 @@ static void process_sdt(struct demux_ts_s *this, int pid)
 		break;
 /* Also present on PID 0x12, Table id 0x4e. Probably EIT now and next */
 	default:
-		printf("demux_ts: Unknown SDT type 0x%x PID=0x%x\n", buffer[0], pid);
+		dlog( LOG_CAT_SDT, "demux_ts: Unknown SDT type 0x%x PID=0x%x\n", buffer[0], pid);
 	}
 }
 
@@ -3140,20 +7287,14 @@ static void process_pmt(struct demux_ts_s *this, int pid)
 	int		program_count;
 
 #ifdef TS_PMT_LOG
-  printf ("ts_demux: have all TS packets for the PMT section\n");
+  dlog( LOG_CAT_DEMUX, "ts_demux: have all TS packets for the PMT section\n");
 #endif
 	program_count = this->pids[pid].program_count;
 	program = &(this->programs[program_count]);
 	buffer = this->pids[pid].section.buffer;
 	section_length = this->pids[pid].section.size;
 
-	for(n = 0; n < section_length + 3; n++) {
-		printf("%02x ", buffer[n]);
-		if ((n % 32) == 31) {
-		printf("\n");
-		}
-	}
-	printf("\n");
+	xlog_hex( LOG_CAT_DEMUX, buffer, section_length + 3, 32 );
 
 	crc32  = (uint32_t) buffer[section_length+3-4] << 24;
 	crc32 |= (uint32_t) buffer[section_length+3-3] << 16;
@@ -3165,26 +7306,26 @@ static void process_pmt(struct demux_ts_s *this, int pid)
 		buffer,
 		section_length + 3 - 4, 0xffffffff);
 	if (crc32 != calc_crc32) {
-		printf ("demux_ts: demux error! PMT with invalid CRC32: packet_crc32: %#.8x calc_crc32: %#.8x\n",
+		elog( LOG_CAT_DEMUX, "demux_ts: demux error! PMT with invalid CRC32: packet_crc32: %#.8x calc_crc32: %#.8x\n",
 			crc32,calc_crc32);
 		return;
 	} else {
 #ifdef TS_PMT_LOG
-		printf ("demux_ts: PMT CRC32 ok: %#.8x\n", crc32);
+		dlog( LOG_CAT_DEMUX, "demux_ts: PMT CRC32 ok: %#.8x\n", crc32);
 #endif
 	}
 	pcr_pid                   = (((uint32_t) buffer[8] << 8) | buffer[9]) & 0x1fff;
 	program_info_length       = (((uint32_t) buffer[10] << 8) | buffer[11]) & 0x0fff;
-	printf ("              pcr_pid: 0x%04x\n", pcr_pid);
-	printf ("              program_info_length: 0x%04x\n", program_info_length);
+	dlog( LOG_CAT_DEMUX, "              pcr_pid: 0x%04x\n", pcr_pid);
+	dlog( LOG_CAT_DEMUX, "              program_info_length: 0x%04x\n", program_info_length);
 	/* Program info descriptor is currently just ignored. */
-	printf ("demux_ts: program_info_desc: ");
+	xlog( LOG_CAT_DEMUX, "demux_ts: program_info_desc: ");
 	for (n = 0; n < program_info_length; n++)
-		printf ("%.2x ", buffer[12+n]);
-	printf ("\n");
+		xlog( LOG_CAT_DEMUX, "%.2x ", buffer[12+n]);
+	xlog( LOG_CAT_DEMUX, "\n");
 	offset = 12 + program_info_length;
 	for (offset = 12 + program_info_length; offset < section_length - 1; ) {
-		printf("offset = %d, section_length = %d\n", offset, section_length);
+		dlog( LOG_CAT_DEMUX, "offset = %d, section_length = %d\n", offset, section_length);
 		stream_type = buffer[offset];
 		elementary_pid = (((uint32_t) buffer[offset + 1] << 8) | buffer[offset + 2]) & 0x1fff;
 		es_info_length       = (((uint32_t) buffer[offset + 3] << 8) | buffer[offset + 4]) & 0x0fff;
@@ -3214,9 +7355,9 @@ static void process_pmt(struct demux_ts_s *this, int pid)
 			this->pids[elementary_pid].type = PID_TYPE_UNKNOWN;
 			this->pids[elementary_pid].program_count = program_count;
 		}
-		printf ("              stream_type: 0x%02x\n", stream_type);
-		printf ("              elementary_pid: 0x%04x\n", elementary_pid);
-		printf ("              es_info_length: 0x%04x\n", es_info_length);
+		dlog( LOG_CAT_DEMUX, "              stream_type: 0x%02x\n", stream_type);
+		dlog( LOG_CAT_DEMUX, "              elementary_pid: 0x%04x\n", elementary_pid);
+		dlog( LOG_CAT_DEMUX, "              es_info_length: 0x%04x\n", es_info_length);
 		for (n = 0; n < es_info_length; ) {
 			desc_tag = buffer[offset + 5 + n];
 			desc_len = buffer[offset + 5 + n + 1];
@@ -3238,28 +7379,28 @@ static void process_pmt(struct demux_ts_s *this, int pid)
 					program->audio.ca_pid = ca_pid;
 				}
 			}
-			printf ("              es_tag: 0x%02x\n", desc_tag);
-			printf ("              es_len: 0x%02x  ", desc_len);
+			dlog( LOG_CAT_DEMUX, "              es_tag: 0x%02x\n", desc_tag);
+			dlog( LOG_CAT_DEMUX, "              es_len: 0x%02x  ", desc_len);
 			for(m = 0; m < desc_len; m++) {
-				printf("%02x ", buffer[offset + 5 + n + 2 + m]);
+				xlog( LOG_CAT_DEMUX, "%02x ", buffer[offset + 5 + n + 2 + m]);
 			};
 			for(m = 0; m < desc_len; m++) {
 				int tmp;
 				tmp = buffer[offset + 5 + n + 2 + m];
 				if ((tmp > 32) && (tmp < 127))
-					printf("%c", tmp);
+					xlog( LOG_CAT_DEMUX, "%c", tmp);
 				else
-					printf(".", tmp);
+					xlog( LOG_CAT_DEMUX, ".");
 			};
-			printf("\n");
+			xlog( LOG_CAT_DEMUX, "\n");
 			if (desc_tag == 9) {
-				printf ("              ca_system_id: 0x%04x\n", ca_system_id);
-				printf ("              ca_pid: 0x%04x\n", ca_pid);
+				dlog( LOG_CAT_DEMUX, "              ca_system_id: 0x%04x\n", ca_system_id);
+				dlog( LOG_CAT_DEMUX, "              ca_pid: 0x%04x\n", ca_pid);
 			}
 			n += desc_len + 2;
 		}
 		offset += 5 + es_info_length;
-		printf("\n");
+		xlog( LOG_CAT_DEMUX, "\n");
 	}
 		
 }
@@ -3291,18 +7432,18 @@ static int64_t demux_ts_adaptation_field_parse(uint8_t *data,
   adaptation_field_extension_flag = (data[0] & 0x01);
 
 #ifdef TS_LOG
-  printf ("demux_ts: ADAPTATION FIELD length: %d (%x)\n",
+  dlog( LOG_CAT_DEMUX, "demux_ts: ADAPTATION FIELD length: %d (%x)\n",
           adaptation_field_length, adaptation_field_length);
   if(discontinuity_indicator) {
-    printf ("               Discontinuity indicator: %d\n",
+    dlog( LOG_CAT_DEMUX, "               Discontinuity indicator: %d\n",
             discontinuity_indicator);
   }
   if(random_access_indicator) {
-    printf ("               Random_access indicator: %d\n",
+    dlog( LOG_CAT_DEMUX, "               Random_access indicator: %d\n",
             random_access_indicator);
   }
   if(elementary_stream_priority_indicator) {
-    printf ("               Elementary_stream_priority_indicator: %d\n",
+    dlog( LOG_CAT_DEMUX, "               Elementary_stream_priority_indicator: %d\n",
             elementary_stream_priority_indicator);
   }
 #endif
@@ -3315,7 +7456,7 @@ static int64_t demux_ts_adaptation_field_parse(uint8_t *data,
 
     EPCR = ((data[offset+4] & 0x1) << 8) | data[offset+5];
 #ifdef TS_LOG
-    printf ("demux_ts: PCR: %"PRId64", EPCR: %u\n",
+    dlog( LOG_CAT_DEMUX, "demux_ts: PCR: %"PRId64", EPCR: %u\n",
             PCR, EPCR);
 #endif
     offset+=6;
@@ -3328,28 +7469,106 @@ static int64_t demux_ts_adaptation_field_parse(uint8_t *data,
     OPCR |= (data[offset+4] >> 7) & 0x01;
     EOPCR = ((data[offset+4] & 0x1) << 8) | data[offset+5];
 #ifdef TS_LOG
-    printf ("demux_ts: OPCR: %u, EOPCR: %u\n",
+    dlog( LOG_CAT_DEMUX, "demux_ts: OPCR: %u, EOPCR: %u\n",
             OPCR,EOPCR);
 #endif
     offset+=6;
   }
 #ifdef TS_LOG
   if(slicing_point_flag) {
-    printf ("demux_ts: slicing_point_flag: %d\n",
+    dlog( LOG_CAT_DEMUX, "demux_ts: slicing_point_flag: %d\n",
             slicing_point_flag);
   }
   if(transport_private_data_flag) {
-    printf ("demux_ts: transport_private_data_flag: %d\n",
+    dlog( LOG_CAT_DEMUX, "demux_ts: transport_private_data_flag: %d\n",
 	    transport_private_data_flag);
   }
   if(adaptation_field_extension_flag) {
-    printf ("demux_ts: adaptation_field_extension_flag: %d\n",
+    dlog( LOG_CAT_DEMUX, "demux_ts: adaptation_field_extension_flag: %d\n",
             adaptation_field_extension_flag);
   }
 #endif
   return PCR;
 }
 
+/* Keep a completed section for offline analysis, see epgtrace.h */
+static void trace_section(struct demux_ts_s *this, int pid)
+{
+	struct section_s *section = &this->pids[pid].section;
+	struct epgtrace_record_s R;
+	uint8_t *buffer = section->whole_section;
+	uint32_t crc32;
+
+	if (!section_trace.file || section->size < 4 || section->size > EPGTRACE_MAX_SECTION) {
+		return;
+	}
+	memset(&R, 0, sizeof(R));
+	R.pcr = this->pcr < 0 ? EPGTRACE_NO_PCR : (uint64_t) this->pcr;
+	R.packet = this->packet_index;
+	R.pid = pid;
+	R.length = section->size;
+	R.table_id = buffer[0];
+	crc32  = (uint32_t) buffer[section->size - 4] << 24;
+	crc32 |= (uint32_t) buffer[section->size - 3] << 16;
+	crc32 |= (uint32_t) buffer[section->size - 2] << 8;
+	crc32 |= (uint32_t) buffer[section->size - 1];
+	if (demux_ts_compute_crc32(this, buffer, section->size - 4, 0xffffffff) == crc32) {
+		R.flags |= EPGTRACE_CRC_OK;
+	}
+	if (!epgtrace_append(&section_trace, &R, buffer)) {
+		elog(LOG_CAT_DEMUX, "Trace: write failed, %s\n", strerror(errno));
+		fclose(section_trace.file);
+		free(section_trace.index);
+		section_trace.file = NULL;
+		section_trace.index = NULL;
+	}
+}
+
+/* Feed the sections of a trace to the same handlers as the TS path.
+ * Returns the number of sections, or -1 if the trace cannot be read.
+ */
+static int trace_replay(struct demux_ts_s *this, const char *FileName)
+{
+	const struct epgtrace_record_s *R;
+	struct section_s *section;
+	struct epgtrace_s T;
+	uint32_t n;
+
+	if (!epgtrace_open(&T, FileName)) {
+		printf("Trace: '%s' is not a finished section trace\n", FileName);
+		return -1;
+	}
+	for (n = 0; n < T.header->record_count; n++) {
+		R = epgtrace_record(&T, n);
+		section = &this->pids[R->pid].section;
+		if (!section->whole_section) {
+			section->whole_section = calloc(0x1100, 1);
+		}
+		if (!section->buffer) {
+			section->buffer = calloc(0x1100, 1);
+		}
+		if (!section->whole_section || !section->buffer) {
+			elog(LOG_CAT_DEMUX, "OUT OF MEMORY!!!!\n");
+			break;
+		}
+		memcpy(section->whole_section, epgtrace_data(R), R->length);
+		memcpy(section->buffer, epgtrace_data(R), R->length);
+		section->size = R->length;
+		this->packet_index = R->packet;
+		this->pcr = R->pcr == EPGTRACE_NO_PCR ? -1 : (int64_t) R->pcr;
+		if (R->pid == 0x11 || R->pid == 0x12) {
+			process_sdt(this, R->pid);
+			section->buffer_progress = 0;
+		} else if (R->pid >= 0x30 && R->pid < 0x62) {
+			process_epg(this, R->pid);
+		}
+		section->size = 0;
+		tables_quiescent();
+	}
+	epgtrace_close(&T);
+	return n;
+}
+
 /* check if an apid is in the list of known apids */
 
 /* transport stream packet layer */
@@ -3371,8 +7590,7 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 	int pes_stream_id;
 	int	discontinuity = 0;
 	uint32_t       program_count;
-	int i;
-	int n;
+	int64_t pcr;
 	static int ccc=0;
 
 #if 0
@@ -3400,31 +7618,26 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 	program_count = this->pids[pid].program_count;
 
 #ifdef TS_HEADER_LOG
-	printf("demux_ts:ts_header:sync_byte=0x%.2x\n",sync_byte);
-	printf("demux_ts:ts_header:transport_error_indicator=%d\n", transport_error_indicator);
-	printf("demux_ts:ts_header:payload_unit_start_indicator=%d\n", payload_unit_start_indicator);
-	printf("demux_ts:ts_header:transport_priority=%d\n", transport_priority);
-	printf("demux_ts:ts_header:pid=0x%.4x\n", pid);
-	printf("demux_ts:ts_header:transport_scrambling_control=0x%.1x\n", transport_scrambling_control);
-	printf("demux_ts:ts_header:adaptation_field_control=0x%.1x\n", adaptation_field_control);
-	printf("demux_ts:ts_header:continuity_counter=0x%.1x\n", continuity_counter);
-
-	for(n = 0; n < 188; n++) {
-		printf("%02x ", packet[n]);
-		if ((n % 32) == 31)
-			printf("\n");
-	}
-	printf("\n");
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:sync_byte=0x%.2x\n",sync_byte);
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:transport_error_indicator=%d\n", transport_error_indicator);
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:payload_unit_start_indicator=%d\n", payload_unit_start_indicator);
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:transport_priority=%d\n", transport_priority);
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:pid=0x%.4x\n", pid);
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:transport_scrambling_control=0x%.1x\n", transport_scrambling_control);
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:adaptation_field_control=0x%.1x\n", adaptation_field_control);
+	dlog( LOG_CAT_DEMUX, "demux_ts:ts_header:continuity_counter=0x%.1x\n", continuity_counter);
+
+	xlog_hex( LOG_CAT_DEMUX, packet, 188, 32 );
 #endif
 	/*
 	 * Discard packets that are obviously bad.
 	 */
 	if (sync_byte != SYNC_BYTE) {
-		printf ( "demux error! invalid ts sync byte %.2x\n", sync_byte);
+		elog( LOG_CAT_DEMUX, "demux error! invalid ts sync byte %.2x\n", sync_byte);
 		return;
 	}
 	if (transport_error_indicator) {
-		printf ("demux error! transport error\n");
+		elog( LOG_CAT_DEMUX, "demux error! transport error\n");
 		return;
 	}
 	if (pid == 0x1ffb) {
@@ -3434,12 +7647,12 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 
 	if (transport_scrambling_control) {
 #ifdef TS_SCRAM
-		printf ("demux_ts: PID 0x%.4x is scrambled!, sc=%d\n", pid, transport_scrambling_control);
+		dlog( LOG_CAT_DEMUX, "demux_ts: PID 0x%.4x is scrambled!, sc=%d\n", pid, transport_scrambling_control);
 #endif
 		return;
 	} else {
 #ifdef TS_SCRAM
-		printf ("demux_ts: PID 0x%.4x is not scrambled!, sc=%d\n", pid, transport_scrambling_control);
+		dlog( LOG_CAT_DEMUX, "demux_ts: PID 0x%.4x is not scrambled!, sc=%d\n", pid, transport_scrambling_control);
 #endif
 	}
 
@@ -3449,7 +7662,10 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 	if( adaptation_field_control & 0x2 ){
 		uint32_t adaptation_field_length = originalPkt[4];
 		if (adaptation_field_length > 0) {
-			demux_ts_adaptation_field_parse (originalPkt+5, adaptation_field_length);
+			pcr = demux_ts_adaptation_field_parse (originalPkt+5, adaptation_field_length);
+			if (originalPkt[5] & 0x10) {
+				this->pcr = pcr;
+			}
 		}
 		/*
 		 * Skip adaptation header.
@@ -3463,7 +7679,7 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 
 	data_len = PKT_SIZE - data_offset;
 #ifdef TS_HEADER_LOG
-	printf("data_offset:0x%x data_len:0x%x\n", data_offset, data_len);
+	dlog( LOG_CAT_DEMUX, "data_offset:0x%x data_len:0x%x\n", data_offset, data_len);
 #endif
 
 	if (pid == 0) {
@@ -3478,7 +7694,7 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 	}
 	if (pid == 0x11 || pid == 0x12 ) {
 #ifdef TS_HEADER_LOG
-		printf ("demux_ts: SDT pid: 0x%.4x\n",
+		dlog( LOG_CAT_DEMUX, "demux_ts: SDT pid: 0x%.4x\n",
 			pid);
 #endif
 		//printf("sdt find1: 0x%x, service_count=0x%x, %s, %s\n", ccc, 0xe, this->services[0xe].provider, this->services[0xe].name);
@@ -3490,11 +7706,12 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 		ccc++;
 		/* Do we have a complete SDT now */
 		if (this->pids[pid].section.size) {
+			trace_section(this, pid);
 			process_sdt(this, pid);
 			this->pids[pid].section.size = 0;
 			this->pids[pid].section.buffer_progress = 0;
 #ifdef TS_HEADER_LOG
-			printf("Zeroing section.size for pid 0x%x\n", pid);
+			dlog( LOG_CAT_DEMUX, "Zeroing section.size for pid 0x%x\n", pid);
 #endif
 		}
 		return;
@@ -3502,7 +7719,7 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 #if 1
 	if (pid >= 0x30 && pid < 0x62) {
 #ifdef TS_HEADER_LOG
-		printf ("demux_ts: EPG pid: 0x%.4x\n",
+		dlog( LOG_CAT_DEMUX, "demux_ts: EPG pid: 0x%.4x\n",
 			pid);
 #endif
 		//printf("sdt find3: 0x%x, service_count=0x%x, %s, %s\n", ccc, 0xe, this->services[0xe].provider, this->services[0xe].name);
@@ -3514,6 +7731,7 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 		ccc++;
 		/* Do we have a complete EPG now */
 		if (this->pids[pid].section.size) {
+			trace_section(this, pid);
 			process_epg(this, pid);
 			this->pids[pid].section.size = 0;
 		}
@@ -3527,7 +7745,7 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 	if (this->pids[pid].type == PID_TYPE_PMT) {
 		
 #ifdef TS_PMT_LOG
-		printf ("demux_ts: PMT prog: 0x%.4x pid: 0x%.4x\n",
+		dlog( LOG_CAT_DEMUX, "demux_ts: PMT prog: 0x%.4x pid: 0x%.4x\n",
 			this->programs[this->pids[pid].program_count].program_id,
 			pid);
 #endif
@@ -3547,7 +7765,7 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 	}
 	if (this->pids[pid].type == PID_TYPE_CA_ECM) {
 #ifdef TS_LOG
-		printf ("demux_ts: CA prog: 0x%.4x pid: 0x%.4x\n",
+		dlog( LOG_CAT_DEMUX, "demux_ts: CA prog: 0x%.4x pid: 0x%.4x\n",
 			this->programs[this->pids[pid].program_count].program_id,
 			pid);
 		demux_ts_parse_ecm (this, originalPkt, data_offset-4,
@@ -3558,6 +7776,414 @@ static void demux_ts_parse_packet (struct demux_ts_s *this, uint8_t *packet)
 	return;
 }
 
+/* Query server. With -u loadepg stays up after the input ends and answers
+ * requests on a Unix stream socket, one request per line:
+ *
+ *   NOW <channel>|* [<time>]     what is on at time (default now) and what follows
+ *   RANGE <channel> <from> <to>  events of a channel overlapping [from, to)
+ *   SEARCH <text>                events whose title contains text, any case
+ *   CHANGES <token>              events changed after token, 0 for all
+ *   RELOAD                       reload the dictionary and themes
+ *
+ * Every event is one tab separated line
+ *   <ChannelId> <EventId> <start> <duration> <theme> <title> <summary>
+ * except that CHANGES gives an event the -x delta deleted as
+ *   D <ChannelId> <EventId>
+ * and a reply ends with "OK <count> <token>" or "ERR <reason>", token being
+ * the change sequence to pass to the next CHANGES. Clients are served
+ * between TS packets through non-blocking sockets, a slow reader only
+ * grows its own output buffer and never holds up the demux.
+ */
+#define SERVER_MAX_CLIENTS 256
+#define SERVER_MAX_REQUEST 1024
+#define SERVER_MAX_OUTPUT ( 64 * 1024 * 1024 ) /* A client that stops reading is dropped past this */
+#define SERVER_SEARCH_LIMIT 1000
+#define SERVER_POLL_PACKETS 256 /* TS packets between looking at the clients */
+
+struct server_client_s {
+	int fd;
+	char in[SERVER_MAX_REQUEST];
+	int in_used;
+	char *out;
+	size_t out_used;
+	size_t out_sent;
+	size_t out_size;
+};
+
+struct server_s {
+	int listen_fd;
+	const char *path;
+	struct server_client_s clients[SERVER_MAX_CLIENTS];
+	int client_count;
+	struct pollfd fds[SERVER_MAX_CLIENTS + 2];
+	uint64_t requests;
+	double busy_seconds; /* Spent answering requests */
+};
+struct server_s server = { -1 };
+volatile sig_atomic_t server_stop;
+
+static void server_stop_handler( int sig )
+{
+	server_stop = 1;
+}
+
+int server_open( const char *Path )
+{
+	struct sockaddr_un addr;
+
+	if( strlen( Path ) >= sizeof( addr.sun_path ) ) {
+		printf( "Server: socket path '%s' too long\n", Path );
+		return 0;
+	}
+	server.listen_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( server.listen_fd < 0 ) {
+		printf( "Server: socket failed. %s\n", strerror( errno ) );
+		return 0;
+	}
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, Path );
+	unlink( Path );
+	if( bind( server.listen_fd, ( struct sockaddr * ) &addr, sizeof( addr ) ) < 0 ||
+		listen( server.listen_fd, 64 ) < 0 ) {
+		printf( "Server: cannot listen on '%s'. %s\n", Path, strerror( errno ) );
+		close( server.listen_fd );
+		server.listen_fd = -1;
+		return 0;
+	}
+	fcntl( server.listen_fd, F_SETFL, O_NONBLOCK );
+	server.path = Path;
+	printf( "Server: listening on '%s'\n", Path );
+	return 1;
+}
+
+static void server_drop( int n )
+{
+	struct server_client_s *K = &server.clients[n];
+	close( K->fd );
+	free( K->out );
+	server.client_count--;
+	if( n != server.client_count ) {
+		*K = server.clients[server.client_count];
+	}
+}
+
+static void server_printf( struct server_client_s *K, const char *Format, ... )
+{
+	va_list ap;
+	size_t size;
+	char *out;
+	int len;
+
+	for( ;; ) {
+		va_start( ap, Format );
+		len = vsnprintf( K->out + K->out_used, K->out_size - K->out_used, Format, ap );
+		va_end( ap );
+		if( len < 0 ) {
+			return;
+		}
+		if( K->out_used + len < K->out_size ) {
+			K->out_used += len;
+			return;
+		}
+		size = K->out_size ? K->out_size * 2 : 65536;
+		while( size <= K->out_used + len ) {
+			size *= 2;
+		}
+		out = realloc( K->out, size );
+		if( !out ) {
+			return;
+		}
+		K->out = out;
+		K->out_size = size;
+	}
+}
+
+static void server_event( struct server_client_s *K, uint32_t row )
+{
+	server_printf( K, "%u\t%u\t%" PRIu64 "\t%u\t%u\t%s\t%s\n",
+		lChannels[events.channel[row]].ChannelId, events.event_id[row],
+		events.epoch + events.start[row], events.duration[row], events.theme[row],
+		string_get( &string_pool, events.title_id[row] ), event_string( events.summary_id[row] ) );
+}
+
+static struct channel_s *server_channel( const char *Arg )
+{
+	char *end;
+	unsigned long id = strtoul( Arg, &end, 0 );
+
+	if( end == Arg || id > 0xffff ) {
+		return NULL;
+	}
+	return channel_find( id );
+}
+
+/* What is on C at t, if anything, and the event after it. Returns how many were written. */
+static int server_now_next( struct server_client_s *K, struct channel_s *C, uint64_t t )
+{
+	uint32_t row;
+	int count = 0;
+	int pos;
+
+	pos = channel_events_bound( C, t > events.epoch ? t - events.epoch : 0, 1 );
+	if( pos > 0 ) {
+		row = C->events[pos - 1];
+		if( events.epoch + events.start[row] + events.duration[row] > t ) {
+			server_event( K, row );
+			count++;
+		}
+	}
+	if( pos < C->events_count && ( events.flags[C->events[pos]] & EVENT_FLAG_TITLE ) ) {
+		server_event( K, C->events[pos] );
+		count++;
+	}
+	return count;
+}
+
+/* Case insensitive, Needle already in lower case */
+static int server_title_match( const char *Title, const char *Needle, int Length )
+{
+	int n;
+
+	for( ; *Title; Title++ ) {
+		for( n = 0; n < Length && Title[n] && tolower( ( unsigned char ) Title[n] ) == Needle[n]; n++ ) {
+		}
+		if( n == Length ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void server_request( struct server_client_s *K, char *Line )
+{
+	struct channel_s *C;
+	char *arg[4];
+	char *save;
+	char *text = NULL;
+	uint64_t t, from, to;
+	uint32_t row, token;
+	int argc, count, n, pos, len;
+
+	if( !( arg[0] = strtok_r( Line, " \t\r", &save ) ) ) {
+		return;
+	}
+	argc = 1;
+	if( !strcasecmp( arg[0], "SEARCH" ) ) {
+		/* The text is the rest of the line, spaces and all */
+		text = save + strspn( save, " \t" );
+	} else {
+		for( ; argc < 4 && ( arg[argc] = strtok_r( NULL, " \t\r", &save ) ); argc++ ) {
+		}
+	}
+	count = 0;
+	if( !strcasecmp( arg[0], "NOW" ) && argc >= 2 ) {
+		t = argc >= 3 ? strtoull( arg[2], NULL, 0 ) : ( uint64_t ) time( NULL );
+		if( !strcmp( arg[1], "*" ) ) {
+			for( n = 0; n < nChannels; n++ ) {
+				count += server_now_next( K, &lChannels[n], t );
+			}
+		} else if( ( C = server_channel( arg[1] ) ) ) {
+			count = server_now_next( K, C, t );
+		} else {
+			server_printf( K, "ERR unknown channel\n" );
+			return;
+		}
+	} else if( !strcasecmp( arg[0], "RANGE" ) && argc == 4 ) {
+		if( !( C = server_channel( arg[1] ) ) ) {
+			server_printf( K, "ERR unknown channel\n" );
+			return;
+		}
+		from = strtoull( arg[2], NULL, 0 );
+		to = strtoull( arg[3], NULL, 0 );
+		/* Events of a channel do not overlap, only the one before can reach into the range */
+		pos = channel_events_bound( C, from > events.epoch ? from - events.epoch : 0, 1 );
+		for( pos = pos > 0 ? pos - 1 : 0; pos < C->events_count; pos++ ) {
+			row = C->events[pos];
+			if( !( events.flags[row] & EVENT_FLAG_TITLE ) || events.epoch + events.start[row] >= to ) {
+				break;
+			}
+			if( events.epoch + events.start[row] + events.duration[row] > from ) {
+				server_event( K, row );
+				count++;
+			}
+		}
+	} else if( text ) {
+		len = strlen( text );
+		while( len > 0 && strchr( " \t\r", text[len - 1] ) ) {
+			len--;
+		}
+		if( !len ) {
+			server_printf( K, "ERR bad request\n" );
+			return;
+		}
+		for( n = 0; n < len; n++ ) {
+			text[n] = tolower( ( unsigned char ) text[n] );
+		}
+		for( row = 0; row < events.count && count < SERVER_SEARCH_LIMIT; row++ ) {
+			if( ( events.flags[row] & EVENT_FLAG_TITLE ) &&
+				server_title_match( string_get( &string_pool, events.title_id[row] ), text, len ) ) {
+				server_event( K, row );
+				count++;
+			}
+		}
+	} else if( !strcasecmp( arg[0], "CHANGES" ) && argc == 2 ) {
+		token = strtoul( arg[1], NULL, 0 );
+		for( row = 0; row < events.count; row++ ) {
+			if( events.seq[row] <= token ) {
+				continue;
+			}
+			if( events.flags[row] & EVENT_FLAG_TITLE ) {
+				server_event( K, row );
+				count++;
+			} else if( events.flags[row] & EVENT_FLAG_DELETED ) {
+				/* The row keeps its channel and EventId as a tombstone */
+				server_printf( K, "D\t%u\t%u\n", lChannels[events.channel[row]].ChannelId, events.event_id[row] );
+				count++;
+			}
+		}
+	} else if( !strcasecmp( arg[0], "RELOAD" ) && argc == 1 ) {
+		/* Done between TS packets, like SIGHUP */
+		reload_requested = 1;
+	} else {
+		server_printf( K, "ERR bad request\n" );
+		return;
+	}
+	server_printf( K, "OK %d %u\n", count, events.last_seq );
+}
+
+/* Returns 0 when the client has to be dropped */
+static int server_client_read( struct server_client_s *K )
+{
+	struct timespec begin, end;
+	char *newline;
+	char *line;
+	ssize_t tmp;
+
+	tmp = read( K->fd, K->in + K->in_used, sizeof( K->in ) - K->in_used );
+	if( tmp < 0 ) {
+		return errno == EAGAIN || errno == EINTR;
+	}
+	if( tmp == 0 ) {
+		return 0;
+	}
+	K->in_used += tmp;
+	line = K->in;
+	while( ( newline = memchr( line, '\n', K->in + K->in_used - line ) ) ) {
+		*newline = 0;
+		clock_gettime( CLOCK_MONOTONIC, &begin );
+		server_request( K, line );
+		clock_gettime( CLOCK_MONOTONIC, &end );
+		server.busy_seconds += ( end.tv_sec - begin.tv_sec ) + ( end.tv_nsec - begin.tv_nsec ) / 1e9;
+		server.requests++;
+		line = newline + 1;
+	}
+	K->in_used -= line - K->in;
+	memmove( K->in, line, K->in_used );
+	if( K->in_used == sizeof( K->in ) ) {
+		/* No newline in a whole buffer */
+		return 0;
+	}
+	return K->out_used - K->out_sent <= SERVER_MAX_OUTPUT;
+}
+
+static int server_client_write( struct server_client_s *K )
+{
+	ssize_t tmp;
+
+	while( K->out_sent < K->out_used ) {
+		tmp = send( K->fd, K->out + K->out_sent, K->out_used - K->out_sent, MSG_NOSIGNAL );
+		if( tmp < 0 ) {
+			return errno == EAGAIN || errno == EINTR;
+		}
+		K->out_sent += tmp;
+	}
+	K->out_sent = K->out_used = 0;
+	return 1;
+}
+
+/* Accept and serve whatever is ready, waiting up to Timeout ms (-1 for
+ * ever). When Fd is not -1 the wait also ends when it becomes readable.
+ */
+void server_poll( int Timeout, int Fd )
+{
+	struct server_client_s *K;
+	struct pollfd *P;
+	int count;
+	int fd;
+	int n;
+
+	if( server.listen_fd < 0 ) {
+		return;
+	}
+	P = server.fds;
+	P[0].fd = server.listen_fd;
+	P[0].events = server.client_count < SERVER_MAX_CLIENTS ? POLLIN : 0;
+	for( n = 0; n < server.client_count; n++ ) {
+		K = &server.clients[n];
+		P[n + 1].fd = K->fd;
+		P[n + 1].events = POLLIN | ( K->out_sent < K->out_used ? POLLOUT : 0 );
+	}
+	count = server.client_count + 1;
+	if( Fd >= 0 ) {
+		P[count].fd = Fd;
+		P[count].events = POLLIN;
+		count++;
+	}
+	if( poll( P, count, Timeout ) <= 0 ) {
+		return;
+	}
+	/* Backwards, dropping a client moves the last one into its place */
+	for( n = server.client_count - 1; n >= 0; n-- ) {
+		K = &server.clients[n];
+		if( !P[n + 1].revents ) {
+			continue;
+		}
+		if( ( P[n + 1].revents & ( POLLERR | POLLNVAL ) ) ||
+			( ( P[n + 1].revents & ( POLLIN | POLLHUP ) ) && !server_client_read( K ) ) ||
+			!server_client_write( K ) ) {
+			server_drop( n );
+		}
+	}
+	if( P[0].revents & POLLIN ) {
+		while( server.client_count < SERVER_MAX_CLIENTS && ( fd = accept( server.listen_fd, NULL, NULL ) ) >= 0 ) {
+			fcntl( fd, F_SETFL, O_NONBLOCK );
+			K = &server.clients[server.client_count++];
+			memset( K, 0, sizeof( *K ) );
+			K->fd = fd;
+		}
+	}
+}
+
+/* Serve until SIGTERM or SIGINT, once the input has ended */
+void server_run( void )
+{
+	if( server.listen_fd < 0 ) {
+		return;
+	}
+	printf( "Server: input done, serving until SIGTERM\n" );
+	fflush( stdout );
+	while( !server_stop ) {
+		server_poll( -1, -1 );
+		tables_quiescent();
+	}
+}
+
+void server_close( void )
+{
+	if( server.listen_fd < 0 ) {
+		return;
+	}
+	while( server.client_count ) {
+		server_drop( server.client_count - 1 );
+	}
+	close( server.listen_fd );
+	unlink( server.path );
+	server.listen_fd = -1;
+	printf( "Server: %" PRIu64 " requests, %.1f us each on average\n", server.requests,
+		server.requests ? server.busy_seconds * 1e6 / server.requests : 0.0 );
+}
+
 #if 0
 static int detect_ts(uint8_t *buf, size_t len, int ts_size)
 {
@@ -3576,7 +8202,7 @@ static int detect_ts(uint8_t *buf, size_t len, int ts_size)
       }
       if (try_again == 0) {
 #ifdef TS_LOG
-	printf ("demux_ts: found 0x47 pattern at offset %d\n", i);
+	dlog( LOG_CAT_DEMUX, "demux_ts: found 0x47 pattern at offset %d\n", i);
 #endif
 	ts_detected = 1;
       }
@@ -3587,30 +8213,184 @@ static int detect_ts(uint8_t *buf, size_t len, int ts_size)
 }
 #endif
 
+static void usage(char *name)
+{
+	printf("usage: %s [options] <filename.ts>\n", name);
+	printf("       %s -R [options] <sections.trace>\n", name);
+	printf("  -d <file>  huffman dictionary (default %s)\n", dict_file);
+	printf("  -t <file>  themes (default %s)\n", themes_file);
+	printf("  -p <file>  write a huffman dictionary profile to <file>\n");
+	printf("  -c <file>  only decode the channels listed in <file>\n");
+	printf("  -D <file>  load the EPG database <file> at start and save it at exit\n");
+	printf("  -x <file>  write what changed since the -D database to <file>\n");
+	printf("  -m <MB>    memory budget for decoded data, summaries over it go to disk\n");
+	printf("             (covers the event arena only, not the spill index or export buffers)\n");
+	printf("  -o <file>  write XMLTV to <file>, same as -E xmltv:<file>\n");
+	printf("  -V <file>  write VDR epg.data to <file>, same as -E vdr:<file>\n");
+#ifdef HAVE_SQLITE
+	printf("  -E <format>:<file>  export as xmltv, vdr, jsonl, columnar, eit or sqlite, may be repeated\n");
+#else
+	printf("  -E <format>:<file>  export as xmltv, vdr, jsonl, columnar or eit, may be repeated\n");
+#endif
+	printf("  -b <bit/s> write the eit export at this rate, e.g. to a FIFO feeding a multiplexer\n");
+	printf("  -s         write each channel to the exports as soon as its carousel is complete\n");
+	printf("  -P <port>  send the EPG to the VDR on this host with SVDRP PUTE (VDR uses %d)\n", VDR_SVDRP_PORT);
+	printf("  -e <file>  channel equivalences for -V/-P (e.g. conf/loadepg.equiv)\n");
+	printf("  -S <src>   VDR source of the channels (default %s)\n", VDR_SOURCE);
+	printf("  -w <time>  print now/next on every channel at unix <time>\n");
+	printf("  -u <path>  answer queries on the Unix socket <path>, staying up after the input ends\n");
+	printf("  -M <name>  publish the EPG in the shared memory object <name> for epgshm.h readers\n");
+	printf("  -T <file>  record every completed section to the trace <file>\n");
+	printf("  -R         the input is a section trace, replay it instead of parsing TS\n");
+	printf("  -l <spec>  log level, either for everything or <category>=<level>,...\n");
+	printf("             categories demux, sdt, bat, titles, summary, huffman, tables\n");
+	printf("             levels none, error, info (default), debug, dump\n");
+	printf("Send SIGHUP to reload the dictionary and themes, SIGTERM to stop -u.\n");
+}
+
 int main(int argc, char *argv[])
 {
 	char *filename;
-	//char *out_file = "ecm-out.ts";
 	int tmp;
 	int in_fd;
-	int out_fd;
-	int l, n, m;
+	int n;
 	int pid;
 	int scrambling_control;
-	int pid_counter = 0;
-	int found;
-	char *name;
-//	struct sNode *H;
-//	H = malloc(sizeof(struct sNode));
-//        tmp = read_huff_dict( &H );
-        tmp = read_huff_dict();
-	printf ("read_huff_dict:result = %d\n",tmp);
-
-        if(argc<2) {
-                printf("usage: %s <filename.ts>\n",argv[0]);
+	char *huffman_profile_file = NULL;
+	char *epgdb_file = NULL;
+	char *delta_file = NULL;
+	char *trace_file = NULL;
+	char *server_path = NULL;
+	int replay = 0;
+	char *export_format[8];
+	char *export_file[8];
+	int export_count = 0;
+	char *colon;
+	int svdrp_port = 0;
+	uint64_t now_next_time = 0;
+	int opt;
+	struct sigaction sa;
+	struct rusage rusage;
+	struct timespec parse_start, parse_end;
+	double parse_seconds;
+
+	while ((opt = getopt(argc, argv, "b:c:d:D:e:E:l:m:M:o:p:P:RsS:t:T:u:V:w:x:")) != -1) {
+		switch (opt) {
+		case 'b':
+			eit_bitrate = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			if (!read_channel_filter(&channel_filter, optarg)) {
+				return 1;
+			}
+			break;
+		case 'd':
+			dict_file = optarg;
+			break;
+		case 'D':
+			epgdb_file = optarg;
+			break;
+		case 'x':
+			delta_file = optarg;
+			break;
+		case 'o':
+		case 'V':
+		case 'E':
+			if (export_count == 8) {
+				usage(argv[0]);
+				return 1;
+			}
+			if (opt == 'E') {
+				colon = strchr(optarg, ':');
+				if (!colon) {
+					usage(argv[0]);
+					return 1;
+				}
+				*colon = 0;
+				export_format[export_count] = optarg;
+				export_file[export_count] = colon + 1;
+			} else {
+				export_format[export_count] = opt == 'o' ? "xmltv" : "vdr";
+				export_file[export_count] = optarg;
+			}
+			export_count++;
+			break;
+		case 's':
+			export_streaming = 1;
+			break;
+		case 'T':
+			trace_file = optarg;
+			break;
+		case 'R':
+			replay = 1;
+			break;
+		case 'u':
+			server_path = optarg;
+			break;
+		case 'P':
+			svdrp_port = atoi(optarg);
+			break;
+		case 'e':
+			if (!read_equiv(optarg)) {
+				return 1;
+			}
+			break;
+		case 'S':
+			vdr_source = optarg;
+			break;
+		case 'l':
+			if (!log_parse(optarg)) {
+				return 1;
+			}
+			break;
+		case 'M':
+			if (!shm_publish_open(optarg)) {
+				return 1;
+			}
+			break;
+		case 'm':
+			epg_arena.limit = strtoull(optarg, NULL, 0) * 1024 * 1024;
+			break;
+		case 't':
+			themes_file = optarg;
+			break;
+		case 'p':
+			/* Huffman profiler: symbol frequencies and unknown prefixes */
+			huffman_profile_file = optarg;
+			huffman_profile = 1;
+			break;
+		case 'w':
+			now_next_time = strtoull(optarg, NULL, 0);
+			events_by_time.anchor_hour = now_next_time / INTERVAL_BUCKET_SECONDS;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+        if(optind >= argc) {
+		usage(argv[0]);
                 return 1;
         }
-	filename = argv[1];
+	filename = argv[optind];
+	tmp = reload_tables();
+	printf ("read_huff_dict:result = %d\n",tmp);
+	if (!tmp) {
+		/* Carry on with an empty dictionary, as before */
+		tables = calloc(1, sizeof(struct tables_s));
+	}
+	/* SIGHUP reloads the dictionary and themes without losing EPG state */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sighup_handler;
+	sigaction(SIGHUP, &sa, NULL);
+	if (server_path) {
+		if (!server_open(server_path)) {
+			return 1;
+		}
+		sa.sa_handler = server_stop_handler;
+		sigaction(SIGTERM, &sa, NULL);
+		sigaction(SIGINT, &sa, NULL);
+	}
 	demux_ts.pids = calloc(0x2000, sizeof(struct pid_s));
 	for(n = 0; n < 0x2000; n++) {
 		demux_ts.pids[n].program_count = INVALID_PROGRAM;
@@ -3619,20 +8399,12 @@ int main(int argc, char *argv[])
 		demux_ts.pids[n].section.buffer_target = 0;
 	}
 	demux_ts.pids[0].type = PID_TYPE_PAT;
+	demux_ts.transport_stream_id = -1;
+	demux_ts.original_network_id = -1;
 
-	demux_ts.programs = calloc(256, sizeof(struct program_s));
 	for(n = 0; n < 256; n++) {
 		section_c0[n].total_length = 0;
 	}
-	for(n = 0; n < 256; n++) {
-		demux_ts.programs[n].program_id = INVALID_PROGRAM;
-	}
-	demux_ts.services = calloc(MAX_SERVICES, sizeof(struct service_s));
-	for(n = 0; n < MAX_SERVICES; n++) {
-		demux_ts.services[n].program_id = INVALID_PROGRAM;
-		demux_ts.services[n].provider = 0;
-		demux_ts.services[n].name = 0;
-	}
 	demux_ts_build_crc32_table(&demux_ts);
 
 #if 0
@@ -3642,23 +8414,12 @@ int main(int argc, char *argv[])
     	    return 0;
     	}
 #endif
-	nChannels = 0;
-	lChannels = (struct channel_s *) calloc(MAX_CHANNELS, sizeof(struct channel_s));
-    	if (!lChannels) {
-            printf("failed to allocate memory for lChannels");
-    	    return 0;
-    	}
-	channels_all = (uint16_t *) calloc(65536, sizeof(uint16_t));
-	for(n = 0; n < 65536; n++) {
-		channels_all[n] = 0xffff;
+	if (epgdb_file && epgdb_load(epgdb_file) < 0) {
+		/* Do not replace something we could not read with this run alone */
+		printf("EpgDB: not saving to '%s'\n", epgdb_file);
+		epgdb_file = NULL;
 	}
 	
-    	nBouquets = 0;
-	lBouquets = (struct bouquet_s *) calloc(MAX_BOUQUETS, sizeof(struct bouquet_s));
-    	if (!lBouquets) {
-    	    printf("failed to allocate memory for lBouquets");
-    	    return 0;
-    	}
 #if 0
     	lTitles = (struct title_s *) calloc(MAX_TITLES, sizeof(struct title_s));
     	if (!lTitles) {
@@ -3688,36 +8449,123 @@ int main(int argc, char *argv[])
 #endif
 
 
-	tmp = in_fd = open(filename, O_RDONLY | O_NONBLOCK);
-	if (tmp < 0) {
-		printf("Open failed: %s\n", strerror(errno));
+	for (n = 0; n < export_count; n++) {
+		if (!export_start(export_format[n], export_file[n])) {
+			export_abort();
+			return 1;
+		}
+	}
+	if (trace_file && !epgtrace_create(&section_trace, trace_file)) {
+		printf("Trace: cannot create '%s'. %s\n", trace_file, strerror(errno));
+		export_abort();
 		return 1;
 	}
-	for(n = 0; ; n++) {
-		printf("\n\n");
-		tmp = read(in_fd, buffer, 188);
-		if (tmp < 188) {
-			printf("Read failed: %s\n", strerror(errno));
-			break;
+	demux_ts.pcr = -1;
+	if (replay) {
+		clock_gettime(CLOCK_MONOTONIC, &parse_start);
+		n = trace_replay(&demux_ts, filename);
+		if (n < 0) {
+			export_abort();
+			return 1;
 		}
-		if (buffer[0] != 0x47) {
-			printf("Found no sync\n");
+		clock_gettime(CLOCK_MONOTONIC, &parse_end);
+		parse_seconds = (parse_end.tv_sec - parse_start.tv_sec) + (parse_end.tv_nsec - parse_start.tv_nsec) / 1e9;
+		printf("LoadEPG: replayed %d sections in %.3f s\n", n, parse_seconds);
+	} else {
+		tmp = in_fd = open(filename, O_RDONLY | O_NONBLOCK);
+		if (tmp < 0) {
+			printf("Open failed: %s\n", strerror(errno));
+			export_abort();
 			return 1;
 		}
-		pid = (buffer[2] + (buffer[1] << 8)) & 0x1fff;
-		if (pid == 0) {
-			memcpy(pat, buffer, 188);
+		clock_gettime(CLOCK_MONOTONIC, &parse_start);
+		for(n = 0; ; n++) {
+			xlog(LOG_CAT_DEMUX, "\n\n");
+			if (n % SERVER_POLL_PACKETS == 0) {
+				server_poll(0, -1);
+				shm_publish(0);
+			}
+			if (server_stop) {
+				break;
+			}
+			tmp = read(in_fd, buffer, 188);
+			if (tmp < 0 && errno == EAGAIN && server.listen_fd >= 0 && !server_stop) {
+				/* Live input with nothing to read, serve clients meanwhile */
+				server_poll(-1, in_fd);
+				n--;
+				continue;
+			}
+			if (tmp < 188) {
+				printf("Read failed: %s\n", strerror(errno));
+				break;
+			}
+			if (buffer[0] != 0x47) {
+				printf("Found no sync\n");
+				export_abort();
+				return 1;
+			}
+			pid = (buffer[2] + (buffer[1] << 8)) & 0x1fff;
+			if (pid == 0) {
+				memcpy(pat, buffer, 188);
+			}
+			scrambling_control = (buffer[3] >> 6);
+			demux_ts.pids[pid].present = 1;
+			if (scrambling_control & 2) {
+				demux_ts.pids[pid].scrambling_control = scrambling_control;
+			}
+			demux_ts.packet_index = n;
+			demux_ts_parse_packet(&demux_ts, buffer);
+			tables_quiescent();
+			if (server.listen_fd >= 0 && epg_generation_complete()) {
+				/* A daemon would otherwise keep every generation */
+				epg_rotate();
+			}
 		}
-		scrambling_control = (buffer[3] >> 6);
-		demux_ts.pids[pid].present = 1;
-		if (scrambling_control & 2) {
-			demux_ts.pids[pid].scrambling_control = scrambling_control;
+		clock_gettime(CLOCK_MONOTONIC, &parse_end);
+		close(in_fd);
+		parse_seconds = (parse_end.tv_sec - parse_start.tv_sec) + (parse_end.tv_nsec - parse_start.tv_nsec) / 1e9;
+		printf("LoadEPG: parsed %d packets (%.1f MB) in %.3f s, %.1f MB/s\n", n, n * 188.0 / 1e6,
+			parse_seconds, parse_seconds > 0 ? n * 188.0 / 1e6 / parse_seconds : 0.0);
+	}
+	if (section_trace.file) {
+		tmp = section_trace.header.record_count;
+		if (!epgtrace_finish(&section_trace)) {
+			printf("Trace: error writing '%s'. %s\n", trace_file, strerror(errno));
+		} else {
+			printf("Trace: %d sections written to '%s'\n", tmp, trace_file);
 		}
-		demux_ts_parse_packet(&demux_ts, buffer);
 	}
-	close(in_fd);
+	if (delta_file) {
+		delta_write(delta_file);
+	}
+	export_finish();
+	if (svdrp_port) {
+		vdr_svdrp_push(svdrp_port);
+	}
+	if (epgdb_file) {
+		epgdb_write(epgdb_file);
+	}
+	if (huffman_profile_file) {
+		write_huffman_profile(huffman_profile_file);
+	}
+	print_string_pool_stats(&string_pool);
+	if (channel_filter.enabled) {
+		printf("Channel filter: %" PRIu64 " sections skipped\n", channel_filter.skipped);
+	}
+	if (now_next_time) {
+		print_now_next(now_next_time);
+	}
+	shm_publish(1);
+	server_run();
+	server_close();
+	shm_publish_close();
 
 #if 0
+	{
+	char *out_file = "ecm-out.ts";
+	int out_fd;
+	int pid_counter = 0;
+
 	tmp = out_fd = open(out_file, O_CREAT | O_WRONLY | O_NONBLOCK, S_IRWXU);
 	if (tmp < 0) {
 		printf("Open failed: %s\n", strerror(errno));
@@ -3750,6 +8598,7 @@ int main(int argc, char *argv[])
 		}
 	}
 	close(out_fd);
+	}
 #endif		
 
 	for(n = 0; n < 0x2000; n++) {
@@ -3757,21 +8606,16 @@ int main(int argc, char *argv[])
 			printf("PID=0x%04x SC=%d Program=0x%0x type=%d:%s pid_for_ecm=0x%x\n", n, demux_ts.pids[n].scrambling_control, demux_ts.pids[n].program_count, demux_ts.pids[n].type, type[demux_ts.pids[n].type], demux_ts.pids[n].pid_for_ecm);
 		}
 	}
-	for(n = 0; n < 255; n++) {
-	    	if (demux_ts.programs[n].program_id != INVALID_PROGRAM) {
-			for(m = 0; m < MAX_SERVICES; m++) {
-				if (demux_ts.programs[n].program_id == demux_ts.services[m].program_id) {
-					demux_ts.programs[n].service_count = m;
-					break;
-				}
-			}
-		}
-	}
+	channel_join();
 
 #if 0
 				
-	for(n = 0; n < 255; n++) {
-	    	if (demux_ts.programs[n].program_id != INVALID_PROGRAM) {
+	{
+	int l;
+	char *name;
+
+	for(n = 0; n < demux_ts.number_of_programs; n++) {
+	    	{
 			printf ("demux_ts: PAT acquired count=%d programNumber=0x%04x "
 				"pmtPid=0x%04x video_pid=0x%04x video_ca_pid=0x%04x "
 				"audio_pid=0x%04x audio_ca_pid=0x%04x, name=%s\n",
@@ -3782,35 +8626,25 @@ int main(int argc, char *argv[])
 				demux_ts.programs[n].video.ca_pid,
 				demux_ts.programs[n].audio.pid,
 				demux_ts.programs[n].audio.ca_pid,
-				demux_ts.services[demux_ts.programs[n].service_count].name);
+				demux_ts.programs[n].service_count < 0 ? "" :
+				string_get(&string_pool, demux_ts.services.services[demux_ts.programs[n].service_count].name_id));
 		}
 	}
-	for(n = 0; n < MAX_SERVICES; n++) {
-	    	if (demux_ts.services[n].program_id != INVALID_PROGRAM) {
-			printf ("demux_ts: SDT acquired count=%d programNumber(Sid)=0x%04x "
-				"provider=%s name=%s\n",
-				n,
-				demux_ts.services[n].program_id,
-				demux_ts.services[n].provider,
-				demux_ts.services[n].name);
-		}
+	for(n = 0; n < demux_ts.services.count; n++) {
+		printf ("demux_ts: SDT acquired count=%d programNumber(Sid)=0x%04x "
+			"provider=%s name=%s\n",
+			n,
+			demux_ts.services.services[n].program_id,
+			string_get(&string_pool, demux_ts.services.services[n].provider_id),
+			string_get(&string_pool, demux_ts.services.services[n].name_id));
 	}
 	printf("nChannels = 0x%x\n", nChannels);
 	for(n = 0; n < nChannels; n++) {
-		qsort( lChannels[n].events, lChannels[n].events_count, sizeof( struct event_s ), &qsort_events_by_time );
 	    	if (lChannels[n].ChannelId == 0x540) {
 //	    	if (lChannels[n].ChannelId == 0x86a) {
-			found = MAX_SERVICES;
-			for(m = 0; m < MAX_SERVICES; m++) {
-				if (demux_ts.services[m].program_id == lChannels[n].Sid) {
-					found = m;
-					break;
-				}
-			}
-			if (found == MAX_SERVICES) {
+			name = channel_service_name(&lChannels[n]);
+			if (!name) {
 				name="JCD:NOT FOUND";
-			} else {
-				name=demux_ts.services[found].name;
 			}
 			printf ("demux_ts: CHANNELS 0x%04x:ChannelID = 0x%x, Nid = 0x%x, Tid = 0x%x, Sid = 0x%x, SkyNumber = %d, %d, Info = 0x%x:%s, events_count=%d, Name=%s\n",
 				n,
@@ -3827,25 +8661,31 @@ int main(int argc, char *argv[])
 			if (lChannels[n].events_count) {
 				for(l = 0; l < lChannels[n].events_count; l++) {
 					struct tm tm1, *tm2;
+					struct event_s E, E_next;
 					int fail = 0;
 					uint64_t next_time;
-					next_time = lChannels[n].events[l].start_time_title + lChannels[n].events[l].duration_title;
-					if ((lChannels[n].events[l].start_time_title + lChannels[n].events[l].duration_title) != (lChannels[n].events[l + 1].start_time_title) ) {
+					event_row(&events, lChannels[n].events[l], &E);
+					memset(&E_next, 0, sizeof(E_next));
+					if (l + 1 < lChannels[n].events_count) {
+						event_row(&events, lChannels[n].events[l + 1], &E_next);
+					}
+					next_time = E.start_time_title + E.duration_title;
+					if ((E.start_time_title + E.duration_title) != (E_next.start_time_title) ) {
 						fail = 1;
 					}
 					tm2 = &tm1;
-					tm2 = gmtime_r(&lChannels[n].events[l].start_time_title, &tm1);
+					tm2 = gmtime_r(&E.start_time_title, &tm1);
 					printf("demux_ts: EVENT %04x: %04d-%02d-%02d %02d:%02d:%02d, %ld, %ld, %ld, %ld, %d, %s,,,%s\n",
-						lChannels[n].events[l].event_id,
+						E.event_id,
 						tm1.tm_year + 1900, tm1.tm_mon + 1, tm1.tm_mday,
 						tm1.tm_hour, tm1.tm_min, tm1.tm_sec,
-						lChannels[n].events[l].start_time_title,
-						lChannels[n].events[l].duration_title,
+						E.start_time_title,
+						E.duration_title,
 						next_time,
-						lChannels[n].events[l + 1].start_time_title,
+						E_next.start_time_title,
 						fail,
-						lChannels[n].events[l].title,
-						lChannels[n].events[l].summary);
+						string_get(&string_pool, E.title_id),
+						event_string(E.summary_id));
 				}
 			} 
 //		      C->pData = 0;
@@ -3854,7 +8694,12 @@ int main(int argc, char *argv[])
 //		      C->IsEpg = 1;
 		}
 	}
+	}
 #endif
+	epg_release();
+	if (getrusage(RUSAGE_SELF, &rusage) == 0) {
+		printf("Peak RSS: %ld kB\n", rusage.ru_maxrss);
+	}
 
 	return 0;
 }